@@ -0,0 +1,56 @@
+#ifndef __CMSIS_OS_H__
+#define __CMSIS_OS_H__
+#include <stdint.h>
+
+// Host stand-in for the CMSIS-RTOS (RTX) types and calls this project uses
+
+typedef enum {
+  osOK = 0,
+  osEventSignal = 0x08,
+  osEventMessage = 0x10,
+  osEventMail = 0x20,
+  osEventTimeout = 0x40,
+  osErrorParameter = 0x80,
+  osErrorResource = 0x81,
+  osErrorTimeoutResource = 0xC1,
+  osErrorISR = 0x82,
+  osErrorNoMemory = 0x85,
+  osErrorValue = 0x86,
+  osErrorOS = 0xFF
+} osStatus;
+
+typedef enum {
+  osPriorityIdle = -3,
+  osPriorityLow = -2,
+  osPriorityBelowNormal = -1,
+  osPriorityNormal = 0,
+  osPriorityAboveNormal = 1,
+  osPriorityHigh = 2,
+  osPriorityRealtime = 3,
+  osPriorityError = 0x84
+} osPriority;
+
+#define osWaitForever 0xFFFFFFFF
+
+#define DEFAULT_STACK_SIZE 2048
+
+struct os_thread_cb;
+typedef os_thread_cb* osThreadId;
+
+typedef struct {
+  osStatus status;
+  union {
+    uint32_t v;
+    void* p;
+    int32_t signals;
+  } value;
+} osEvent;
+
+osThreadId osThreadGetId(void);
+osPriority osThreadGetPriority(osThreadId thread_id);
+osStatus osThreadSetPriority(osThreadId thread_id, osPriority priority);
+
+// Returns the previous signal flags, or 0x80000000 for a bad thread
+int32_t osSignalSet(osThreadId thread_id, int32_t signals);
+
+#endif //__CMSIS_OS_H__
@@ -0,0 +1,327 @@
+#ifndef __MBED_H__
+#define __MBED_H__
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include "mbed_host.h"
+
+// Host stand-in for the part of the mbed 2 API this project uses, so main()
+// and the sensor drivers build and run unchanged as a Linux process. See
+// mbed_host.h for the clock and interrupt model.
+
+typedef enum {
+  NC = -1,
+  A0, A1, A2, A3, A4, A5,
+  D0, D1, D2, D3, D4, D5, D6, D7, D8, D9, D10, D11, D12, D13, D14, D15,
+  USBTX, USBRX, LED1
+} PinName;
+
+typedef enum { PullNone, PullUp, PullDown, OpenDrain } PinMode;
+
+typedef uint32_t timestamp_t;
+
+extern uint32_t SystemCoreClock;
+
+uint32_t us_ticker_read(void);
+void wait(float s);
+void wait_ms(int ms);
+void wait_us(int us);
+
+// Wait for the next interrupt. deepsleep() is the same thing on the host,
+// nothing stops the clock.
+void sleep(void);
+void deepsleep(void);
+
+void error(const char* format, ...);
+
+void __disable_irq(void);
+void __enable_irq(void);
+// Non-zero on the interrupt thread, like the exception number in handler mode
+uint32_t __get_IPSR(void);
+// Threads have no process stack pointer to sample, this is always 0
+uint32_t __get_PSP(void);
+
+// Cortex-M4 DWT cycle counter, counting wall clock time at SystemCoreClock
+struct HostCycleCounter {
+  uint32_t offset;
+  operator uint32_t() const;
+  HostCycleCounter& operator=(uint32_t value);
+};
+
+struct HostDWT {
+  uint32_t CTRL;
+  HostCycleCounter CYCCNT;
+};
+
+struct HostCoreDebug {
+  uint32_t DEMCR;
+};
+
+extern HostDWT host_dwt;
+extern HostCoreDebug host_core_debug;
+#define DWT (&host_dwt)
+#define CoreDebug (&host_core_debug)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk 1UL
+
+// Plain or member function callback, as in mbed
+class FunctionPointer {
+  void (*_function)(void);
+  void* _object;
+  char _member[16];
+  void (*_membercaller)(void*, char*);
+
+  template<typename T>
+  static void membercaller(void* object, char* member) {
+    T* o = static_cast<T*>(object);
+    void (T::*m)(void);
+    memcpy((char*) &m, member, sizeof(m));
+    (o->*m)();
+  }
+
+public:
+  FunctionPointer(void (*function)(void) = 0) {
+    attach(function);
+  }
+
+  template<typename T>
+  FunctionPointer(T* object, void (T::*member)(void)) {
+    attach(object, member);
+  }
+
+  void attach(void (*function)(void)) {
+    _function = function;
+    _object = 0;
+  }
+
+  template<typename T>
+  void attach(T* object, void (T::*member)(void)) {
+    static_assert(sizeof(member) <= sizeof(_member), "Member function pointer too large");
+    _function = 0;
+    _object = static_cast<void*>(object);
+    memcpy(_member, (char*) &member, sizeof(member));
+    _membercaller = &FunctionPointer::membercaller<T>;
+  }
+
+  bool attached() const {
+    return _function != 0 || _object != 0;
+  }
+
+  void call() {
+    if (_function) {
+      _function();
+    } else if (_object) {
+      _membercaller(_object, _member);
+    }
+  }
+};
+
+// Periodic callback, a timerfd on the interrupt thread
+class Ticker {
+  FunctionPointer _function;
+  uint32_t _source;
+  bool _periodic;
+
+  void setup(timestamp_t t);
+
+protected:
+  Ticker(bool periodic) : _source(0), _periodic(periodic) {};
+
+public:
+  Ticker() : _source(0), _periodic(true) {};
+  virtual ~Ticker() {
+    detach();
+  }
+
+  void attach(void (*fptr)(void), float t) {
+    attach_us(fptr, (timestamp_t) (t * 1000000.0f));
+  }
+
+  template<typename T>
+  void attach(T* tptr, void (T::*mptr)(void), float t) {
+    attach_us(tptr, mptr, (timestamp_t) (t * 1000000.0f));
+  }
+
+  void attach_us(void (*fptr)(void), timestamp_t t) {
+    detach();
+    _function.attach(fptr);
+    setup(t);
+  }
+
+  template<typename T>
+  void attach_us(T* tptr, void (T::*mptr)(void), timestamp_t t) {
+    detach();
+    _function.attach(tptr, mptr);
+    setup(t);
+  }
+
+  void detach();
+};
+
+// A Ticker that calls once
+class Timeout : public Ticker {
+public:
+  Timeout() : Ticker(false) {};
+};
+
+// Nothing drives pins on the host. With MBED_HOST_EDGE_HZ set, every pin
+// with a rise handler sees a rising edge at that rate, which stands in for
+// a sensor data ready line.
+class InterruptIn {
+  FunctionPointer _rise;
+  FunctionPointer _fall;
+  FunctionPointer _edge;
+  bool _enabled;
+  uint32_t _source;
+
+  void edge();
+  void setup();
+
+public:
+  InterruptIn(PinName pin) : _edge(this, &InterruptIn::edge), _enabled(true), _source(0) {};
+  ~InterruptIn();
+
+  void rise(void (*fptr)(void)) {
+    _rise.attach(fptr);
+    setup();
+  }
+
+  template<typename T>
+  void rise(T* tptr, void (T::*mptr)(void)) {
+    _rise.attach(tptr, mptr);
+    setup();
+  }
+
+  void fall(void (*fptr)(void)) {
+    _fall.attach(fptr);
+  }
+
+  template<typename T>
+  void fall(T* tptr, void (T::*mptr)(void)) {
+    _fall.attach(tptr, mptr);
+  }
+
+  void mode(PinMode pull) {};
+  int read() {
+    return 0;
+  }
+  void enable_irq();
+  void disable_irq();
+};
+
+// I2C bus with a register file per device. MBED_HOST_I2C_TRACE names a trace
+// captured on the target with DevI2C::attach_trace_writer; every device in
+// it is present and its registers start out with the values it last read or
+// wrote, so the drivers find their sensors and read recorded samples. Other
+// addresses NACK. Transfers take as long as they would at the bus frequency.
+class I2C {
+  int _hz;
+  int _address;       // of the byte level transfer, -1 until it is sent
+  int _bytes;         // sent to it since the address
+
+public:
+  I2C(PinName sda, PinName scl);
+
+  void frequency(int hz) {
+    _hz = hz;
+  }
+
+  int read(int address, char* data, int length, bool repeated = false);
+  int write(int address, const char* data, int length, bool repeated = false);
+
+  // Byte level: the first byte after start() is the address, returns 1 on ACK
+  void start();
+  void stop();
+  int write(int data);
+};
+
+class DigitalOut {
+  int _value;
+
+public:
+  DigitalOut(PinName pin, int value = 0) : _value(value) {}
+
+  void write(int value) {
+    _value = value;
+  }
+  int read() {
+    return _value;
+  }
+  DigitalOut& operator=(int value) {
+    _value = value;
+    return *this;
+  }
+  operator int() {
+    return _value;
+  }
+};
+
+// SPI bus with nothing on it: MISO idles high, so every frame reads back all
+// ones. Frames take as long as they would at the bus frequency.
+class SPI {
+protected:
+  int _bits;
+  int _mode;
+  int _hz;
+
+public:
+  SPI(PinName mosi, PinName miso, PinName sclk, PinName ssel = NC) : _bits(8), _mode(0), _hz(1000000) {}
+
+  void format(int bits, int mode = 0) {
+    _bits = bits;
+    _mode = mode;
+  }
+  void frequency(int hz = 1000000) {
+    _hz = hz;
+  }
+
+  int write(int value);
+};
+
+// UART on stdout/stdin, paced at the configured baud rate. Only one Serial
+// can own stdin.
+class Serial {
+  int _baud;
+  FunctionPointer _rx;
+
+  void transmitted(int count);
+  void attachRx();
+
+public:
+  enum IrqType { RxIrq = 0, TxIrq };
+
+  Serial(PinName tx, PinName rx, const char* name = NULL);
+
+  void baud(int baudrate) {
+    _baud = baudrate;
+  }
+
+  int printf(const char* format, ...);
+  int puts(const char* str);
+  int putc(int c);
+  int getc();
+  int readable();
+  int writeable() {
+    return 1;
+  }
+
+  void attach(void (*fptr)(void), IrqType type = RxIrq) {
+    if (type == RxIrq) {
+      _rx.attach(fptr);
+      attachRx();
+    }
+  }
+
+  template<typename T>
+  void attach(T* tptr, void (T::*mptr)(void), IrqType type = RxIrq) {
+    if (type == RxIrq) {
+      _rx.attach(tptr, mptr);
+      attachRx();
+    }
+  }
+};
+
+#endif //__MBED_H__
@@ -0,0 +1,648 @@
+#include "mbed.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "I2CTrace.h"
+
+uint32_t SystemCoreClock = 84000000;
+HostDWT host_dwt;
+HostCoreDebug host_core_debug;
+
+namespace mbed_host {
+
+enum SourceKind { TIMER, UART_RX };
+
+struct Source {
+  uint32_t id;
+  SourceKind kind;
+  int fd;
+  FunctionPointer* handler;
+  bool periodic;
+};
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static struct timespec start;
+static bool simulated = false;
+static double speedup = 1.0;
+static double edgeHz = 0;
+
+// The interrupt lock: held by the interrupt thread while it runs ISRs, and
+// by any thread between __disable_irq() and __enable_irq()
+static pthread_mutex_t irqLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t irqDone;
+static __thread bool irqMasked = false;
+static __thread bool inIsr = false;
+
+// Guarded by irqLock. Plain data so it's usable from static constructors,
+// main.cpp probes the sensors before main() runs.
+static const int MAX_SOURCES = 16;
+static Source sources[MAX_SOURCES];
+static uint32_t nextSource = 1;
+static int epollFd = -1;
+
+static pthread_mutex_t rxLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rxReady;
+static char rxBuffer[256];
+static uint32_t rxHead = 0;
+static uint32_t rxCount = 0;
+static uint32_t rxSource = 0;
+
+struct BusDevice {
+  bool present;
+  uint8_t pointer;
+  uint8_t regs[128];
+};
+
+static pthread_mutex_t busLock = PTHREAD_MUTEX_INITIALIZER;
+static BusDevice bus[128];
+
+// Takes the interrupt lock unless this thread already holds it
+class IrqGuard {
+  bool _taken;
+
+public:
+  IrqGuard() : _taken(!irqMasked) {
+    if (_taken) {
+      pthread_mutex_lock(&irqLock);
+      irqMasked = true;
+    }
+  }
+  ~IrqGuard() {
+    if (_taken) {
+      irqMasked = false;
+      pthread_mutex_unlock(&irqLock);
+    }
+  }
+};
+
+static uint64_t wallNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) (now.tv_sec - start.tv_sec) * 1000000000ULL + now.tv_nsec - start.tv_nsec;
+}
+
+// Wall clock ns for a span of simulated time
+static uint64_t toWallNs(uint64_t us) {
+  return (uint64_t) (us * 1000.0 / speedup);
+}
+
+static double envDouble(const char* name, double fallback) {
+  const char* value = getenv(name);
+  return value != NULL ? atof(value) : fallback;
+}
+
+// Seed the register files from a trace: a device is present if it ever
+// acknowledged, each register holds the last value transferred
+static void loadTrace(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    error("mbed_host: can't open I2C trace %s\n", path);
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t* trace = (uint8_t*) malloc(size);
+  if (trace == NULL || fread(trace, 1, size, file) != (size_t) size) {
+    error("mbed_host: can't read I2C trace %s\n", path);
+  }
+  fclose(file);
+
+  I2CTraceReader reader(trace, size);
+  if (!reader.rewind()) {
+    error("mbed_host: %s is not an I2C trace\n", path);
+  }
+  I2CTraceRecord rec;
+  uint32_t records = 0;
+  while (reader.next(&rec) == 1) {
+    if (rec.flags & I2C_TRACE_FLAG_ERROR) {
+      continue;
+    }
+    BusDevice& device = bus[(rec.address >> 1) & 0x7F];
+    device.present = true;
+    for (uint16_t i = 0; i < rec.length; i++) {
+      device.regs[(rec.reg + i) & 0x7F] = rec.data[i];
+    }
+    records++;
+  }
+  free(trace);
+  fprintf(stderr, "mbed_host: %lu transfers loaded from %s\n", (unsigned long) records, path);
+}
+
+static void finish() {
+  fflush(stdout);
+  fprintf(stderr, "mbed_host: %.3f s simulated in %.3f s\n",
+          now_us() / 1e6, wallNs() / 1e9);
+  _exit(0);
+}
+
+static Source* findSource(uint32_t id) {
+  for (int i = 0; i < MAX_SOURCES; i++) {
+    if (sources[i].id == id) {
+      return &sources[i];
+    }
+  }
+  return NULL;
+}
+
+static void dispatch(uint32_t id) {
+  Source* found = findSource(id);
+  if (found == NULL) {
+    return;
+  }
+  Source source = *found;
+
+  if (source.kind == TIMER) {
+    uint64_t expirations = 0;
+    if (read(source.fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+      return;
+    }
+    if (!source.periodic) {
+      remove_source(id);
+    }
+    // A late mbed Ticker catches up with back to back calls, so does this.
+    // Stop if the handler detached itself.
+    for (uint64_t i = 0; i < expirations; i++) {
+      source.handler->call();
+      if (source.periodic && findSource(id) == NULL) {
+        break;
+      }
+    }
+  } else {
+    char data[64];
+    ssize_t n = read(source.fd, data, sizeof(data));
+    if (n < 0 && errno == EAGAIN) {
+      return;
+    }
+    if (n <= 0) {
+      // EOF, stop watching stdin
+      remove_source(id);
+      return;
+    }
+    pthread_mutex_lock(&rxLock);
+    for (ssize_t i = 0; i < n && rxCount < sizeof(rxBuffer); i++) {
+      rxBuffer[(rxHead + rxCount++) % sizeof(rxBuffer)] = data[i];
+    }
+    pthread_cond_broadcast(&rxReady);
+    pthread_mutex_unlock(&rxLock);
+
+    // One RX interrupt per character, as long as the ISR keeps reading
+    uint32_t before = ~0u;
+    for (;;) {
+      pthread_mutex_lock(&rxLock);
+      uint32_t pending = rxCount;
+      pthread_mutex_unlock(&rxLock);
+      if (pending == 0 || pending == before) {
+        break;
+      }
+      before = pending;
+      source.handler->call();
+    }
+  }
+}
+
+static void* interruptThread(void*) {
+  struct epoll_event events[8];
+  for (;;) {
+    int n = epoll_wait(epollFd, events, 8, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error("mbed_host: epoll_wait failed (%d)\n", errno);
+    }
+    pthread_mutex_lock(&irqLock);
+    irqMasked = inIsr = true;
+    for (int i = 0; i < n; i++) {
+      dispatch(events[i].data.u32);
+    }
+    irqMasked = inIsr = false;
+    pthread_cond_broadcast(&irqDone);
+    pthread_mutex_unlock(&irqLock);
+  }
+  return NULL;
+}
+
+static uint32_t addTimer(FunctionPointer* handler, uint64_t period_us, bool periodic);
+
+static void setup() {
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  const char* clock = getenv("MBED_HOST_CLOCK");
+  simulated = clock != NULL && strcmp(clock, "sim") == 0;
+  if (simulated) {
+    speedup = envDouble("MBED_HOST_SPEEDUP", 10.0);
+    if (speedup <= 0) {
+      speedup = 1.0;
+    }
+  }
+  edgeHz = envDouble("MBED_HOST_EDGE_HZ", 0);
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&irqDone, &attr);
+  pthread_cond_init(&rxReady, &attr);
+  pthread_condattr_destroy(&attr);
+
+  const char* trace = getenv("MBED_HOST_I2C_TRACE");
+  if (trace != NULL) {
+    loadTrace(trace);
+  } else {
+    fprintf(stderr, "mbed_host: no MBED_HOST_I2C_TRACE, the I2C bus is empty\n");
+  }
+
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0) {
+    error("mbed_host: epoll_create1 failed (%d)\n", errno);
+  }
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, &interruptThread, NULL) != 0) {
+    error("mbed_host: can't start the interrupt thread\n");
+  }
+  pthread_detach(thread);
+
+  double runS = envDouble("MBED_HOST_RUN_S", 0);
+  if (runS > 0) {
+    static FunctionPointer stop(&finish);
+    addTimer(&stop, (uint64_t) (runS * 1000000.0), false);
+  }
+}
+
+void init() {
+  pthread_once(&once, &setup);
+}
+
+uint64_t now_us() {
+  init();
+  uint64_t ns = wallNs();
+  return simulated ? (uint64_t) (ns * speedup / 1000.0) : ns / 1000;
+}
+
+struct timespec deadline(uint32_t millisec) {
+  init();
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  uint64_t ns = toWallNs((uint64_t) millisec * 1000);
+  ts.tv_sec += ns / 1000000000ULL;
+  ts.tv_nsec += ns % 1000000000ULL;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  return ts;
+}
+
+void delay_us(uint64_t us) {
+  init();
+  uint64_t ns = toWallNs(us);
+  struct timespec ts;
+  ts.tv_sec = ns / 1000000000ULL;
+  ts.tv_nsec = ns % 1000000000ULL;
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+  }
+}
+
+static uint32_t addSource(SourceKind kind, int fd, FunctionPointer* handler, bool periodic) {
+  IrqGuard guard;
+  Source* source = findSource(0);
+  if (source == NULL) {
+    error("mbed_host: more than %d interrupt sources\n", MAX_SOURCES);
+  }
+  uint32_t id = nextSource++;
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = 0;
+  event.data.u32 = id;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+    return 0;
+  }
+  source->id = id;
+  source->kind = kind;
+  source->fd = fd;
+  source->handler = handler;
+  source->periodic = periodic;
+  return id;
+}
+
+static uint32_t addTimer(FunctionPointer* handler, uint64_t period_us, bool periodic) {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    error("mbed_host: timerfd_create failed (%d)\n", errno);
+  }
+  uint64_t ns = toWallNs(period_us);
+  if (ns < 1000) {
+    ns = 1000;
+  }
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = ns / 1000000000ULL;
+  spec.it_value.tv_nsec = ns % 1000000000ULL;
+  if (periodic) {
+    spec.it_interval = spec.it_value;
+  }
+  timerfd_settime(fd, 0, &spec, NULL);
+
+  uint32_t id = addSource(TIMER, fd, handler, periodic);
+  if (id == 0) {
+    close(fd);
+  }
+  return id;
+}
+
+uint32_t add_timer(FunctionPointer* handler, uint64_t period_us, bool periodic) {
+  init();
+  return addTimer(handler, period_us, periodic);
+}
+
+void remove_source(uint32_t id) {
+  IrqGuard guard;
+  Source* source = id != 0 ? findSource(id) : NULL;
+  if (source == NULL) {
+    return;
+  }
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, source->fd, NULL);
+  if (source->kind == TIMER) {
+    close(source->fd);
+  }
+  source->id = 0;
+}
+
+}
+
+using namespace mbed_host;
+
+uint32_t us_ticker_read(void) {
+  return (uint32_t) now_us();
+}
+
+void wait(float s) {
+  delay_us((uint64_t) (s * 1000000.0f));
+}
+
+void wait_ms(int ms) {
+  delay_us((uint64_t) ms * 1000);
+}
+
+void wait_us(int us) {
+  delay_us(us);
+}
+
+void sleep(void) {
+  init();
+  bool masked = irqMasked;
+  if (!masked) {
+    pthread_mutex_lock(&irqLock);
+  }
+  // Like WFI with PRIMASK set: the pending interrupt runs, then we return
+  irqMasked = false;
+  pthread_cond_wait(&irqDone, &irqLock);
+  irqMasked = masked;
+  if (!masked) {
+    pthread_mutex_unlock(&irqLock);
+  }
+}
+
+void deepsleep(void) {
+  sleep();
+}
+
+void error(const char* format, ...) {
+  va_list args;
+  fflush(stdout);
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  exit(1);
+}
+
+void __disable_irq(void) {
+  if (!irqMasked) {
+    pthread_mutex_lock(&irqLock);
+    irqMasked = true;
+  }
+}
+
+void __enable_irq(void) {
+  // ISRs run to completion with interrupts masked
+  if (irqMasked && !inIsr) {
+    irqMasked = false;
+    pthread_mutex_unlock(&irqLock);
+  }
+}
+
+uint32_t __get_IPSR(void) {
+  // Any exception number will do, SysTick's
+  return inIsr ? 15 : 0;
+}
+
+uint32_t __get_PSP(void) {
+  return 0;
+}
+
+static uint32_t cycles() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t ns = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+  return (uint32_t) (ns * SystemCoreClock / 1000000000ULL);
+}
+
+HostCycleCounter::operator uint32_t() const {
+  return cycles() - offset;
+}
+
+HostCycleCounter& HostCycleCounter::operator=(uint32_t value) {
+  offset = cycles() - value;
+  return *this;
+}
+
+void Ticker::setup(timestamp_t t) {
+  _source = add_timer(&_function, t, _periodic);
+}
+
+void Ticker::detach() {
+  if (_source != 0) {
+    remove_source(_source);
+    _source = 0;
+  }
+}
+
+void InterruptIn::edge() {
+  if (_enabled) {
+    _rise.call();
+  }
+}
+
+void InterruptIn::setup() {
+  init();
+  if (_source == 0 && edgeHz > 0) {
+    _source = add_timer(&_edge, (uint64_t) (1000000.0 / edgeHz), true);
+  }
+}
+
+InterruptIn::~InterruptIn() {
+  if (_source != 0) {
+    remove_source(_source);
+  }
+}
+
+void InterruptIn::enable_irq() {
+  _enabled = true;
+}
+
+void InterruptIn::disable_irq() {
+  _enabled = false;
+}
+
+int SPI::write(int value) {
+  delay_us(((uint64_t) _bits * 1000000 + _hz - 1) / _hz);
+  return (1 << _bits) - 1;
+}
+
+I2C::I2C(PinName sda, PinName scl) : _hz(100000), _address(-1), _bytes(0) {
+  init();
+}
+
+// Start, address and data bytes at 9 clocks each plus stop
+static uint64_t transferUs(int hz, int length) {
+  return (uint64_t) (length + 1) * 9 * 1000000 / hz + 1;
+}
+
+int I2C::write(int address, const char* data, int length, bool repeated) {
+  delay_us(transferUs(_hz, length));
+  pthread_mutex_lock(&busLock);
+  BusDevice& device = bus[(address >> 1) & 0x7F];
+  bool present = device.present;
+  if (present && length > 0) {
+    // First byte is the register, ST parts use bit 7 for auto increment
+    device.pointer = data[0] & 0x7F;
+    for (int i = 1; i < length; i++) {
+      device.regs[device.pointer] = data[i];
+      device.pointer = (device.pointer + 1) & 0x7F;
+    }
+  }
+  pthread_mutex_unlock(&busLock);
+  return present ? 0 : 1;
+}
+
+int I2C::read(int address, char* data, int length, bool repeated) {
+  delay_us(transferUs(_hz, length));
+  pthread_mutex_lock(&busLock);
+  BusDevice& device = bus[(address >> 1) & 0x7F];
+  bool present = device.present;
+  if (present) {
+    for (int i = 0; i < length; i++) {
+      data[i] = device.regs[device.pointer];
+      device.pointer = (device.pointer + 1) & 0x7F;
+    }
+  }
+  pthread_mutex_unlock(&busLock);
+  return present ? 0 : 1;
+}
+
+void I2C::start() {
+  _address = -1;
+  _bytes = 0;
+}
+
+void I2C::stop() {
+  _address = -1;
+}
+
+// Same register file semantics as write(address, data, length)
+int I2C::write(int data) {
+  delay_us(9 * 1000000 / _hz + 1);
+  pthread_mutex_lock(&busLock);
+  bool ack;
+  if (_address < 0) {
+    _address = data;
+    ack = bus[(data >> 1) & 0x7F].present;
+  } else {
+    BusDevice& device = bus[(_address >> 1) & 0x7F];
+    ack = device.present;
+    if (ack && _bytes == 0) {
+      device.pointer = data & 0x7F;
+    } else if (ack) {
+      device.regs[device.pointer] = data;
+      device.pointer = (device.pointer + 1) & 0x7F;
+    }
+    _bytes++;
+  }
+  pthread_mutex_unlock(&busLock);
+  return ack ? 1 : 0;
+}
+
+Serial::Serial(PinName tx, PinName rx, const char* name) : _baud(9600) {
+  init();
+}
+
+// 8N1, ten bit times per character
+void Serial::transmitted(int count) {
+  fflush(stdout);
+  delay_us((uint64_t) count * 10 * 1000000 / _baud);
+}
+
+int Serial::printf(const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (length >= (int) sizeof(buffer)) {
+    char* large = (char*) malloc(length + 1);
+    if (large == NULL) {
+      return -1;
+    }
+    va_start(args, format);
+    vsnprintf(large, length + 1, format, args);
+    va_end(args);
+    fwrite(large, 1, length, stdout);
+    ::free(large);
+  } else if (length > 0) {
+    fwrite(buffer, 1, length, stdout);
+  }
+  transmitted(length);
+  return length;
+}
+
+int Serial::puts(const char* str) {
+  int length = fputs(str, stdout) < 0 ? -1 : (int) strlen(str);
+  transmitted(length);
+  return length;
+}
+
+int Serial::putc(int c) {
+  int result = fputc(c, stdout);
+  transmitted(1);
+  return result;
+}
+
+// Blocks until a character arrives, like the target
+int Serial::getc() {
+  pthread_mutex_lock(&rxLock);
+  while (rxCount == 0) {
+    pthread_cond_wait(&rxReady, &rxLock);
+  }
+  int c = (unsigned char) rxBuffer[rxHead];
+  rxHead = (rxHead + 1) % sizeof(rxBuffer);
+  rxCount--;
+  pthread_mutex_unlock(&rxLock);
+  return c;
+}
+
+int Serial::readable() {
+  pthread_mutex_lock(&rxLock);
+  int result = rxCount > 0;
+  pthread_mutex_unlock(&rxLock);
+  return result;
+}
+
+void Serial::attachRx() {
+  IrqGuard guard;
+  if (rxSource == 0) {
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    rxSource = addSource(UART_RX, STDIN_FILENO, &_rx, false);
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef __MBED_HOST_H__
+#define __MBED_HOST_H__
+#include <stdint.h>
+#include <time.h>
+
+class FunctionPointer;
+
+// Internals shared by the host stand-ins for mbed.h and rtos.h.
+//
+// Clock: "real" runs at wall speed; "sim" runs a simulated clock that is
+// MBED_HOST_SPEEDUP times faster than the wall clock. Everything timed goes
+// through it: us_ticker_read(), Ticker periods, RTOS timeouts, and the I2C
+// and UART transfer times. So the firmware sees the same timing it would on
+// the target, only compressed, and pushing the speedup until samples drop
+// finds its throughput ceiling.
+//
+// Interrupts: ISRs (Ticker, UART RX, pin edges) all run on one "interrupt"
+// thread that holds the interrupt lock while dispatching. __disable_irq()
+// takes the same lock, so masked code and ISRs exclude each other the way
+// they do on the single core target.
+namespace mbed_host {
+
+// Read the environment and start the interrupt thread, safe to call often
+void init();
+
+// Simulated time since start
+uint64_t now_us();
+
+// Absolute CLOCK_MONOTONIC deadline `millisec` of simulated time from now
+struct timespec deadline(uint32_t millisec);
+
+// Block for `us` of simulated time
+void delay_us(uint64_t us);
+
+// Interrupt sources, dispatched on the interrupt thread
+uint32_t add_timer(FunctionPointer* handler, uint64_t period_us, bool periodic);
+void remove_source(uint32_t id);
+
+}
+
+#endif //__MBED_HOST_H__
@@ -0,0 +1,317 @@
+#include "rtos.h"
+#include <errno.h>
+#include <sched.h>
+#include "mbed.h"
+
+// Per thread signal flags, what osThreadId points at
+struct os_thread_cb {
+  pthread_mutex_t lock;
+  pthread_cond_t signalled;
+  int32_t signals;
+  osPriority priority;
+};
+
+static __thread os_thread_cb* current = NULL;
+
+static void condInit(pthread_cond_t* cond) {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+// Wait on `cond` until woken or the simulated timeout passes.
+// Returns false on timeout.
+static bool condWait(pthread_cond_t* cond, pthread_mutex_t* lock, const struct timespec* until) {
+  if (until == NULL) {
+    pthread_cond_wait(cond, lock);
+    return true;
+  }
+  return pthread_cond_timedwait(cond, lock, until) != ETIMEDOUT;
+}
+
+static os_thread_cb* newThreadCb() {
+  os_thread_cb* cb = new os_thread_cb;
+  pthread_mutex_init(&cb->lock, NULL);
+  condInit(&cb->signalled);
+  cb->signals = 0;
+  cb->priority = osPriorityNormal;
+  return cb;
+}
+
+osThreadId osThreadGetId(void) {
+  // Threads not started through Thread, main() and the interrupt thread,
+  // get theirs on first use
+  if (current == NULL) {
+    current = newThreadCb();
+  }
+  return current;
+}
+
+osPriority osThreadGetPriority(osThreadId thread_id) {
+  return thread_id == NULL ? osPriorityError : thread_id->priority;
+}
+
+osStatus osThreadSetPriority(osThreadId thread_id, osPriority priority) {
+  if (thread_id == NULL) {
+    return osErrorParameter;
+  }
+  thread_id->priority = priority;
+  return osOK;
+}
+
+int32_t osSignalSet(osThreadId thread_id, int32_t signals) {
+  if (thread_id == NULL) {
+    return (int32_t) 0x80000000;
+  }
+  pthread_mutex_lock(&thread_id->lock);
+  int32_t previous = thread_id->signals;
+  thread_id->signals |= signals;
+  pthread_cond_broadcast(&thread_id->signalled);
+  pthread_mutex_unlock(&thread_id->lock);
+  return previous;
+}
+
+Thread::Thread(void (*task)(void const* argument), void* argument, osPriority priority,
+               uint32_t stack_size, unsigned char* stack_pointer)
+    : _tid(newThreadCb()), _task(task), _argument(argument) {
+  _tid->priority = priority;
+  mbed_host::init();
+  if (pthread_create(&_thread, NULL, &Thread::start, this) != 0) {
+    error("mbed_host: can't start thread\n");
+  }
+}
+
+// RTX would delete the thread; there's no safe way to stop a pthread from
+// outside, so it's left running. main() never returns on the target anyway.
+Thread::~Thread() {
+  pthread_detach(_thread);
+}
+
+void* Thread::start(void* thread) {
+  Thread* self = static_cast<Thread*>(thread);
+  current = self->_tid;
+  self->_task(self->_argument);
+  return NULL;
+}
+
+osStatus Thread::set_priority(osPriority priority) {
+  _tid->priority = priority;
+  return osOK;
+}
+
+int32_t Thread::signal_set(int32_t signals) {
+  return osSignalSet(_tid, signals);
+}
+
+// Wait for all of `signals`, or any signal when 0; the flags waited for
+// are cleared
+osEvent Thread::signal_wait(int32_t signals, uint32_t millisec) {
+  os_thread_cb* cb = osThreadGetId();
+  struct timespec until;
+  if (millisec != osWaitForever) {
+    until = mbed_host::deadline(millisec);
+  }
+  osEvent result;
+  result.status = osOK;
+  result.value.signals = 0;
+
+  pthread_mutex_lock(&cb->lock);
+  for (;;) {
+    int32_t flags = cb->signals;
+    if (signals == 0 ? flags != 0 : (flags & signals) == signals) {
+      result.status = osEventSignal;
+      result.value.signals = flags;
+      cb->signals &= signals == 0 ? 0 : ~signals;
+      break;
+    }
+    if (millisec == 0) {
+      break;
+    }
+    if (!condWait(&cb->signalled, &cb->lock, millisec == osWaitForever ? NULL : &until)) {
+      result.status = osEventTimeout;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&cb->lock);
+  return result;
+}
+
+osStatus Thread::wait(uint32_t millisec) {
+  mbed_host::delay_us((uint64_t) millisec * 1000);
+  return osEventTimeout;
+}
+
+osStatus Thread::yield() {
+  sched_yield();
+  return osOK;
+}
+
+osThreadId Thread::gettid() {
+  return osThreadGetId();
+}
+
+Mutex::Mutex() {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&_mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+Mutex::~Mutex() {
+  pthread_mutex_destroy(&_mutex);
+}
+
+osStatus Mutex::lock(uint32_t millisec) {
+  if (millisec == osWaitForever) {
+    return pthread_mutex_lock(&_mutex) == 0 ? osOK : osErrorOS;
+  }
+  if (millisec == 0) {
+    return pthread_mutex_trylock(&_mutex) == 0 ? osOK : osErrorResource;
+  }
+  struct timespec until = mbed_host::deadline(millisec);
+  return pthread_mutex_clocklock(&_mutex, CLOCK_MONOTONIC, &until) == 0 ? osOK : osErrorTimeoutResource;
+}
+
+bool Mutex::trylock() {
+  return lock(0) == osOK;
+}
+
+osStatus Mutex::unlock() {
+  return pthread_mutex_unlock(&_mutex) == 0 ? osOK : osErrorResource;
+}
+
+Semaphore::Semaphore(int32_t count) : _count(count) {
+  pthread_mutex_init(&_lock, NULL);
+  condInit(&_available);
+}
+
+Semaphore::~Semaphore() {
+  pthread_cond_destroy(&_available);
+  pthread_mutex_destroy(&_lock);
+}
+
+int32_t Semaphore::wait(uint32_t millisec) {
+  struct timespec until;
+  if (millisec != osWaitForever) {
+    until = mbed_host::deadline(millisec);
+  }
+  int32_t result = 0;
+  pthread_mutex_lock(&_lock);
+  for (;;) {
+    if (_count > 0) {
+      result = _count--;
+      break;
+    }
+    if (millisec == 0 ||
+        !condWait(&_available, &_lock, millisec == osWaitForever ? NULL : &until)) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+  return result;
+}
+
+osStatus Semaphore::release() {
+  pthread_mutex_lock(&_lock);
+  _count++;
+  pthread_cond_signal(&_available);
+  pthread_mutex_unlock(&_lock);
+  return osOK;
+}
+
+namespace mbed_host {
+
+MailQueue::MailQueue(void* pool, bool* used, void** fifo, uint32_t itemSize, uint32_t count)
+    : _pool((uint8_t*) pool), _used(used), _fifo(fifo), _itemSize(itemSize), _count(count),
+      _head(0), _queued(0) {
+  memset(_used, 0, count * sizeof(bool));
+  pthread_mutex_init(&_lock, NULL);
+  condInit(&_freed);
+  condInit(&_put);
+}
+
+MailQueue::~MailQueue() {
+  pthread_cond_destroy(&_put);
+  pthread_cond_destroy(&_freed);
+  pthread_mutex_destroy(&_lock);
+}
+
+void* MailQueue::alloc(uint32_t millisec) {
+  struct timespec until;
+  if (millisec != osWaitForever) {
+    until = deadline(millisec);
+  }
+  void* result = NULL;
+  pthread_mutex_lock(&_lock);
+  for (;;) {
+    for (uint32_t i = 0; i < _count; i++) {
+      if (!_used[i]) {
+        _used[i] = true;
+        result = _pool + i * _itemSize;
+        break;
+      }
+    }
+    if (result != NULL || millisec == 0 ||
+        !condWait(&_freed, &_lock, millisec == osWaitForever ? NULL : &until)) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+  return result;
+}
+
+// Every slot has room in the FIFO, so put never blocks
+osStatus MailQueue::put(void* mail) {
+  if (mail == NULL) {
+    return osErrorParameter;
+  }
+  pthread_mutex_lock(&_lock);
+  _fifo[(_head + _queued++) % _count] = mail;
+  pthread_cond_signal(&_put);
+  pthread_mutex_unlock(&_lock);
+  return osOK;
+}
+
+osEvent MailQueue::get(uint32_t millisec) {
+  struct timespec until;
+  if (millisec != osWaitForever) {
+    until = deadline(millisec);
+  }
+  osEvent result;
+  result.status = millisec == 0 ? osOK : osEventTimeout;
+  result.value.p = NULL;
+
+  pthread_mutex_lock(&_lock);
+  for (;;) {
+    if (_queued > 0) {
+      result.status = osEventMail;
+      result.value.p = _fifo[_head];
+      _head = (_head + 1) % _count;
+      _queued--;
+      break;
+    }
+    if (millisec == 0 ||
+        !condWait(&_put, &_lock, millisec == osWaitForever ? NULL : &until)) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+  return result;
+}
+
+osStatus MailQueue::free(void* mail) {
+  uint8_t* slot = (uint8_t*) mail;
+  if (slot < _pool || slot >= _pool + _count * _itemSize || (slot - _pool) % _itemSize != 0) {
+    return osErrorValue;
+  }
+  pthread_mutex_lock(&_lock);
+  _used[(slot - _pool) / _itemSize] = false;
+  pthread_cond_signal(&_freed);
+  pthread_mutex_unlock(&_lock);
+  return osOK;
+}
+
+}
@@ -0,0 +1,132 @@
+#ifndef __RTOS_H__
+#define __RTOS_H__
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <type_traits>
+#include "cmsis_os.h"
+
+// Host stand-in for the mbed RTOS classes this project uses, on pthreads.
+// Timeouts are in simulated time (see mbed_host.h). Priorities are recorded
+// but not enforced, every thread gets a normal Linux time slice; stack sizes
+// are ignored since host frames are larger than the target's anyway.
+
+class Thread {
+  osThreadId _tid;
+  pthread_t _thread;
+  void (*_task)(void const*);
+  void* _argument;
+
+  static void* start(void* thread);
+
+public:
+  Thread(void (*task)(void const* argument), void* argument = NULL,
+         osPriority priority = osPriorityNormal,
+         uint32_t stack_size = DEFAULT_STACK_SIZE,
+         unsigned char* stack_pointer = NULL);
+  virtual ~Thread();
+
+  int32_t signal_set(int32_t signals);
+  static osEvent signal_wait(int32_t signals, uint32_t millisec = osWaitForever);
+
+  osStatus set_priority(osPriority priority);
+  osPriority get_priority() {
+    return osThreadGetPriority(_tid);
+  }
+
+  static osStatus wait(uint32_t millisec);
+  static osStatus yield();
+  static osThreadId gettid();
+};
+
+// Recursive, like RTX mutexes
+class Mutex {
+  pthread_mutex_t _mutex;
+
+public:
+  Mutex();
+  ~Mutex();
+
+  osStatus lock(uint32_t millisec = osWaitForever);
+  bool trylock();
+  osStatus unlock();
+};
+
+class Semaphore {
+  pthread_mutex_t _lock;
+  pthread_cond_t _available;
+  int32_t _count;
+
+public:
+  Semaphore(int32_t count = 0);
+  ~Semaphore();
+
+  // Tokens available before taking one, 0 on timeout
+  int32_t wait(uint32_t millisec = osWaitForever);
+  osStatus release();
+};
+
+namespace mbed_host {
+
+// Untyped fixed size pool plus FIFO behind Mail<T, N>
+class MailQueue {
+  uint8_t* _pool;
+  bool* _used;
+  void** _fifo;
+  uint32_t _itemSize;
+  uint32_t _count;
+  uint32_t _head;
+  uint32_t _queued;
+  pthread_mutex_t _lock;
+  pthread_cond_t _freed;
+  pthread_cond_t _put;
+
+public:
+  MailQueue(void* pool, bool* used, void** fifo, uint32_t itemSize, uint32_t count);
+  ~MailQueue();
+
+  void* alloc(uint32_t millisec);
+  osStatus put(void* mail);
+  osEvent get(uint32_t millisec);
+  osStatus free(void* mail);
+};
+
+}
+
+// Like RTX, slots are raw storage: T is never constructed or destroyed
+template<typename T, uint32_t queue_sz>
+class Mail {
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type _pool[queue_sz];
+  bool _used[queue_sz];
+  void* _fifo[queue_sz];
+  mbed_host::MailQueue _queue;
+
+public:
+  Mail() : _queue(_pool, _used, _fifo, sizeof(_pool[0]), queue_sz) {};
+
+  T* alloc(uint32_t millisec = 0) {
+    return (T*) _queue.alloc(millisec);
+  }
+
+  T* calloc(uint32_t millisec = 0) {
+    T* mail = alloc(millisec);
+    if (mail != NULL) {
+      memset((void*) mail, 0, sizeof(T));
+    }
+    return mail;
+  }
+
+  osStatus put(T* mptr) {
+    return _queue.put(mptr);
+  }
+
+  osEvent get(uint32_t millisec = osWaitForever) {
+    return _queue.get(millisec);
+  }
+
+  osStatus free(T* mptr) {
+    return _queue.free(mptr);
+  }
+};
+
+#endif //__RTOS_H__
@@ -0,0 +1,276 @@
+/**
+ ******************************************************************************
+ * @file    transport.h
+ * @brief   Register transports the sensor drivers are templated on
+ ******************************************************************************
+ *
+ * A driver reads and writes its registers through a Transport, a policy
+ * class it takes as a template parameter and holds by value:
+ *
+ *   int read(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr,
+ *            uint16_t NumByteToRead);
+ *   int write(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr,
+ *             uint16_t NumByteToWrite);
+ *   int write(const I2CSegment* segments, uint8_t count, uint8_t DeviceAddr,
+ *             uint8_t RegisterAddr);
+ *
+ * all returning 0 on success, with DeviceAddr the 8 bit I2C address and
+ * RegisterAddr as the driver would send it over I2C. Every call is resolved
+ * at compile time, so the transfer code inlines into each driver method. The
+ * DevI2C trace replay works under I2CTransport as before.
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent from recursive inclusion --------------------------------*/
+#ifndef __TRANSPORT_H
+#define __TRANSPORT_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <string.h>
+#include "mbed.h"
+#include "DevI2C.h"
+#include "DevSPI.h"
+#include "I2CTrace.h"
+
+/* Definitions ---------------------------------------------------------------*/
+#define SPI_TRANSPORT_READ	((uint8_t)0x80)	/*!< read bit of the ST command byte */
+
+/* Classes -------------------------------------------------------------------*/
+/** Registers over DevI2C */
+class I2CTransport
+{
+ public:
+	I2CTransport(DevI2C &i2c) : dev_i2c(&i2c) {}
+	explicit I2CTransport(DevI2C *i2c) : dev_i2c(i2c) {}
+
+	int read(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToRead)
+	{
+		return dev_i2c->i2c_read(pBuffer, DeviceAddr, RegisterAddr, NumByteToRead);
+	}
+
+	int write(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToWrite)
+	{
+		return dev_i2c->i2c_write(pBuffer, DeviceAddr, RegisterAddr, NumByteToWrite);
+	}
+
+	int write(const I2CSegment* segments, uint8_t count, uint8_t DeviceAddr, uint8_t RegisterAddr)
+	{
+		return dev_i2c->i2c_write(segments, count, DeviceAddr, RegisterAddr);
+	}
+
+ private:
+	DevI2C *dev_i2c;
+};
+
+/** Registers over DevSPI (4-wire, mode 3), one chip select per device. ST
+ *  sensors take a command byte: the register address with the read bit
+ *  and, on some, their own auto increment bit in place of the I2C one.
+ */
+class SPITransport
+{
+ public:
+	/** Constructor
+	 * @param[in] spi device SPI to be used for communication, its arbiter
+	 *            if any is asked with the device's I2C address
+	 * @param[in] cs_pin pin name of the chip select
+	 * @param[in] spi_inc auto increment bit of the SPI command byte, 0 if
+	 *            the device increments on its own (IF_INC)
+	 * @param[in] i2c_inc auto increment bit the driver sets in I2C register
+	 *            addresses, taken out of the command byte
+	 */
+	SPITransport(DevSPI *spi, PinName cs_pin, uint8_t spi_inc = 0, uint8_t i2c_inc = 0) :
+		dev_spi(spi), cs(cs_pin, 1), spi_inc(spi_inc), i2c_inc(i2c_inc) {}
+
+	int read(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToRead)
+	{
+		return dev_spi->spi_read_reg(pBuffer, DeviceAddr,
+					     command(RegisterAddr, NumByteToRead) | SPI_TRANSPORT_READ,
+					     cs, NumByteToRead);
+	}
+
+	int write(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToWrite)
+	{
+		return dev_spi->spi_write_reg(pBuffer, DeviceAddr, command(RegisterAddr, NumByteToWrite),
+					      cs, NumByteToWrite);
+	}
+
+	int write(const I2CSegment* segments, uint8_t count, uint8_t DeviceAddr, uint8_t RegisterAddr)
+	{
+		uint32_t total = 0;
+		for(uint8_t i = 0; i < count; i++) total += segments[i].length;
+		return dev_spi->spi_write_reg(segments, count, DeviceAddr, command(RegisterAddr, total), cs);
+	}
+
+ private:
+	uint8_t command(uint8_t RegisterAddr, uint32_t NumBytes)
+	{
+		uint8_t cmd = RegisterAddr & ~(i2c_inc | SPI_TRANSPORT_READ);
+		if(NumBytes > 1) cmd |= spi_inc;
+		return cmd;
+	}
+
+	DevSPI *dev_spi;
+	DigitalOut cs;
+	uint8_t spi_inc;
+	uint8_t i2c_inc;
+};
+
+/** I2C or SPI, chosen when the board is put together: for the sensors that
+ *  can sit on either, at the cost of one predictable branch a transfer.
+ */
+class SensorTransport
+{
+ public:
+	SensorTransport(DevI2C &i2c) : i2c(i2c), spi(NULL, NC), on_spi(false) {}
+	SensorTransport(const SPITransport &spi) : i2c(NULL), spi(spi), on_spi(true) {}
+
+	int read(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToRead)
+	{
+		return on_spi ? spi.read(pBuffer, DeviceAddr, RegisterAddr, NumByteToRead)
+			      : i2c.read(pBuffer, DeviceAddr, RegisterAddr, NumByteToRead);
+	}
+
+	int write(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToWrite)
+	{
+		return on_spi ? spi.write(pBuffer, DeviceAddr, RegisterAddr, NumByteToWrite)
+			      : i2c.write(pBuffer, DeviceAddr, RegisterAddr, NumByteToWrite);
+	}
+
+	int write(const I2CSegment* segments, uint8_t count, uint8_t DeviceAddr, uint8_t RegisterAddr)
+	{
+		return on_spi ? spi.write(segments, count, DeviceAddr, RegisterAddr)
+			      : i2c.write(segments, count, DeviceAddr, RegisterAddr);
+	}
+
+ private:
+	I2CTransport i2c;
+	SPITransport spi;
+	bool on_spi;
+};
+
+/** No bus at all: one 256 byte register file that reads return and writes
+ *  fill, addresses incrementing and wrapping. For timing a driver's own code
+ *  in host benchmarks, and for tests; preload registers (WHO_AM_I, say)
+ *  before calling the driver.
+ */
+class RegisterFileTransport
+{
+ public:
+	RegisterFileTransport() : transfers(0)
+	{
+		memset(registers, 0, sizeof(registers));
+	}
+
+	int read(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToRead)
+	{
+		for(uint16_t i = 0; i < NumByteToRead; i++) pBuffer[i] = registers[(uint8_t)(RegisterAddr + i)];
+		transfers++;
+		return 0;
+	}
+
+	int write(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToWrite)
+	{
+		for(uint16_t i = 0; i < NumByteToWrite; i++) registers[(uint8_t)(RegisterAddr + i)] = pBuffer[i];
+		transfers++;
+		return 0;
+	}
+
+	int write(const I2CSegment* segments, uint8_t count, uint8_t DeviceAddr, uint8_t RegisterAddr)
+	{
+		for(uint8_t s = 0; s < count; s++) {
+			for(uint16_t i = 0; i < segments[s].length; i++) registers[RegisterAddr++] = segments[s].data[i];
+		}
+		transfers++;
+		return 0;
+	}
+
+	uint8_t registers[256];
+	uint32_t transfers;
+};
+
+/** Coalesces a run of register read-modify-writes into one burst read and
+ *  one burst write. While a batch is open, a driver's single register reads
+ *  inside the block are served from a copy read in one transfer and its
+ *  writes inside the block only change the copy; end() writes the changed
+ *  span back in one transfer, unchanged registers between changed ones
+ *  included. Accesses outside the block go to the device as usual, as do
+ *  ones straddling its edge (a straddling write updates the copy too).
+ *  The device must auto increment, and nothing else may access it while
+ *  the batch is open.
+ */
+template <uint8_t Size>
+class RegisterBatch
+{
+ public:
+	RegisterBatch() : first(0), open(false), dirty_lo(Size), dirty_hi(0) {}
+
+	/** Open a batch over Size registers from RegisterAddr
+	 *  @retval the transport's read result, 0 if the batch is open
+	 */
+	template <class Transport>
+	int begin(Transport &transport, uint8_t DeviceAddr, uint8_t RegisterAddr)
+	{
+		int ret = transport.read(shadow, DeviceAddr, RegisterAddr, Size);
+		if(ret != 0) return ret;
+		first = RegisterAddr;
+		dirty_lo = Size;
+		dirty_hi = 0;
+		open = true;
+		return 0;
+	}
+
+	/** Close the batch, writing back what changed
+	 *  @retval the transport's write result, 0 if nothing changed
+	 */
+	template <class Transport>
+	int end(Transport &transport, uint8_t DeviceAddr)
+	{
+		open = false;
+		if(dirty_lo >= dirty_hi) return 0;
+		return transport.write(&shadow[dirty_lo], DeviceAddr, first + dirty_lo, dirty_hi - dirty_lo);
+	}
+
+	/** Serve a read from the copy
+	 *  @retval true if it was, false if it has to go to the device
+	 */
+	bool read(uint8_t* pBuffer, uint8_t RegisterAddr, uint16_t NumByteToRead)
+	{
+		if(!inside(RegisterAddr, NumByteToRead)) return false;
+		memcpy(pBuffer, &shadow[RegisterAddr - first], NumByteToRead);
+		return true;
+	}
+
+	/** Hold a write back until end()
+	 *  @retval true if it was, false if it has to go to the device
+	 */
+	bool write(const uint8_t* pBuffer, uint8_t RegisterAddr, uint16_t NumByteToWrite)
+	{
+		if(!open) return false;
+		bool held = inside(RegisterAddr, NumByteToWrite);
+		for(uint16_t i = 0; i < NumByteToWrite; i++) {
+			uint16_t offset = (uint16_t)(RegisterAddr + i) - first;
+			if(offset >= Size) continue;
+			shadow[offset] = pBuffer[i];
+			if(!held) continue;
+			if(offset < dirty_lo) dirty_lo = offset;
+			if(offset + 1 > dirty_hi) dirty_hi = offset + 1;
+		}
+		return held;
+	}
+
+ private:
+	bool inside(uint8_t RegisterAddr, uint16_t NumBytes) const
+	{
+		return open && RegisterAddr >= first && RegisterAddr + NumBytes <= first + Size;
+	}
+
+	uint8_t shadow[Size];
+	uint8_t first;
+	bool open;
+	uint8_t dirty_lo;
+	uint8_t dirty_hi;
+};
+
+#endif /* __TRANSPORT_H */
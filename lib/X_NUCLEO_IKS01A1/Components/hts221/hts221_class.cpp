@@ -49,7 +49,8 @@
  * @brief  HTS221 Calibration procedure
  * @retval HUM_TEMP_OK in case of success, an error code otherwise
  */
-HUM_TEMP_StatusTypeDef HTS221::HTS221_Calibration(void)
+template <class Transport>
+HUM_TEMP_StatusTypeDef HTS221Driver<Transport>::HTS221_Calibration(void)
 {
   /* Temperature Calibration */
   /* Temperature in degree for calibration ( "/8" to obtain float) */
@@ -143,7 +144,8 @@ HUM_TEMP_StatusTypeDef HTS221::HTS221_Calibration(void)
  * @param  HTS221_Init the configuration setting for the HTS221
  * @retval HUM_TEMP_OK in case of success, an error code otherwise
  */
-HUM_TEMP_StatusTypeDef HTS221::HTS221_Init(HUM_TEMP_InitTypeDef *HTS221_Init)
+template <class Transport>
+HUM_TEMP_StatusTypeDef HTS221Driver<Transport>::HTS221_Init(HUM_TEMP_InitTypeDef *HTS221_Init)
 {
   uint8_t tmp = 0x00;
   
@@ -187,7 +189,8 @@ HUM_TEMP_StatusTypeDef HTS221::HTS221_Init(HUM_TEMP_InitTypeDef *HTS221_Init)
  * @param  ht_id the pointer where the ID of the device is stored
  * @retval HUM_TEMP_OK in case of success, an error code otherwise
  */
-HUM_TEMP_StatusTypeDef HTS221::HTS221_ReadID(uint8_t *ht_id)
+template <class Transport>
+HUM_TEMP_StatusTypeDef HTS221Driver<Transport>::HTS221_ReadID(uint8_t *ht_id)
 {
   if(!ht_id)
   {
@@ -201,7 +204,8 @@ HUM_TEMP_StatusTypeDef HTS221::HTS221_ReadID(uint8_t *ht_id)
  * @brief  Reboot memory content of HTS221
  * @retval HUM_TEMP_OK in case of success, an error code otherwise
  */
-HUM_TEMP_StatusTypeDef HTS221::HTS221_RebootCmd(void)
+template <class Transport>
+HUM_TEMP_StatusTypeDef HTS221Driver<Transport>::HTS221_RebootCmd(void)
 {
   uint8_t tmpreg;
   
@@ -229,7 +233,8 @@ HUM_TEMP_StatusTypeDef HTS221::HTS221_RebootCmd(void)
  * @param  pfData the pointer to data output
  * @retval HUM_TEMP_OK in case of success, an error code otherwise
  */
-HUM_TEMP_StatusTypeDef HTS221::HTS221_GetHumidity(float* pfData)
+template <class Transport>
+HUM_TEMP_StatusTypeDef HTS221Driver<Transport>::HTS221_GetHumidity(float* pfData)
 {
   int16_t H_T_out, humidity_t;
   uint8_t tempReg[2] = {0, 0};
@@ -299,7 +304,8 @@ HUM_TEMP_StatusTypeDef HTS221::HTS221_GetHumidity(float* pfData)
  * @param  pfData the pointer to data output
  * @retval HUM_TEMP_OK in case of success, an error code otherwise
  */
-HUM_TEMP_StatusTypeDef HTS221::HTS221_GetTemperature(float* pfData)
+template <class Transport>
+HUM_TEMP_StatusTypeDef HTS221Driver<Transport>::HTS221_GetTemperature(float* pfData)
 {
   int16_t T_out, temperature_t;
   uint8_t tempReg[2] = {0, 0};
@@ -364,7 +370,8 @@ HUM_TEMP_StatusTypeDef HTS221::HTS221_GetTemperature(float* pfData)
  * @brief  Exit the shutdown mode for HTS221
  * @retval HUM_TEMP_OK in case of success, an error code otherwise
  */
-HUM_TEMP_StatusTypeDef HTS221::HTS221_Power_On(void)
+template <class Transport>
+HUM_TEMP_StatusTypeDef HTS221Driver<Transport>::HTS221_Power_On(void)
 {
   uint8_t tmpReg;
   
@@ -390,7 +397,8 @@ HUM_TEMP_StatusTypeDef HTS221::HTS221_Power_On(void)
  * @brief  Enter the shutdown mode for HTS221
  * @retval HUM_TEMP_OK in case of success, an error code otherwise
  */
-HUM_TEMP_StatusTypeDef HTS221::HTS221_Power_OFF(void)
+template <class Transport>
+HUM_TEMP_StatusTypeDef HTS221Driver<Transport>::HTS221_Power_OFF(void)
 {
   uint8_t tmpReg;
   
@@ -412,4 +420,7 @@ HUM_TEMP_StatusTypeDef HTS221::HTS221_Power_OFF(void)
   return HUM_TEMP_OK;
 }
 
+/* Explicit instantiations ---------------------------------------------------*/
+template class HTS221Driver<I2CTransport>;
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
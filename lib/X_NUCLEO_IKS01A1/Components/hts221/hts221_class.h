@@ -41,26 +41,29 @@
 /* Includes ------------------------------------------------------------------*/
 #include "mbed.h"
 #include "DevI2C.h"
+#include "../Common/transport.h"
 #include "hts221.h"
 #include "../Interfaces/HumiditySensor.h"
 #include "../Interfaces/TempSensor.h"
 
 /* Classes -------------------------------------------------------------------*/
-/** Class representing a HTS221 sensor component
+/** Class representing a HTS221 sensor component, reading and writing its
+ *  registers through a Transport (see transport.h)
  */
-class HTS221 : public HumiditySensor, public TempSensor {
+template <class Transport>
+class HTS221Driver : public HumiditySensor, public TempSensor {
  public:
 	/** Constructor
-	 * @param[in] i2c device I2C to be used for communication
+	 * @param[in] transport the bus, a DevI2C for the default Transport
 	 */
-        HTS221(DevI2C &i2c) : HumiditySensor(), TempSensor(), dev_i2c(i2c) {
+        HTS221Driver(const Transport &transport) : HumiditySensor(), TempSensor(), transport(transport) {
 		T0_degC = T1_degC = H0_rh = H1_rh = 0.0;
 		T0_out = T1_out = H0_T0_out = H1_T0_out = 0;
 	}
 	
 	/** Destructor
 	 */
-        virtual ~HTS221() {}
+        virtual ~HTS221Driver() {}
 	
 	/*** Interface Methods ***/
 	virtual int Init(void *init_struct) {
@@ -135,10 +138,7 @@ class HTS221 : public HumiditySensor, public TempSensor {
 	HUM_TEMP_StatusTypeDef HTS221_IO_Read(uint8_t* pBuffer, 
 					      uint8_t RegisterAddr, uint16_t NumByteToRead)
 	{
-		int ret = dev_i2c.i2c_read(pBuffer,
-					   HTS221_ADDRESS,
-					   RegisterAddr,
-					   NumByteToRead);
+		int ret = transport.read(pBuffer, HTS221_ADDRESS, RegisterAddr, NumByteToRead);
 		if(ret != 0) {
 			return HUM_TEMP_ERROR;
 		}
@@ -156,10 +156,7 @@ class HTS221 : public HumiditySensor, public TempSensor {
 	HUM_TEMP_StatusTypeDef HTS221_IO_Write(uint8_t* pBuffer, 
 					       uint8_t RegisterAddr, uint16_t NumByteToWrite)
 	{
-		int ret = dev_i2c.i2c_write(pBuffer,
-					    HTS221_ADDRESS,
-					    RegisterAddr,
-					    NumByteToWrite);
+		int ret = transport.write(pBuffer, HTS221_ADDRESS, RegisterAddr, NumByteToWrite);
 		if(ret != 0) {
 			return HUM_TEMP_ERROR;
 		}
@@ -168,7 +165,7 @@ class HTS221 : public HumiditySensor, public TempSensor {
 	
 	/*** Instance Variables ***/
 	/* IO Device */
-	DevI2C &dev_i2c;
+	Transport transport;
 
 	/* Temperature in degree for calibration  */
 	float T0_degC, T1_degC;
@@ -183,4 +180,7 @@ class HTS221 : public HumiditySensor, public TempSensor {
 	int16_t H0_T0_out, H1_T0_out;
 };
 
+/** The HTS221 as the expansion board has it */
+typedef HTS221Driver<I2CTransport> HTS221;
+
 #endif // __HTS221_CLASS_H
@@ -249,6 +249,12 @@ extern "C" {
  */
 #define LIS3MDL_I2C_MULTIPLEBYTE_CMD                      ((uint8_t)0x80)
 
+/**
+ * @brief Multiple Byte bit of the SPI command byte, doing over SPI what
+ *        LIS3MDL_I2C_MULTIPLEBYTE_CMD does over I2C.
+ */
+#define LIS3MDL_SPI_MULTIPLEBYTE_CMD                      ((uint8_t)0x40)
+
 /**
  * @brief Device Address
  */
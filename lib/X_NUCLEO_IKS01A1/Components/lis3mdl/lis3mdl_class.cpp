@@ -50,7 +50,8 @@
  * @param  LIS3MDL_Init the configuration setting for the LIS3MDL
  * @retval MAGNETO_OK in case of success, an error code otherwise
  */
-MAGNETO_StatusTypeDef LIS3MDL::LIS3MDL_Init(MAGNETO_InitTypeDef *LIS3MDL_Init)
+template <class Transport>
+MAGNETO_StatusTypeDef LIS3MDLDriver<Transport>::LIS3MDL_Init(MAGNETO_InitTypeDef *LIS3MDL_Init)
 {
   uint8_t tmp1 = 0x00;
   
@@ -122,7 +123,8 @@ MAGNETO_StatusTypeDef LIS3MDL::LIS3MDL_Init(MAGNETO_InitTypeDef *LIS3MDL_Init)
  * @param  m_id the pointer where the ID of the device is stored
  * @retval MAGNETO_OK in case of success, an error code otherwise
  */
-MAGNETO_StatusTypeDef LIS3MDL::LIS3MDL_Read_M_ID(uint8_t *m_id)
+template <class Transport>
+MAGNETO_StatusTypeDef LIS3MDLDriver<Transport>::LIS3MDL_Read_M_ID(uint8_t *m_id)
 {
   if(!m_id)
   {
@@ -138,7 +140,8 @@ MAGNETO_StatusTypeDef LIS3MDL::LIS3MDL_Read_M_ID(uint8_t *m_id)
  * @param  pData the pointer where the magnetometer raw data are stored
  * @retval MAGNETO_OK in case of success, an error code otherwise
  */
-MAGNETO_StatusTypeDef LIS3MDL::LIS3MDL_M_GetAxesRaw(int16_t *pData)
+template <class Transport>
+MAGNETO_StatusTypeDef LIS3MDLDriver<Transport>::LIS3MDL_M_GetAxesRaw(int16_t *pData)
 {
   uint8_t tempReg[2] = {0, 0};
   
@@ -175,7 +178,8 @@ MAGNETO_StatusTypeDef LIS3MDL::LIS3MDL_M_GetAxesRaw(int16_t *pData)
  * @param pData the pointer where the magnetometer data are stored
  * @retval MAGNETO_OK in case of success, an error code otherwise
  */
-MAGNETO_StatusTypeDef LIS3MDL::LIS3MDL_M_GetAxes(int32_t *pData)
+template <class Transport>
+MAGNETO_StatusTypeDef LIS3MDLDriver<Transport>::LIS3MDL_M_GetAxes(int32_t *pData)
 {
   uint8_t tempReg = 0x00;
   int16_t pDataRaw[3];
@@ -216,4 +220,7 @@ MAGNETO_StatusTypeDef LIS3MDL::LIS3MDL_M_GetAxes(int32_t *pData)
   return MAGNETO_OK;
 }
 
+/* Explicit instantiations ---------------------------------------------------*/
+template class LIS3MDLDriver<SensorTransport>;
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
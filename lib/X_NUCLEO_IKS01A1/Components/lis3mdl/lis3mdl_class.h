@@ -41,23 +41,28 @@
 /* Includes ------------------------------------------------------------------*/
 #include "mbed.h"
 #include "DevI2C.h"
+#include "../Common/transport.h"
 #include "lis3mdl.h"
 #include "../Interfaces/MagneticSensor.h"
 
 /* Classes -------------------------------------------------------------------*/
-/** Class representing a LIS3MDL sensor component
+/** Class representing a LIS3MDL sensor component, reading and writing its
+ *  registers through a Transport (see transport.h)
  */
-class LIS3MDL : public MagneticSensor {
+template <class Transport>
+class LIS3MDLDriver : public MagneticSensor {
  public:
 	/** Constructor
-	 * @param[in] i2c device I2C to be used for communication
+	 * @param[in] transport the bus, a DevI2C for the default Transport, or
+	 *            on SPI (mode 3, up to 10MHz) SPITransport(&spi, cs_pin,
+	 *            LIS3MDL_SPI_MULTIPLEBYTE_CMD, LIS3MDL_I2C_MULTIPLEBYTE_CMD)
 	 */
-        LIS3MDL(DevI2C &i2c) : MagneticSensor(), dev_i2c(i2c) {
+        LIS3MDLDriver(const Transport &transport) : MagneticSensor(), transport(transport) {
 	}
 	
 	/** Destructor
 	 */
-        virtual ~LIS3MDL() {}
+        virtual ~LIS3MDLDriver() {}
 	
 	/*** Interface Methods ***/
 	virtual int Init(void *init_struct) {
@@ -111,10 +116,7 @@ class LIS3MDL : public MagneticSensor {
 	MAGNETO_StatusTypeDef LIS3MDL_IO_Read(uint8_t* pBuffer, 
 					      uint8_t RegisterAddr, uint16_t NumByteToRead)
 	{
-		int ret = dev_i2c.i2c_read(pBuffer,
-					   LIS3MDL_M_MEMS_ADDRESS,
-					   RegisterAddr,
-					   NumByteToRead);
+		int ret = transport.read(pBuffer, LIS3MDL_M_MEMS_ADDRESS, RegisterAddr, NumByteToRead);
 		if(ret != 0) {
 			return MAGNETO_ERROR;
 		}
@@ -132,10 +134,7 @@ class LIS3MDL : public MagneticSensor {
 	MAGNETO_StatusTypeDef LIS3MDL_IO_Write(uint8_t* pBuffer, 
 					       uint8_t RegisterAddr, uint16_t NumByteToWrite)
 	{
-		int ret = dev_i2c.i2c_write(pBuffer,
-					    LIS3MDL_M_MEMS_ADDRESS,
-					    RegisterAddr,
-					    NumByteToWrite);
+		int ret = transport.write(pBuffer, LIS3MDL_M_MEMS_ADDRESS, RegisterAddr, NumByteToWrite);
 		if(ret != 0) {
 			return MAGNETO_ERROR;
 		}
@@ -144,7 +143,10 @@ class LIS3MDL : public MagneticSensor {
 	
 	/*** Instance Variables ***/
 	/* IO Device */
-	DevI2C &dev_i2c;
+	Transport transport;
 };
 
+/** The LIS3MDL as the expansion board has it */
+typedef LIS3MDLDriver<SensorTransport> LIS3MDL;
+
 #endif // __LIS3MDL_CLASS_H
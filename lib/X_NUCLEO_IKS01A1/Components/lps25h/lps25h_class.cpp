@@ -50,7 +50,8 @@
  * @param  LPS25H_Init the configuration setting for the LPS25H
  * @retval PRESSURE_OK in case of success, an error code otherwise
  */
-PRESSURE_StatusTypeDef LPS25H::LPS25H_Init(PRESSURE_InitTypeDef *LPS25H_Init)
+template <class Transport>
+PRESSURE_StatusTypeDef LPS25HDriver<Transport>::LPS25H_Init(PRESSURE_InitTypeDef *LPS25H_Init)
 {
   uint8_t tmp1 = 0x00;
   
@@ -119,7 +120,8 @@ PRESSURE_StatusTypeDef LPS25H::LPS25H_Init(PRESSURE_InitTypeDef *LPS25H_Init)
  * @param  ht_id the pointer where the ID of the device is stored
  * @retval PRESSURE_OK in case of success, an error code otherwise
  */
-PRESSURE_StatusTypeDef LPS25H::LPS25H_ReadID(uint8_t *p_id)
+template <class Transport>
+PRESSURE_StatusTypeDef LPS25HDriver<Transport>::LPS25H_ReadID(uint8_t *p_id)
 {
   if(!p_id)
   {
@@ -133,7 +135,8 @@ PRESSURE_StatusTypeDef LPS25H::LPS25H_ReadID(uint8_t *p_id)
  * @brief  Reboot memory content of LPS25H
  * @retval PRESSURE_OK in case of success, an error code otherwise
  */
-PRESSURE_StatusTypeDef LPS25H::LPS25H_RebootCmd(void)
+template <class Transport>
+PRESSURE_StatusTypeDef LPS25HDriver<Transport>::LPS25H_RebootCmd(void)
 {
   uint8_t tmpreg;
   
@@ -161,7 +164,8 @@ PRESSURE_StatusTypeDef LPS25H::LPS25H_RebootCmd(void)
  * @param  raw_press the pressure raw value
  * @retval PRESSURE_OK in case of success, an error code otherwise
  */
-PRESSURE_StatusTypeDef LPS25H::LPS25H_I2C_ReadRawPressure(int32_t *raw_press)
+template <class Transport>
+PRESSURE_StatusTypeDef LPS25HDriver<Transport>::LPS25H_I2C_ReadRawPressure(int32_t *raw_press)
 {
   uint8_t buffer[3], i;
   uint32_t tempVal = 0;
@@ -193,7 +197,8 @@ PRESSURE_StatusTypeDef LPS25H::LPS25H_I2C_ReadRawPressure(int32_t *raw_press)
  * @param  pfData the pressure value in mbar
  * @retval PRESSURE_OK in case of success, an error code otherwise
  */
-PRESSURE_StatusTypeDef LPS25H::LPS25H_GetPressure(float* pfData)
+template <class Transport>
+PRESSURE_StatusTypeDef LPS25HDriver<Transport>::LPS25H_GetPressure(float* pfData)
 {
   int32_t raw_press = 0;
   
@@ -212,7 +217,8 @@ PRESSURE_StatusTypeDef LPS25H::LPS25H_GetPressure(float* pfData)
  * @param  raw_data the temperature raw value
  * @retval PRESSURE_OK in case of success, an error code otherwise
  */
-PRESSURE_StatusTypeDef LPS25H::LPS25H_I2C_ReadRawTemperature(int16_t *raw_data)
+template <class Transport>
+PRESSURE_StatusTypeDef LPS25HDriver<Transport>::LPS25H_I2C_ReadRawTemperature(int16_t *raw_data)
 {
   uint8_t buffer[2];
   uint16_t tempVal = 0;
@@ -238,7 +244,8 @@ PRESSURE_StatusTypeDef LPS25H::LPS25H_I2C_ReadRawTemperature(int16_t *raw_data)
  * @param  pfData the temperature value
  * @retval PRESSURE_OK in case of success, an error code otherwise
  */
-PRESSURE_StatusTypeDef LPS25H::LPS25H_GetTemperature(float *pfData)
+template <class Transport>
+PRESSURE_StatusTypeDef LPS25HDriver<Transport>::LPS25H_GetTemperature(float *pfData)
 {
   int16_t raw_data;
   
@@ -255,7 +262,8 @@ PRESSURE_StatusTypeDef LPS25H::LPS25H_GetTemperature(float *pfData)
  * @brief  Exit the shutdown mode for LPS25H
  * @retval PRESSURE_OK in case of success, an error code otherwise
  */
-PRESSURE_StatusTypeDef LPS25H::LPS25H_PowerOn(void)
+template <class Transport>
+PRESSURE_StatusTypeDef LPS25HDriver<Transport>::LPS25H_PowerOn(void)
 {
   uint8_t tmpreg;
   
@@ -282,7 +290,8 @@ PRESSURE_StatusTypeDef LPS25H::LPS25H_PowerOn(void)
  * @brief  Enter the shutdown mode for LPS25H
  * @retval PRESSURE_OK in case of success, an error code otherwise
  */
-PRESSURE_StatusTypeDef LPS25H::LPS25H_PowerOff(void)
+template <class Transport>
+PRESSURE_StatusTypeDef LPS25HDriver<Transport>::LPS25H_PowerOff(void)
 {
   uint8_t tmpreg;
   
@@ -309,9 +318,13 @@ PRESSURE_StatusTypeDef LPS25H::LPS25H_PowerOff(void)
  * @param  SA0_Bit_Status LPS25H_SA0_LOW or LPS25H_SA0_HIGH
  * @retval None
  */
-void LPS25H::LPS25H_SlaveAddrRemap(uint8_t SA0_Bit_Status)
+template <class Transport>
+void LPS25HDriver<Transport>::LPS25H_SlaveAddrRemap(uint8_t SA0_Bit_Status)
 {
   LPS25H_SlaveAddress = (SA0_Bit_Status == LPS25H_SA0_LOW ? LPS25H_ADDRESS_LOW : LPS25H_ADDRESS_HIGH);
 }
 
+/* Explicit instantiations ---------------------------------------------------*/
+template class LPS25HDriver<I2CTransport>;
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -41,25 +41,28 @@
 /* Includes ------------------------------------------------------------------*/
 #include "mbed.h"
 #include "DevI2C.h"
+#include "../Common/transport.h"
 #include "lps25h.h"
 #include "../Interfaces/PressureSensor.h"
 #include "../Interfaces/TempSensor.h"
 
 /* Classes -------------------------------------------------------------------*/
-/** Class representing a LPS25H sensor component
+/** Class representing a LPS25H sensor component, reading and writing its
+ *  registers through a Transport (see transport.h)
  */
-class LPS25H : public PressureSensor, public TempSensor {
+template <class Transport>
+class LPS25HDriver : public PressureSensor, public TempSensor {
  public:
 	/** Constructor
-	 * @param[in] i2c device I2C to be used for communication
+	 * @param[in] transport the bus, a DevI2C for the default Transport
 	 */
-        LPS25H(DevI2C &i2c) : PressureSensor(), TempSensor(), dev_i2c(i2c) {
+        LPS25HDriver(const Transport &transport) : PressureSensor(), TempSensor(), transport(transport) {
 		LPS25H_SlaveAddress = LPS25H_ADDRESS_HIGH;
 	}
 	
 	/** Destructor
 	 */
-        virtual ~LPS25H() {}
+        virtual ~LPS25HDriver() {}
 	
 	/*** Interface Methods ***/
 	virtual int Init(void *init_struct) {
@@ -140,10 +143,7 @@ protected:
 	PRESSURE_StatusTypeDef LPS25H_IO_Read(uint8_t* pBuffer, 
 					      uint8_t RegisterAddr, uint16_t NumByteToRead)
 	{
-		int ret = dev_i2c.i2c_read(pBuffer,
-					   LPS25H_SlaveAddress,
-					   RegisterAddr,
-					   NumByteToRead);
+		int ret = transport.read(pBuffer, LPS25H_SlaveAddress, RegisterAddr, NumByteToRead);
 		if(ret != 0) {
 			return PRESSURE_ERROR;
 		}
@@ -161,10 +161,7 @@ protected:
 	PRESSURE_StatusTypeDef LPS25H_IO_Write(uint8_t* pBuffer, 
 					       uint8_t RegisterAddr, uint16_t NumByteToWrite)
 	{
-		int ret = dev_i2c.i2c_write(pBuffer,
-					    LPS25H_SlaveAddress,
-					    RegisterAddr,
-					    NumByteToWrite);
+		int ret = transport.write(pBuffer, LPS25H_SlaveAddress, RegisterAddr, NumByteToWrite);
 		if(ret != 0) {
 			return PRESSURE_ERROR;
 		}
@@ -173,9 +170,12 @@ protected:
 	
 	/*** Instance Variables ***/
 	/* IO Device */
-	DevI2C &dev_i2c;
+	Transport transport;
 
 	uint8_t LPS25H_SlaveAddress;
 };
 
+/** The LPS25H as the expansion board has it */
+typedef LPS25HDriver<I2CTransport> LPS25H;
+
 #endif // __LPS25H_CLASS_H
@@ -50,7 +50,8 @@
  * @param  LSM6DS0_Init the configuration setting for the LSM6DS0
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_Init(IMU_6AXES_InitTypeDef *LSM6DS0_Init)
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS0Driver<Transport>::LSM6DS0_Init(IMU_6AXES_InitTypeDef *LSM6DS0_Init)
 {
   /* Configure the low level interface ---------------------------------------*/
   if(LSM6DS0_IO_Init() != IMU_6AXES_OK)
@@ -108,7 +109,8 @@ IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_Init(IMU_6AXES_InitTypeDef *LSM6DS0_Ini
  * @param  xg_id the pointer where the ID of the device is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_Read_XG_ID(uint8_t *xg_id)
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS0Driver<Transport>::LSM6DS0_Read_XG_ID(uint8_t *xg_id)
 {
   if(!xg_id)
   {
@@ -124,7 +126,8 @@ IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_Read_XG_ID(uint8_t *xg_id)
  * @param  pData the pointer where the accelerometer raw data are stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_X_GetAxesRaw(int16_t *pData)
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS0Driver<Transport>::LSM6DS0_X_GetAxesRaw(int16_t *pData)
 {
   uint8_t tempReg[2] = {0, 0};
   
@@ -161,7 +164,8 @@ IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_X_GetAxesRaw(int16_t *pData)
  * @param  pData the pointer where the accelerometer data are stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_X_GetAxes(int32_t *pData)
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS0Driver<Transport>::LSM6DS0_X_GetAxes(int32_t *pData)
 {
   int16_t pDataRaw[3];
   float sensitivity = 0;
@@ -189,7 +193,8 @@ IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_X_GetAxes(int32_t *pData)
  * @param  pData the pointer where the gyroscope raw data are stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_G_GetAxesRaw(int16_t *pData)
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS0Driver<Transport>::LSM6DS0_G_GetAxesRaw(int16_t *pData)
 {
   uint8_t tempReg[2] = {0, 0};
   
@@ -227,7 +232,8 @@ IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_G_GetAxesRaw(int16_t *pData)
  * @param  enableZ the status of the z axis to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_X_Set_Axes_Status(uint8_t enableX, uint8_t enableY, uint8_t enableZ)
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS0Driver<Transport>::LSM6DS0_X_Set_Axes_Status(uint8_t enableX, uint8_t enableY, uint8_t enableZ)
 {
   uint8_t tmp1 = 0x00;
   uint8_t eX = 0x00;
@@ -270,7 +276,8 @@ IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_X_Set_Axes_Status(uint8_t enableX, uint
  * @param  enableZ the status of the z axis to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_G_Set_Axes_Status(uint8_t enableX, uint8_t enableY, uint8_t enableZ)
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS0Driver<Transport>::LSM6DS0_G_Set_Axes_Status(uint8_t enableX, uint8_t enableY, uint8_t enableZ)
 {
   uint8_t tmp1 = 0x00;
   uint8_t eX = 0x00;
@@ -312,7 +319,8 @@ IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_G_Set_Axes_Status(uint8_t enableX, uint
  * @param  pData the pointer where the gyroscope data are stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_G_GetAxes(int32_t *pData)
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS0Driver<Transport>::LSM6DS0_G_GetAxes(int32_t *pData)
 {
   int16_t pDataRaw[3];
   float sensitivity = 0;
@@ -339,7 +347,8 @@ IMU_6AXES_StatusTypeDef LSM6DS0::LSM6DS0_G_GetAxes(int32_t *pData)
  * @param  odr the pointer where the accelerometer output data rate is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_X_Get_ODR( float *odr )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS0Driver<Transport>::LSM6DS0_X_Get_ODR( float *odr )
 {
   /*Here we have to add the check if the parameters are valid*/
   uint8_t tempReg = 0x00;
@@ -386,7 +395,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_X_Get_ODR( float *odr )
  * @param  odr the accelerometer output data rate to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_X_Set_ODR( float odr )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS0Driver<Transport>::LSM6DS0_X_Set_ODR( float odr )
 {
   uint8_t new_odr = 0x00;
   uint8_t tempReg = 0x00;
@@ -420,7 +430,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_X_Set_ODR( float odr )
  * @param  pfData the pointer where the accelerometer sensitivity is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_X_GetSensitivity( float *pfData )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS0Driver<Transport>::LSM6DS0_X_GetSensitivity( float *pfData )
 {
   /*Here we have to add the check if the parameters are valid*/
   uint8_t tempReg = 0x00;
@@ -458,7 +469,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_X_GetSensitivity( float *pfData )
  * @param  fullScale the pointer where the accelerometer full scale is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_X_Get_FS( float *fullScale )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS0Driver<Transport>::LSM6DS0_X_Get_FS( float *fullScale )
 {
   /*Here we have to add the check if the parameters are valid*/
   uint8_t tempReg = 0x00;
@@ -496,7 +508,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_X_Get_FS( float *fullScale )
  * @param  fullScale the accelerometer full scale to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_X_Set_FS( float fullScale )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS0Driver<Transport>::LSM6DS0_X_Set_FS( float fullScale )
 {
   uint8_t new_fs = 0x00;
   uint8_t tempReg = 0x00;
@@ -527,7 +540,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_X_Set_FS( float fullScale )
  * @param  odr the pointer where the gyroscope output data rate is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_G_Get_ODR( float *odr )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS0Driver<Transport>::LSM6DS0_G_Get_ODR( float *odr )
 {
   /*Here we have to add the check if the parameters are valid*/
   uint8_t tempReg = 0x00;
@@ -574,7 +588,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_G_Get_ODR( float *odr )
  * @param  odr the gyroscope output data rate to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_G_Set_ODR( float odr )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS0Driver<Transport>::LSM6DS0_G_Set_ODR( float odr )
 {
   uint8_t new_odr = 0x00;
   uint8_t tempReg = 0x00;
@@ -608,7 +623,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_G_Set_ODR( float odr )
  * @param  pfData the pointer where the gyroscope sensitivity is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
 */
-IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_G_GetSensitivity( float *pfData )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS0Driver<Transport>::LSM6DS0_G_GetSensitivity( float *pfData )
 {
   /*Here we have to add the check if the parameters are valid*/
   uint8_t tempReg = 0x00;
@@ -643,7 +659,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_G_GetSensitivity( float *pfData )
  * @param  fullScale the pointer where the gyroscope full scale is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
 */
-IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_G_Get_FS( float *fullScale )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS0Driver<Transport>::LSM6DS0_G_Get_FS( float *fullScale )
 {
   /*Here we have to add the check if the parameters are valid*/
   uint8_t tempReg = 0x00;
@@ -678,7 +695,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_G_Get_FS( float *fullScale )
  * @param  fullScale the gyroscope full scale to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
 */
-IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_G_Set_FS( float fullScale )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS0Driver<Transport>::LSM6DS0_G_Set_FS( float fullScale )
 {
   uint8_t new_fs = 0x00;
   uint8_t tempReg = 0x00;
@@ -703,4 +721,7 @@ IMU_6AXES_StatusTypeDef    LSM6DS0::LSM6DS0_G_Set_FS( float fullScale )
   return IMU_6AXES_OK;
 }
 
+/* Explicit instantiations ---------------------------------------------------*/
+template class LSM6DS0Driver<I2CTransport>;
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -41,24 +41,27 @@
 /* Includes ------------------------------------------------------------------*/
 #include "mbed.h"
 #include "DevI2C.h"
+#include "../Common/transport.h"
 #include "lsm6ds0.h"
 #include "../Interfaces/GyroSensor.h"
 #include "../Interfaces/MotionSensor.h"
 
 /* Classes -------------------------------------------------------------------*/
-/** Class representing a LSM6DS0 sensor component
+/** Class representing a LSM6DS0 sensor component, reading and writing its
+ *  registers through a Transport (see transport.h)
  */
-class LSM6DS0 : public GyroSensor, public MotionSensor {
+template <class Transport>
+class LSM6DS0Driver : public GyroSensor, public MotionSensor {
  public:
 	/** Constructor
-	 * @param[in] i2c device I2C to be used for communication
+	 * @param[in] transport the bus, a DevI2C for the default Transport
 	 */
-        LSM6DS0(DevI2C &i2c) : GyroSensor(), MotionSensor(), dev_i2c(i2c) {
+        LSM6DS0Driver(const Transport &transport) : GyroSensor(), MotionSensor(), transport(transport) {
 	}
 	
 	/** Destructor
 	 */
-        virtual ~LSM6DS0() {}
+        virtual ~LSM6DS0Driver() {}
 	
 	/*** Interface Methods ***/
 	virtual int Init(void *init_struct) {
@@ -175,10 +178,7 @@ class LSM6DS0 : public GyroSensor, public MotionSensor {
 	IMU_6AXES_StatusTypeDef LSM6DS0_IO_Read(uint8_t* pBuffer, 
 					      uint8_t RegisterAddr, uint16_t NumByteToRead)
 	{
-		int ret = dev_i2c.i2c_read(pBuffer,
-					   LSM6DS0_XG_MEMS_ADDRESS,
-					   RegisterAddr,
-					   NumByteToRead);
+		int ret = transport.read(pBuffer, LSM6DS0_XG_MEMS_ADDRESS, RegisterAddr, NumByteToRead);
 		if(ret != 0) {
 			return IMU_6AXES_ERROR;
 		}
@@ -196,10 +196,7 @@ class LSM6DS0 : public GyroSensor, public MotionSensor {
 	IMU_6AXES_StatusTypeDef LSM6DS0_IO_Write(uint8_t* pBuffer, 
 					       uint8_t RegisterAddr, uint16_t NumByteToWrite)
 	{
-		int ret = dev_i2c.i2c_write(pBuffer,
-					    LSM6DS0_XG_MEMS_ADDRESS,
-					    RegisterAddr,
-					    NumByteToWrite);
+		int ret = transport.write(pBuffer, LSM6DS0_XG_MEMS_ADDRESS, RegisterAddr, NumByteToWrite);
 		if(ret != 0) {
 			return IMU_6AXES_ERROR;
 		}
@@ -208,7 +205,10 @@ class LSM6DS0 : public GyroSensor, public MotionSensor {
 	
 	/*** Instance Variables ***/
 	/* IO Device */
-	DevI2C &dev_i2c;
+	Transport transport;
 };
 
+/** The LSM6DS0 as the expansion board has it */
+typedef LSM6DS0Driver<I2CTransport> LSM6DS0;
+
 #endif // __LSM6DS0_CLASS_H
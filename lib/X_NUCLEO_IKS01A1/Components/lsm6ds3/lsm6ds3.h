@@ -1003,13 +1003,63 @@ extern "C" {
 #define LSM6DS3_XG_FIFO_MODE_FIFO                       ((uint8_t)0x01) /*!< FIFO Mode. Stop collecting data when FIFO is full */
 #define LSM6DS3_XG_FIFO_MODE_CONTINUOUS_THEN_FIFO       ((uint8_t)0x03) /*!< CONTINUOUS mode until trigger is deasserted, then FIFO mode */
 #define LSM6DS3_XG_FIFO_MODE_BYPASS_THEN_CONTINUOUS     ((uint8_t)0x04) /*!< BYPASS mode until trigger is deasserted, then CONTINUOUS mode */
-#define LSM6DS3_XG_FIFO_MODE_CONTINUOUS_OVERWRITE       ((uint8_t)0x05) /*!< CONTINUOUS mode. If the FIFO is full the new sample overwrite the older one */
+#define LSM6DS3_XG_FIFO_MODE_CONTINUOUS_OVERWRITE       ((uint8_t)0x06) /*!< CONTINUOUS mode. If the FIFO is full the new sample overwrite the older one */
 
 #define LSM6DS3_XG_FIFO_MODE_MASK                       ((uint8_t)0x07)
 /**
  * @}
  */
 
+/** @defgroup LSM6DS3_XG_FIFO_Threshold_FIFO_CTRL2 LSM6DS3_XG_FIFO_Threshold_FIFO_CTRL2
+ * @{
+ */
+#define LSM6DS3_XG_FIFO_FTH_MAX                         ((uint16_t)0x0FFF) /*!< FIFO threshold is 12 bit wide, in words */
+
+#define LSM6DS3_XG_FIFO_FTH_H_MASK                      ((uint8_t)0x0F)
+/**
+ * @}
+ */
+
+/** @defgroup LSM6DS3_XG_FIFO_Decimation_FIFO_CTRL3 LSM6DS3_XG_FIFO_Decimation_FIFO_CTRL3
+ * @{
+ */
+#define LSM6DS3_XG_FIFO_DEC_XL_NOT_IN_FIFO              ((uint8_t)0x00) /*!< Accelerometer sensor not in FIFO */
+#define LSM6DS3_XG_FIFO_DEC_XL_NO_DECIMATION            ((uint8_t)0x01) /*!< Accelerometer in FIFO, no decimation */
+
+#define LSM6DS3_XG_FIFO_DEC_XL_MASK                     ((uint8_t)0x07)
+
+#define LSM6DS3_XG_FIFO_DEC_G_NOT_IN_FIFO               ((uint8_t)0x00) /*!< Gyroscope sensor not in FIFO */
+#define LSM6DS3_XG_FIFO_DEC_G_NO_DECIMATION             ((uint8_t)0x08) /*!< Gyroscope in FIFO, no decimation */
+
+#define LSM6DS3_XG_FIFO_DEC_G_MASK                      ((uint8_t)0x38)
+/**
+ * @}
+ */
+
+/** @defgroup LSM6DS3_XG_INT1_FIFO_Threshold_INT1_CTRL LSM6DS3_XG_INT1_FIFO_Threshold_INT1_CTRL
+ * @{
+ */
+#define LSM6DS3_XG_INT1_FTH_DISABLE                     ((uint8_t)0x00)
+#define LSM6DS3_XG_INT1_FTH_ENABLE                      ((uint8_t)0x08)
+
+#define LSM6DS3_XG_INT1_FTH_MASK                        ((uint8_t)0x08)
+/**
+ * @}
+ */
+
+/** @defgroup LSM6DS3_XG_FIFO_Status_FIFO_STATUS2 LSM6DS3_XG_FIFO_Status_FIFO_STATUS2
+ * @{
+ */
+#define LSM6DS3_XG_FIFO_STATUS2_FTH                     ((uint8_t)0x80) /*!< FIFO watermark reached */
+#define LSM6DS3_XG_FIFO_STATUS2_OVER_RUN                ((uint8_t)0x40) /*!< FIFO overrun, oldest samples lost */
+#define LSM6DS3_XG_FIFO_STATUS2_FIFO_FULL               ((uint8_t)0x20) /*!< FIFO full */
+#define LSM6DS3_XG_FIFO_STATUS2_FIFO_EMPTY              ((uint8_t)0x10) /*!< FIFO empty */
+
+#define LSM6DS3_XG_FIFO_STATUS2_DIFF_H_MASK             ((uint8_t)0x0F)
+/**
+ * @}
+ */
+
 
 /************************************** GYROSCOPE REGISTERS VALUE *******************************************/
 
@@ -1411,6 +1461,68 @@ extern "C" {
  * @}
  */
 
+/** @defgroup LSM6DS3_XG_Event_Sources_TAP_SRC LSM6DS3_XG_Event_Sources_TAP_SRC
+ * @{
+ */
+#define LSM6DS3_XG_TAP_SRC_TAP_IA_MASK                  ((uint8_t)0x40) /*!< Tap event detected */
+#define LSM6DS3_XG_TAP_SRC_SINGLE_TAP_MASK              ((uint8_t)0x20) /*!< Single tap event */
+#define LSM6DS3_XG_TAP_SRC_DOUBLE_TAP_MASK              ((uint8_t)0x10) /*!< Double tap event */
+#define LSM6DS3_XG_TAP_SRC_AXES_MASK                    ((uint8_t)0x0F) /*!< Tap sign and X/Y/Z axis */
+/**
+ * @}
+ */
+
+/** @defgroup LSM6DS3_XG_Event_Sources_D6D_SRC LSM6DS3_XG_Event_Sources_D6D_SRC
+ * @{
+ */
+#define LSM6DS3_XG_D6D_SRC_D6D_IA_MASK                  ((uint8_t)0x40) /*!< Orientation change detected */
+#define LSM6DS3_XG_D6D_SRC_POSITION_MASK                ((uint8_t)0x3F) /*!< ZH/ZL/YH/YL/XH/XL */
+/**
+ * @}
+ */
+
+/** @defgroup LSM6DS3_XG_Event_Sources_FUNC_SRC LSM6DS3_XG_Event_Sources_FUNC_SRC
+ * @{
+ */
+#define LSM6DS3_XG_FUNC_SRC_TILT_IA_MASK                ((uint8_t)0x20) /*!< Tilt event detected */
+/**
+ * @}
+ */
+
+/** @defgroup LSM6DS3_XG_Embedded_Functions_TAP_CFG LSM6DS3_XG_Embedded_Functions_TAP_CFG
+ * @{
+ */
+#define LSM6DS3_XG_TAP_CFG_TILT_EN_ENABLE               ((uint8_t)0x20)
+#define LSM6DS3_XG_TAP_CFG_TILT_EN_MASK                 ((uint8_t)0x20)
+#define LSM6DS3_XG_TAP_CFG_TAP_XYZ_EN_ENABLE            ((uint8_t)0x0E)
+#define LSM6DS3_XG_TAP_CFG_TAP_XYZ_EN_MASK              ((uint8_t)0x0E)
+#define LSM6DS3_XG_TAP_CFG_LIR_ENABLE                   ((uint8_t)0x01) /*!< Latch event flags until the source register is read */
+#define LSM6DS3_XG_TAP_CFG_LIR_MASK                     ((uint8_t)0x01)
+/**
+ * @}
+ */
+
+/** @defgroup LSM6DS3_XG_Embedded_Functions_CTRL10_C LSM6DS3_XG_Embedded_Functions_CTRL10_C
+ * @{
+ */
+#define LSM6DS3_XG_CTRL10_C_FUNC_EN_ENABLE              ((uint8_t)0x04) /*!< Needed by tilt, pedometer and significant motion */
+#define LSM6DS3_XG_CTRL10_C_FUNC_EN_MASK                ((uint8_t)0x04)
+/**
+ * @}
+ */
+
+/** @defgroup LSM6DS3_XG_Event_Thresholds LSM6DS3_XG_Event_Thresholds
+ * @{
+ */
+#define LSM6DS3_XG_WAKE_UP_THS_WK_THS_TYPICAL           ((uint8_t)0x02) /*!< 2 * FS/64, 62.5mg at 2g */
+#define LSM6DS3_XG_WAKE_UP_THS_WK_THS_MASK              ((uint8_t)0x3F)
+#define LSM6DS3_XG_TAP_THS_6D_TAP_THS_TYPICAL           ((uint8_t)0x09) /*!< 9 * FS/32, 562mg at 2g */
+#define LSM6DS3_XG_TAP_THS_6D_TAP_THS_MASK              ((uint8_t)0x1F)
+#define LSM6DS3_XG_INT_DUR2_TAP_TYPICAL                 ((uint8_t)0x06) /*!< QUIET = 1, SHOCK = 2 */
+/**
+ * @}
+ */
+
 /**
  * @}
  */
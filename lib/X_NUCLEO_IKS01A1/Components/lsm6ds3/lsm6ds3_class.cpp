@@ -50,7 +50,8 @@
  * @param  LSM6DS3_Init the configuration setting for the LSM6DS3
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_Init( IMU_6AXES_InitTypeDef *LSM6DS3_Init )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Init( IMU_6AXES_InitTypeDef *LSM6DS3_Init )
 {
   /*Here we have to add the check if the parameters are valid*/
   
@@ -69,37 +70,37 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_Init( IMU_6AXES_InitTypeDef *LSM6DS3
   }
   
   
-  /******* Gyroscope init *******/
-  
-  if(LSM6DS3_G_Set_ODR( LSM6DS3_Init->G_OutputDataRate ) != IMU_6AXES_OK)
+  /* The settings below are read-modify-writes of CTRL1_XL to CTRL10_C, made
+     on a copy read in one transfer and written back in one (IF_INC is set
+     by now) */
+  if(ctrl_batch.begin(transport, LSM6DS3_XG_MEMS_ADDRESS, LSM6DS3_XG_CTRL1_XL) != 0)
   {
     return IMU_6AXES_ERROR;
   }
   
-  if(LSM6DS3_G_Set_FS( LSM6DS3_Init->G_FullScale ) != IMU_6AXES_OK)
-  {
-    return IMU_6AXES_ERROR;
-  }
   
-  if(LSM6DS3_G_Set_Axes_Status(LSM6DS3_Init->G_X_Axis, LSM6DS3_Init->G_Y_Axis, LSM6DS3_Init->G_Z_Axis) != IMU_6AXES_OK)
+  /******* Gyroscope init *******/
+  
+  if(LSM6DS3_G_Set_ODR( LSM6DS3_Init->G_OutputDataRate ) != IMU_6AXES_OK ||
+     LSM6DS3_G_Set_FS( LSM6DS3_Init->G_FullScale ) != IMU_6AXES_OK ||
+     LSM6DS3_G_Set_Axes_Status(LSM6DS3_Init->G_X_Axis, LSM6DS3_Init->G_Y_Axis, LSM6DS3_Init->G_Z_Axis) != IMU_6AXES_OK)
   {
+    ctrl_batch.end(transport, LSM6DS3_XG_MEMS_ADDRESS);
     return IMU_6AXES_ERROR;
   }
   
   
   /***** Accelerometer init *****/
   
-  if(LSM6DS3_X_Set_ODR( LSM6DS3_Init->X_OutputDataRate ) != IMU_6AXES_OK)
+  if(LSM6DS3_X_Set_ODR( LSM6DS3_Init->X_OutputDataRate ) != IMU_6AXES_OK ||
+     LSM6DS3_X_Set_FS( LSM6DS3_Init->X_FullScale ) != IMU_6AXES_OK ||
+     LSM6DS3_X_Set_Axes_Status(LSM6DS3_Init->X_X_Axis, LSM6DS3_Init->X_Y_Axis, LSM6DS3_Init->X_Z_Axis) != IMU_6AXES_OK)
   {
+    ctrl_batch.end(transport, LSM6DS3_XG_MEMS_ADDRESS);
     return IMU_6AXES_ERROR;
   }
   
-  if(LSM6DS3_X_Set_FS( LSM6DS3_Init->X_FullScale ) != IMU_6AXES_OK)
-  {
-    return IMU_6AXES_ERROR;
-  }
-  
-  if(LSM6DS3_X_Set_Axes_Status(LSM6DS3_Init->X_X_Axis, LSM6DS3_Init->X_Y_Axis, LSM6DS3_Init->X_Z_Axis) != IMU_6AXES_OK)
+  if(ctrl_batch.end(transport, LSM6DS3_XG_MEMS_ADDRESS) != 0)
   {
     return IMU_6AXES_ERROR;
   }
@@ -115,7 +116,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_Init( IMU_6AXES_InitTypeDef *LSM6DS3
  * @param  xg_id the pointer where the ID of the device is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_Read_XG_ID( uint8_t *xg_id)
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Read_XG_ID( uint8_t *xg_id)
 {
   if(!xg_id)
   {
@@ -129,7 +131,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_Read_XG_ID( uint8_t *xg_id)
  * @brief  Set LSM6DS3 common initialization
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS3::LSM6DS3_Common_Sensor_Enable(void)
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS3Driver<Transport>::LSM6DS3_Common_Sensor_Enable(void)
 {
   uint8_t tmp1 = 0x00;
   
@@ -175,7 +178,8 @@ IMU_6AXES_StatusTypeDef LSM6DS3::LSM6DS3_Common_Sensor_Enable(void)
  * @param  pData the pointer where the accelerometer raw data are stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS3::LSM6DS3_X_GetAxesRaw( int16_t *pData )
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS3Driver<Transport>::LSM6DS3_X_GetAxesRaw( int16_t *pData )
 {
   /*Here we have to add the check if the parameters are valid*/
   
@@ -213,7 +217,8 @@ IMU_6AXES_StatusTypeDef LSM6DS3::LSM6DS3_X_GetAxesRaw( int16_t *pData )
  * @param  pData the pointer where the accelerometer data are stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_GetAxes( int32_t *pData )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_X_GetAxes( int32_t *pData )
 {
   /*Here we have to add the check if the parameters are valid*/
   int16_t pDataRaw[3];
@@ -243,7 +248,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_GetAxes( int32_t *pData )
  * @param  pData the pointer where the gyroscope raw data are stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS3::LSM6DS3_G_GetAxesRaw( int16_t *pData )
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS3Driver<Transport>::LSM6DS3_G_GetAxesRaw( int16_t *pData )
 {
   /*Here we have to add the check if the parameters are valid*/
   
@@ -281,7 +287,8 @@ IMU_6AXES_StatusTypeDef LSM6DS3::LSM6DS3_G_GetAxesRaw( int16_t *pData )
  * @param  enableZ the status of the z axis to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS3::LSM6DS3_X_Set_Axes_Status(uint8_t enableX, uint8_t enableY, uint8_t enableZ)
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS3Driver<Transport>::LSM6DS3_X_Set_Axes_Status(uint8_t enableX, uint8_t enableY, uint8_t enableZ)
 {
   uint8_t tmp1 = 0x00;
   uint8_t eX = 0x00;
@@ -324,7 +331,8 @@ IMU_6AXES_StatusTypeDef LSM6DS3::LSM6DS3_X_Set_Axes_Status(uint8_t enableX, uint
  * @param  enableZ the status of the z axis to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef LSM6DS3::LSM6DS3_G_Set_Axes_Status(uint8_t enableX, uint8_t enableY, uint8_t enableZ)
+template <class Transport>
+IMU_6AXES_StatusTypeDef LSM6DS3Driver<Transport>::LSM6DS3_G_Set_Axes_Status(uint8_t enableX, uint8_t enableY, uint8_t enableZ)
 {
   uint8_t tmp1 = 0x00;
   uint8_t eX = 0x00;
@@ -365,7 +373,8 @@ IMU_6AXES_StatusTypeDef LSM6DS3::LSM6DS3_G_Set_Axes_Status(uint8_t enableX, uint
  * @param  pData the pointer where the gyroscope data are stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_GetAxes( int32_t *pData )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_G_GetAxes( int32_t *pData )
 {
   /*Here we have to add the check if the parameters are valid*/
   int16_t pDataRaw[3];
@@ -393,7 +402,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_GetAxes( int32_t *pData )
  * @param  odr the pointer where the accelerometer output data rate is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_Get_ODR( float *odr )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_X_Get_ODR( float *odr )
 {
   /*Here we have to add the check if the parameters are valid*/
   uint8_t tempReg = 0x00;
@@ -452,7 +462,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_Get_ODR( float *odr )
  * @param  odr the accelerometer output data rate to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_Set_ODR( float odr )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_X_Set_ODR( float odr )
 {
   uint8_t new_odr = 0x00;
   uint8_t tempReg = 0x00;
@@ -490,7 +501,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_Set_ODR( float odr )
  * @param  pfData the pointer where the accelerometer sensitivity is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_GetSensitivity( float *pfData )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_X_GetSensitivity( float *pfData )
 {
   /*Here we have to add the check if the parameters are valid*/
   
@@ -530,7 +542,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_GetSensitivity( float *pfData )
  * @param  fullScale the pointer where the accelerometer full scale is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_Get_FS( float *fullScale )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_X_Get_FS( float *fullScale )
 {
   /*Here we have to add the check if the parameters are valid*/
   
@@ -570,7 +583,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_Get_FS( float *fullScale )
  * @param  fullScale the accelerometer full scale to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_Set_FS( float fullScale )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_X_Set_FS( float fullScale )
 {
   uint8_t new_fs = 0x00;
   uint8_t tempReg = 0x00;
@@ -601,7 +615,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_X_Set_FS( float fullScale )
  * @param  odr the pointer where the gyroscope output data rate is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_Get_ODR( float *odr )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_G_Get_ODR( float *odr )
 {
   /*Here we have to add the check if the parameters are valid*/
   uint8_t tempReg = 0x00;
@@ -654,7 +669,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_Get_ODR( float *odr )
  * @param  odr the gyroscope output data rate to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
  */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_Set_ODR( float odr )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_G_Set_ODR( float odr )
 {
   uint8_t new_odr = 0x00;
   uint8_t tempReg = 0x00;
@@ -690,7 +706,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_Set_ODR( float odr )
  * @param  pfData the pointer where the gyroscope sensitivity is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
 */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_GetSensitivity( float *pfData )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_G_GetSensitivity( float *pfData )
 {
   /*Here we have to add the check if the parameters are valid*/
   
@@ -743,7 +760,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_GetSensitivity( float *pfData )
  * @param  fullScale the pointer where the gyroscope full scale is stored
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
 */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_Get_FS( float *fullScale )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_G_Get_FS( float *fullScale )
 {
   /*Here we have to add the check if the parameters are valid*/
   
@@ -796,7 +814,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_Get_FS( float *fullScale )
  * @param  fullScale the gyroscope full scale to be set
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
 */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_Set_FS( float fullScale )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_G_Set_FS( float fullScale )
 {
   uint8_t new_fs = 0x00;
   uint8_t tempReg = 0x00;
@@ -860,7 +879,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_G_Set_FS( float fullScale )
  * @brief  Enable free fall detection
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
 */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_Enable_Free_Fall_Detection( void )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Enable_Free_Fall_Detection( void )
 {
   uint8_t tmp1 = 0x00;
   
@@ -947,7 +967,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_Enable_Free_Fall_Detection( void )
  * @brief  Disable free fall detection
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
 */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_Disable_Free_Fall_Detection( void )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Disable_Free_Fall_Detection( void )
 {
   uint8_t tmp1 = 0x00;
   
@@ -991,7 +1012,8 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_Disable_Free_Fall_Detection( void )
  * @param  status the pointer where the status of free fall detection is stored; 0 means no detection, 1 means detection happened
  * @retval IMU_6AXES_OK in case of success, an error code otherwise
 */
-IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_Get_Status_Free_Fall_Detection( uint8_t *status )
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Get_Status_Free_Fall_Detection( uint8_t *status )
 {
   uint8_t tmp1 = 0x00;
   
@@ -1016,4 +1038,408 @@ IMU_6AXES_StatusTypeDef    LSM6DS3::LSM6DS3_Get_Status_Free_Fall_Detection( uint
   return IMU_6AXES_OK;
 }
 
+/**
+ * @brief  Enable accelerometer FIFO in continuous mode with watermark interrupt on INT1
+ * @param  watermark number of X/Y/Z samples after which the FIFO threshold flag is raised
+ * @param  odr the FIFO output data rate to be set
+ * @retval IMU_6AXES_OK in case of success, an error code otherwise
+*/
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Enable_X_FIFO( uint16_t watermark, float odr )
+{
+  uint8_t tmp1 = 0x00;
+  uint8_t threshold = 0x00;
+  uint8_t ctrl[4];
+  I2CSegment segments[2];
+  uint8_t new_odr = 0x00;
+  uint32_t words = (uint32_t)watermark * 3;
+  
+  if((watermark == 0) || (words > LSM6DS3_XG_FIFO_FTH_MAX))
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  new_odr = ( odr <= 10.0f   ) ? LSM6DS3_XG_FIFO_ODR_10HZ
+            : ( odr <= 25.0f   ) ? LSM6DS3_XG_FIFO_ODR_25HZ
+            : ( odr <= 50.0f   ) ? LSM6DS3_XG_FIFO_ODR_50HZ
+            : ( odr <= 100.0f  ) ? LSM6DS3_XG_FIFO_ODR_100HZ
+            : ( odr <= 200.0f  ) ? LSM6DS3_XG_FIFO_ODR_200HZ
+            : ( odr <= 400.0f  ) ? LSM6DS3_XG_FIFO_ODR_400HZ
+            : ( odr <= 800.0f  ) ? LSM6DS3_XG_FIFO_ODR_800HZ
+            : ( odr <= 1600.0f ) ? LSM6DS3_XG_FIFO_ODR_1600HZ
+            : ( odr <= 3300.0f ) ? LSM6DS3_XG_FIFO_ODR_3300HZ
+            :                      LSM6DS3_XG_FIFO_ODR_6600HZ;
+  
+  /* FIFO_CTRL2 to FIFO_CTRL5 in one transaction, to be modified */
+  if(LSM6DS3_IO_Read(ctrl, LSM6DS3_XG_FIFO_CTRL2, 4) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* FIFO threshold, in 16 bit words */
+  threshold = (uint8_t)(words & 0xFF);
+  ctrl[0] &= ~(LSM6DS3_XG_FIFO_FTH_H_MASK);
+  ctrl[0] |= (uint8_t)((words >> 8) & LSM6DS3_XG_FIFO_FTH_H_MASK);
+  
+  /* Only the accelerometer goes into the FIFO, so every sample is an X/Y/Z triplet */
+  ctrl[1] = LSM6DS3_XG_FIFO_DEC_XL_NO_DECIMATION | LSM6DS3_XG_FIFO_DEC_G_NOT_IN_FIFO;
+  
+  /* FIFO ODR selection */
+  ctrl[3] &= ~(LSM6DS3_XG_FIFO_ODR_MASK);
+  ctrl[3] |= new_odr;
+  
+  /* FIFO mode selection */
+  ctrl[3] &= ~(LSM6DS3_XG_FIFO_MODE_MASK);
+  ctrl[3] |= LSM6DS3_XG_FIFO_MODE_CONTINUOUS_OVERWRITE;
+  
+  /* FIFO_CTRL1 to FIFO_CTRL5 in one transaction, so the mode in FIFO_CTRL5
+     goes in last, after the threshold and decimation it depends on */
+  segments[0].data = &threshold;
+  segments[0].length = 1;
+  segments[1].data = ctrl;
+  segments[1].length = 4;
+  if(LSM6DS3_IO_Write(segments, 2, LSM6DS3_XG_FIFO_CTRL1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_INT1_CTRL, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* INT1_FTH setting */
+  tmp1 &= ~(LSM6DS3_XG_INT1_FTH_MASK);
+  tmp1 |= LSM6DS3_XG_INT1_FTH_ENABLE;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_INT1_CTRL, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  return IMU_6AXES_OK;
+}
+
+/**
+ * @brief  Disable accelerometer FIFO and its watermark interrupt
+ * @retval IMU_6AXES_OK in case of success, an error code otherwise
+*/
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Disable_X_FIFO( void )
+{
+  uint8_t tmp1 = 0x00;
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_INT1_CTRL, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* INT1_FTH setting */
+  tmp1 &= ~(LSM6DS3_XG_INT1_FTH_MASK);
+  tmp1 |= LSM6DS3_XG_INT1_FTH_DISABLE;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_INT1_CTRL, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_FIFO_CTRL5, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* FIFO ODR selection */
+  tmp1 &= ~(LSM6DS3_XG_FIFO_ODR_MASK);
+  tmp1 |= LSM6DS3_XG_FIFO_ODR_NA;
+  
+  /* FIFO mode selection */
+  tmp1 &= ~(LSM6DS3_XG_FIFO_MODE_MASK);
+  tmp1 |= LSM6DS3_XG_FIFO_MODE_BYPASS;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_FIFO_CTRL5, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  return IMU_6AXES_OK;
+}
+
+/**
+ * @brief  Get number of complete accelerometer samples stored in FIFO
+ * @param  num_samples the pointer where the number of X/Y/Z samples is stored
+ * @param  flags the pointer where FIFO_STATUS2 flags are stored, may be NULL
+ * @retval IMU_6AXES_OK in case of success, an error code otherwise
+*/
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Get_X_FIFO_Samples( uint16_t *num_samples, uint8_t *flags )
+{
+  uint8_t tempReg[2] = {0, 0};
+  uint16_t words = 0;
+  
+  /* FIFO_STATUS1 and FIFO_STATUS2 in one transaction */
+  if(LSM6DS3_IO_Read(&tempReg[0], LSM6DS3_XG_FIFO_STATUS1, 2) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  words = (((uint16_t)(tempReg[1] & LSM6DS3_XG_FIFO_STATUS2_DIFF_H_MASK)) << 8) | tempReg[0];
+  
+  *num_samples = words / 3;
+  
+  if(flags)
+  {
+    *flags = tempReg[1] & ~(LSM6DS3_XG_FIFO_STATUS2_DIFF_H_MASK);
+  }
+  
+  return IMU_6AXES_OK;
+}
+
+/**
+ * @brief  Read accelerometer raw samples from FIFO
+ * @param  pData the pointer where the X/Y/Z raw triplets are stored
+ * @param  num_samples number of samples to read
+ * @retval IMU_6AXES_OK in case of success, an error code otherwise
+ * @note   The register address rolls back onto FIFO_DATA_OUT_L, so the whole
+ *         batch is drained with a single multi-byte read
+*/
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Read_X_FIFO( int16_t *pData, uint16_t num_samples )
+{
+  uint8_t *tempReg = (uint8_t *)pData;
+  uint16_t words = num_samples * 3;
+  
+  if(num_samples == 0)
+  {
+    return IMU_6AXES_OK;
+  }
+  
+  if(LSM6DS3_IO_Read(tempReg, LSM6DS3_XG_FIFO_DATA_OUT_L, words * 2) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* Data is little endian on the wire; convert in place */
+  for(uint16_t i = 0; i < words; i++)
+  {
+    pData[i] = (int16_t)((((uint16_t)tempReg[2 * i + 1]) << 8) | tempReg[2 * i]);
+  }
+  
+  return IMU_6AXES_OK;
+}
+
+/**
+ * @brief  Enable wake-up detection
+ * @retval IMU_6AXES_OK in case of success, an error code otherwise
+*/
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Enable_Wake_Up_Detection( void )
+{
+  uint8_t tmp1 = 0x00;
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_WAKE_UP_THS, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* WK_THS setting */
+  tmp1 &= ~(LSM6DS3_XG_WAKE_UP_THS_WK_THS_MASK);
+  tmp1 |= LSM6DS3_XG_WAKE_UP_THS_WK_THS_TYPICAL;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_WAKE_UP_THS, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_MD1_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* INT1_WU setting */
+  tmp1 &= ~(LSM6DS3_XG_MD1_CFG_INT1_WU_MASK);
+  tmp1 |= LSM6DS3_XG_MD1_CFG_INT1_WU_ENABLE;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_MD1_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  return IMU_6AXES_OK;
+}
+
+/**
+ * @brief  Enable single tap detection on X, Y and Z
+ * @retval IMU_6AXES_OK in case of success, an error code otherwise
+*/
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Enable_Single_Tap_Detection( void )
+{
+  uint8_t tmp1 = 0x00;
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_TAP_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* TAP_X_EN, TAP_Y_EN and TAP_Z_EN setting */
+  tmp1 &= ~(LSM6DS3_XG_TAP_CFG_TAP_XYZ_EN_MASK);
+  tmp1 |= LSM6DS3_XG_TAP_CFG_TAP_XYZ_EN_ENABLE;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_TAP_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_TAP_THS_6D, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* TAP_THS setting */
+  tmp1 &= ~(LSM6DS3_XG_TAP_THS_6D_TAP_THS_MASK);
+  tmp1 |= LSM6DS3_XG_TAP_THS_6D_TAP_THS_TYPICAL;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_TAP_THS_6D, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* QUIET and SHOCK windows */
+  tmp1 = LSM6DS3_XG_INT_DUR2_TAP_TYPICAL;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_INT_DUR2, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_MD1_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* INT1_SINGLE_TAP setting */
+  tmp1 &= ~(LSM6DS3_XG_MD1_CFG_INT1_SINGLE_TAP_MASK);
+  tmp1 |= LSM6DS3_XG_MD1_CFG_INT1_SINGLE_TAP_ENABLE;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_MD1_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  return IMU_6AXES_OK;
+}
+
+/**
+ * @brief  Enable the embedded tilt function
+ * @retval IMU_6AXES_OK in case of success, an error code otherwise
+*/
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Enable_Tilt_Detection( void )
+{
+  uint8_t tmp1 = 0x00;
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_CTRL10_C, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* FUNC_EN setting */
+  tmp1 &= ~(LSM6DS3_XG_CTRL10_C_FUNC_EN_MASK);
+  tmp1 |= LSM6DS3_XG_CTRL10_C_FUNC_EN_ENABLE;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_CTRL10_C, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_TAP_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* TILT_EN setting */
+  tmp1 &= ~(LSM6DS3_XG_TAP_CFG_TILT_EN_MASK);
+  tmp1 |= LSM6DS3_XG_TAP_CFG_TILT_EN_ENABLE;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_TAP_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_MD1_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* INT1_TILT setting */
+  tmp1 &= ~(LSM6DS3_XG_MD1_CFG_INT1_TILT_MASK);
+  tmp1 |= LSM6DS3_XG_MD1_CFG_INT1_TILT_ENABLE;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_MD1_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  return IMU_6AXES_OK;
+}
+
+/**
+ * @brief  Latch event interrupts until the source registers are read
+ * @retval IMU_6AXES_OK in case of success, an error code otherwise
+*/
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Enable_Event_Latch( void )
+{
+  uint8_t tmp1 = 0x00;
+  
+  if(LSM6DS3_IO_Read(&tmp1, LSM6DS3_XG_TAP_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  /* LIR setting */
+  tmp1 &= ~(LSM6DS3_XG_TAP_CFG_LIR_MASK);
+  tmp1 |= LSM6DS3_XG_TAP_CFG_LIR_ENABLE;
+  
+  if(LSM6DS3_IO_Write(&tmp1, LSM6DS3_XG_TAP_CFG, 1) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  return IMU_6AXES_OK;
+}
+
+/**
+ * @brief  Read the event source registers
+ * @param  sources the pointer where WAKE_UP_SRC, TAP_SRC, D6D_SRC and FUNC_SRC are stored
+ * @param  with_func 1 to read FUNC_SRC too, 0 to skip it
+ * @retval IMU_6AXES_OK in case of success, an error code otherwise
+ * @note   WAKE_UP_SRC, TAP_SRC and D6D_SRC are contiguous and read in a
+ *         single transaction; FUNC_SRC is elsewhere in the map and costs a second one
+*/
+template <class Transport>
+IMU_6AXES_StatusTypeDef    LSM6DS3Driver<Transport>::LSM6DS3_Get_Event_Sources( uint8_t *sources, uint8_t with_func )
+{
+  if(LSM6DS3_IO_Read(sources, LSM6DS3_XG_WAKE_UP_SRC, 3) != IMU_6AXES_OK)
+  {
+    return IMU_6AXES_ERROR;
+  }
+  
+  sources[3] = 0x00;
+  
+  if(with_func)
+  {
+    if(LSM6DS3_IO_Read(&sources[3], LSM6DS3_XG_FUNC_SRC, 1) != IMU_6AXES_OK)
+    {
+      return IMU_6AXES_ERROR;
+    }
+  }
+  
+  return IMU_6AXES_OK;
+}
+
+/* Explicit instantiations ---------------------------------------------------*/
+template class LSM6DS3Driver<SensorTransport>;
+template class LSM6DS3Driver<RegisterFileTransport>;
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -41,26 +41,30 @@
 /* Includes ------------------------------------------------------------------*/
 #include "mbed.h"
 #include "DevI2C.h"
+#include "../Common/transport.h"
 #include "lsm6ds3.h"
 #include "../Interfaces/GyroSensor.h"
 #include "../Interfaces/MotionSensor.h"
 
 /* Classes -------------------------------------------------------------------*/
-/** Class representing a LSM6DS3 sensor component
+/** Class representing a LSM6DS3 sensor component, reading and writing its
+ *  registers through a Transport (see transport.h)
  */
-class LSM6DS3 : public GyroSensor, public MotionSensor {
+template <class Transport>
+class LSM6DS3Driver : public GyroSensor, public MotionSensor {
  public:
 	/** Constructor
-	 * @param[in] i2c device I2C to be used for communication
+	 * @param[in] transport the bus, a DevI2C for the default Transport, or
+	 *            on SPI (mode 3, up to 10MHz) SPITransport(&spi, cs_pin)
 	 * @param[in] irq_pin pin name for free fall detection interrupt
 	 */
-        LSM6DS3(DevI2C &i2c, PinName irq_pin) : GyroSensor(), MotionSensor(), 
-		dev_i2c(i2c), free_fall(irq_pin) {
+        LSM6DS3Driver(const Transport &transport, PinName irq_pin) : GyroSensor(), MotionSensor(), 
+		transport(transport), free_fall(irq_pin) {
 	}
 	
 	/** Destructor
 	 */
-        virtual ~LSM6DS3() {}
+        virtual ~LSM6DS3Driver() {}
 	
 	/*** Interface Methods ***/
 	virtual int Init(void *init_struct) {
@@ -174,6 +178,118 @@ class LSM6DS3 : public GyroSensor, public MotionSensor {
 		free_fall.disable_irq();
 	}
 
+	/**
+	 * @brief      Enable the accelerometer FIFO in continuous mode, with the
+	 *             FIFO threshold routed to INT1
+	 * @param[in]  watermark number of complete X/Y/Z samples after which INT1 is raised
+	 * @param[in]  odr FIFO output data rate in [Hz]
+	 * @return     IMU_6AXES_OK in case of success, an error code otherwise
+	 * @note       INT1 is the same pin used for free fall detection
+	 */
+	IMU_6AXES_StatusTypeDef Enable_X_FIFO(uint16_t watermark, float odr) {
+		return LSM6DS3_Enable_X_FIFO(watermark, odr);
+	}
+
+	/**
+	 * @brief  Put the FIFO back into bypass mode and release INT1
+	 * @return IMU_6AXES_OK in case of success, an error code otherwise
+	 */
+	IMU_6AXES_StatusTypeDef Disable_X_FIFO(void) {
+		return LSM6DS3_Disable_X_FIFO();
+	}
+
+	/**
+	 * @brief       Get the number of complete samples waiting in the FIFO
+	 * @param[out]  num_samples the pointer where the number of X/Y/Z samples is stored
+	 * @param[out]  flags the pointer where FIFO_STATUS2 flags are stored (may be NULL)
+	 * @return      IMU_6AXES_OK in case of success, an error code otherwise
+	 */
+	IMU_6AXES_StatusTypeDef Get_X_FIFO_Samples(uint16_t *num_samples, uint8_t *flags) {
+		return LSM6DS3_Get_X_FIFO_Samples(num_samples, flags);
+	}
+
+	/**
+	 * @brief       Drain accelerometer samples from the FIFO in one burst
+	 * @param[out]  pData the pointer where raw X/Y/Z triplets are stored;
+	 *              must hold (at least) 3 * num_samples elements
+	 * @param[in]   num_samples number of X/Y/Z samples to read
+	 * @return      IMU_6AXES_OK in case of success, an error code otherwise
+	 */
+	IMU_6AXES_StatusTypeDef Read_X_FIFO(int16_t *pData, uint16_t num_samples) {
+		return LSM6DS3_Read_X_FIFO(pData, num_samples);
+	}
+
+	/** Attach a function to call when the FIFO threshold is reached
+	 *
+	 *  @param[in] fptr A pointer to a void function, or 0 to set as none
+	 */
+	void Attach_FIFO_Threshold_IRQ(void (*fptr)(void)) {
+		free_fall.rise(fptr);
+	}
+
+	/**
+	 * @brief  Enable wake-up (activity) detection, routed to INT1
+	 * @return IMU_6AXES_OK in case of success, an error code otherwise
+	 */
+	IMU_6AXES_StatusTypeDef Enable_Wake_Up_Detection(void) {
+		return LSM6DS3_Enable_Wake_Up_Detection();
+	}
+
+	/**
+	 * @brief  Enable single tap detection on all axes, routed to INT1
+	 * @return IMU_6AXES_OK in case of success, an error code otherwise
+	 */
+	IMU_6AXES_StatusTypeDef Enable_Single_Tap_Detection(void) {
+		return LSM6DS3_Enable_Single_Tap_Detection();
+	}
+
+	/**
+	 * @brief  Enable the embedded tilt function, routed to INT1
+	 * @return IMU_6AXES_OK in case of success, an error code otherwise
+	 * @note   Tilt needs the accelerometer running at 26Hz or faster
+	 */
+	IMU_6AXES_StatusTypeDef Enable_Tilt_Detection(void) {
+		return LSM6DS3_Enable_Tilt_Detection();
+	}
+
+	/**
+	 * @brief  Latch event interrupts until their source register is read, so
+	 *         a short event is still visible when the handler gets to it
+	 * @return IMU_6AXES_OK in case of success, an error code otherwise
+	 */
+	IMU_6AXES_StatusTypeDef Enable_Event_Latch(void) {
+		return LSM6DS3_Enable_Event_Latch();
+	}
+
+	/**
+	 * @brief       Read every event source register after an INT1 edge
+	 * @param[out]  sources WAKE_UP_SRC, TAP_SRC and D6D_SRC, then FUNC_SRC;
+	 *              must hold 4 bytes
+	 * @param[in]   with_func also read FUNC_SRC (tilt), otherwise sources[3] is 0
+	 * @return      IMU_6AXES_OK in case of success, an error code otherwise
+	 * @note        Reading the sources clears latched interrupts
+	 */
+	IMU_6AXES_StatusTypeDef Get_Event_Sources(uint8_t *sources, uint8_t with_func) {
+		return LSM6DS3_Get_Event_Sources(sources, with_func);
+	}
+
+	/** Attach a function to call on every INT1 rising edge, whatever the source
+	 *
+	 *  @param[in] fptr A pointer to a void function, or 0 to set as none
+	 */
+	void Attach_INT1_IRQ(void (*fptr)(void)) {
+		free_fall.rise(fptr);
+	}
+
+	/** Level of the INT1 line: high while the FIFO is at its threshold or
+	 *  a latched event waits to be read
+	 *
+	 *  @return 1 if high, 0 if low
+	 */
+	int Read_INT1(void) {
+		return free_fall.read();
+	}
+
  protected:
 	/*** Methods ***/
 	IMU_6AXES_StatusTypeDef LSM6DS3_Init(IMU_6AXES_InitTypeDef *LSM6DS3_Init);
@@ -195,6 +311,15 @@ class LSM6DS3 : public GyroSensor, public MotionSensor {
 	IMU_6AXES_StatusTypeDef LSM6DS3_Enable_Free_Fall_Detection( void );
 	IMU_6AXES_StatusTypeDef LSM6DS3_Disable_Free_Fall_Detection( void );
 	IMU_6AXES_StatusTypeDef LSM6DS3_Get_Status_Free_Fall_Detection( uint8_t *status );
+	IMU_6AXES_StatusTypeDef LSM6DS3_Enable_X_FIFO( uint16_t watermark, float odr );
+	IMU_6AXES_StatusTypeDef LSM6DS3_Disable_X_FIFO( void );
+	IMU_6AXES_StatusTypeDef LSM6DS3_Get_X_FIFO_Samples( uint16_t *num_samples, uint8_t *flags );
+	IMU_6AXES_StatusTypeDef LSM6DS3_Read_X_FIFO( int16_t *pData, uint16_t num_samples );
+	IMU_6AXES_StatusTypeDef LSM6DS3_Enable_Wake_Up_Detection( void );
+	IMU_6AXES_StatusTypeDef LSM6DS3_Enable_Single_Tap_Detection( void );
+	IMU_6AXES_StatusTypeDef LSM6DS3_Enable_Tilt_Detection( void );
+	IMU_6AXES_StatusTypeDef LSM6DS3_Enable_Event_Latch( void );
+	IMU_6AXES_StatusTypeDef LSM6DS3_Get_Event_Sources( uint8_t *sources, uint8_t with_func );
 
 	IMU_6AXES_StatusTypeDef LSM6DS3_Common_Sensor_Enable(void);
 	IMU_6AXES_StatusTypeDef LSM6DS3_X_Set_Axes_Status(uint8_t enableX, uint8_t enableY, uint8_t enableZ);
@@ -228,10 +353,10 @@ class LSM6DS3 : public GyroSensor, public MotionSensor {
 	IMU_6AXES_StatusTypeDef LSM6DS3_IO_Read(uint8_t* pBuffer, 
 					      uint8_t RegisterAddr, uint16_t NumByteToRead)
 	{
-		int ret = dev_i2c.i2c_read(pBuffer,
-					   LSM6DS3_XG_MEMS_ADDRESS,
-					   RegisterAddr,
-					   NumByteToRead);
+		if(ctrl_batch.read(pBuffer, RegisterAddr, NumByteToRead)) {
+			return IMU_6AXES_OK;
+		}
+		int ret = transport.read(pBuffer, LSM6DS3_XG_MEMS_ADDRESS, RegisterAddr, NumByteToRead);
 		if(ret != 0) {
 			return IMU_6AXES_ERROR;
 		}
@@ -249,10 +374,30 @@ class LSM6DS3 : public GyroSensor, public MotionSensor {
 	IMU_6AXES_StatusTypeDef LSM6DS3_IO_Write(uint8_t* pBuffer, 
 					       uint8_t RegisterAddr, uint16_t NumByteToWrite)
 	{
-		int ret = dev_i2c.i2c_write(pBuffer,
-					    LSM6DS3_XG_MEMS_ADDRESS,
-					    RegisterAddr,
-					    NumByteToWrite);
+		if(ctrl_batch.write(pBuffer, RegisterAddr, NumByteToWrite)) {
+			return IMU_6AXES_OK;
+		}
+		int ret = transport.write(pBuffer, LSM6DS3_XG_MEMS_ADDRESS, RegisterAddr, NumByteToWrite);
+		if(ret != 0) {
+			return IMU_6AXES_ERROR;
+		}
+		return IMU_6AXES_OK;
+	}
+	
+	/**
+	 * @brief      Utility function to write consecutive registers of LSM6DS3
+	 *             in one transfer, from data in several places
+	 * @param[in]  segments the register values, in order
+	 * @param[in]  count number of segments
+	 * @param[in]  RegisterAddr specifies internal address register to start
+	 *             writing to, IF_INC must be set
+	 * @retval     IMU_6AXES_OK if ok, 
+	 * @retval     IMU_6AXES_ERROR if an I2C error has occured
+	 */
+	IMU_6AXES_StatusTypeDef LSM6DS3_IO_Write(const I2CSegment* segments, uint8_t count,
+					       uint8_t RegisterAddr)
+	{
+		int ret = transport.write(segments, count, LSM6DS3_XG_MEMS_ADDRESS, RegisterAddr);
 		if(ret != 0) {
 			return IMU_6AXES_ERROR;
 		}
@@ -261,10 +406,16 @@ class LSM6DS3 : public GyroSensor, public MotionSensor {
 	
 	/*** Instance Variables ***/
 	/* IO Device */
-	DevI2C &dev_i2c;
+	Transport transport;
+
+	/* CTRL1_XL to CTRL10_C while LSM6DS3_Init() sets them up */
+	RegisterBatch<LSM6DS3_XG_CTRL10_C - LSM6DS3_XG_CTRL1_XL + 1> ctrl_batch;
 
 	/* Free Fall Detection IRQ */
 	InterruptIn free_fall;
 };
 
+/** The LSM6DS3 as the expansion board has it */
+typedef LSM6DS3Driver<SensorTransport> LSM6DS3;
+
 #endif // __LSM6DS3_CLASS_H
@@ -42,6 +42,9 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "mbed.h"
+#include "I2CTrace.h"
+#include "I2CArbiter.h"
+#include "I2CStats.h"
 
 /* Classes -------------------------------------------------------------------*/
 /** Helper class DevI2C providing functions for multi-register I2C communication
@@ -55,7 +58,59 @@ class DevI2C : public I2C
 	 *  @param sda I2C data line pin
 	 *  @param scl I2C clock line pin
 	 */
-        DevI2C(PinName sda, PinName scl) : I2C(sda, scl) {}
+        DevI2C(PinName sda, PinName scl) : I2C(sda, scl), error_handler(NULL),
+		trace_writer(NULL), trace_reader(NULL), arbiter(NULL), stats(NULL) {}
+
+	/** Attach a function to call whenever a transfer fails
+	 *
+	 *  @param fptr A pointer to a function taking the device address and
+	 *         the error code (-1, -2 or I2C_ARBITER_BUSY), or NULL to set
+	 *         as none
+	 *  @note  Called from whatever context issued the transfer, which may
+	 *         be an ISR; keep it to counting
+	 */
+	void attach_error_handler(void (*fptr)(uint8_t DeviceAddr, int error))
+	{
+		error_handler = fptr;
+	}
+
+	/** Record every transfer, with its timing, into a trace
+	 *
+	 *  @param writer the trace to append to, or NULL to stop capturing
+	 */
+	void attach_trace_writer(I2CTraceWriter *writer)
+	{
+		trace_writer = writer;
+	}
+
+	/** Ask an arbiter for the bus around every transfer
+	 *
+	 *  @param bus_arbiter the arbiter, or NULL for none
+	 *  @note  Attach before more than one context uses the bus
+	 */
+	void attach_arbiter(I2CArbiter *bus_arbiter)
+	{
+		arbiter = bus_arbiter;
+	}
+
+	/** Account for every transfer per device address
+	 *
+	 *  @param device_stats the accounting to add to, or NULL to stop
+	 *  @note  Replayed transfers never reach the bus and aren't counted
+	 */
+	void attach_stats(I2CStats *device_stats)
+	{
+		stats = device_stats;
+	}
+
+	/** Serve every transfer from a recorded trace instead of the bus
+	 *
+	 *  @param reader the trace to replay, or NULL to go back to the bus
+	 */
+	void attach_trace_reader(I2CTraceReader *reader)
+	{
+		trace_reader = reader;
+	}
 
 	/**
 	 * @brief  Writes a buffer towards the I2C peripheral device.
@@ -66,25 +121,63 @@ class DevI2C : public I2C
 	 * @param  NumByteToWrite number of bytes to be written.
 	 * @retval 0 if ok, 
 	 * @retval -1 if an I2C error has occured, or
-	 * @retval -2 on temporary buffer overflow (i.e. NumByteToWrite was too high)
+	 * @retval I2C_ARBITER_BUSY if the arbiter refused the bus
 	 * @note   On some devices if NumByteToWrite is greater
 	 *         than one, the RegisterAddr must be masked correctly!
 	 */
 	int i2c_write(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, 
 		      uint16_t NumByteToWrite)
+	{
+		I2CSegment segment = { pBuffer, NumByteToWrite };
+		return i2c_write(&segment, 1, DeviceAddr, RegisterAddr);
+	}
+
+	/**
+	 * @brief  Writes data gathered from several buffers towards the I2C
+	 *         peripheral device, in one transfer.
+	 * @param  segments the pieces of data, sent in order straight from
+	 *         where they are: nothing is copied and there is no size limit
+	 * @param  count number of segments
+	 * @param  DeviceAddr specifies the peripheral device slave address.
+	 * @param  RegisterAddr specifies the internal address register 
+	 *         where to start writing to (must be correctly masked).
+	 * @retval 0 if ok, 
+	 * @retval -1 if an I2C error has occured, or
+	 * @retval -2 if the segments add up to more than 65535 bytes
+	 * @retval I2C_ARBITER_BUSY if the arbiter refused the bus
+	 * @note   Writing several registers in one go relies on the device
+	 *         incrementing the register address, see the note above
+	 */
+	int i2c_write(const I2CSegment *segments, uint8_t count, uint8_t DeviceAddr,
+		      uint8_t RegisterAddr)
 	{
 		int ret;
-		uint8_t tmp[TEMP_BUF_SIZE];
-	
-		if(NumByteToWrite >= TEMP_BUF_SIZE) return -2;
-		
-		/* First, send device address. Then, send data and STOP condition */
-		tmp[0] = RegisterAddr;
-		memcpy(tmp+1, pBuffer, NumByteToWrite);
+		uint32_t total = 0;
+		uint32_t start, end;
+
+		for(uint8_t i = 0; i < count; i++) total += segments[i].length;
+		if(total > 0xFFFF) return report_error(DeviceAddr, -2);
+		if(arbiter && !arbiter->acquire(DeviceAddr)) return report_error(DeviceAddr, I2C_ARBITER_BUSY);
 
-		ret = write(DeviceAddr, (const char*)tmp, NumByteToWrite+1, false);
+		if(trace_reader) {
+			ret = trace_reader->replay_write(DeviceAddr, RegisterAddr, (uint16_t)total);
+			if(arbiter) arbiter->release(DeviceAddr);
+			return ret ? report_error(DeviceAddr, ret) : 0;
+		}
+
+		/* Device address and register, then every segment byte by byte
+		   and the STOP condition */
+		start = us_ticker_read();
+		ret = write_gathered(segments, count, DeviceAddr, RegisterAddr);
+		end = us_ticker_read();
+		if(trace_writer) {
+			trace_writer->record(ret ? I2C_TRACE_FLAG_ERROR : 0, DeviceAddr, RegisterAddr,
+					     segments, count, start, end);
+		}
+		if(stats) stats->record(DeviceAddr, (uint16_t)total, ret != 0, end - start);
+		if(arbiter) arbiter->release(DeviceAddr);
 
-		if(ret) return -1;
+		if(ret) return report_error(DeviceAddr, -1);
 		return 0;
 	}
 
@@ -97,6 +190,7 @@ class DevI2C : public I2C
 	 * @param  NumByteToRead number of bytes to be read.
 	 * @retval 0 if ok, 
 	 * @retval -1 if an I2C error has occured
+	 * @retval I2C_ARBITER_BUSY if the arbiter refused the bus
 	 * @note   On some devices if NumByteToWrite is greater
 	 *         than one, the RegisterAddr must be masked correctly!
 	 */
@@ -104,20 +198,67 @@ class DevI2C : public I2C
 		     uint16_t NumByteToRead)
 	{
 		int ret;
+		uint32_t start, end;
+
+		if(arbiter && !arbiter->acquire(DeviceAddr)) return report_error(DeviceAddr, I2C_ARBITER_BUSY);
+
+		if(trace_reader) {
+			ret = trace_reader->replay_read(pBuffer, DeviceAddr, RegisterAddr, NumByteToRead);
+			if(arbiter) arbiter->release(DeviceAddr);
+			return ret ? report_error(DeviceAddr, ret) : 0;
+		}
     
 		/* Send device address, with no STOP condition */
+		start = us_ticker_read();
 		ret = write(DeviceAddr, (const char*)&RegisterAddr, 1, true);
 		if(!ret) {
 			/* Read data, with STOP condition  */
 			ret = read(DeviceAddr, (char*)pBuffer, NumByteToRead, false);
 		}
+		end = us_ticker_read();
+		if(trace_writer) {
+			trace_writer->record(I2C_TRACE_FLAG_READ | (ret ? I2C_TRACE_FLAG_ERROR : 0), DeviceAddr,
+					     RegisterAddr, pBuffer, NumByteToRead, start, end);
+		}
+		if(stats) stats->record(DeviceAddr, NumByteToRead, ret != 0, end - start);
+		if(arbiter) arbiter->release(DeviceAddr);
     
-		if(ret) return -1;
+		if(ret) return report_error(DeviceAddr, -1);
 		return 0;
 	}
 
  private:
-	static const unsigned int TEMP_BUF_SIZE = 32;
+	int report_error(uint8_t DeviceAddr, int error)
+	{
+		if(error_handler) error_handler(DeviceAddr, error);
+		return error;
+	}
+
+	/* Byte level transfer, the STOP condition is sent even after a NACK */
+	int write_gathered(const I2CSegment *segments, uint8_t count, uint8_t DeviceAddr,
+			   uint8_t RegisterAddr)
+	{
+		int ret = 0;
+
+		start();
+		if(write(DeviceAddr) != 1 || write(RegisterAddr) != 1) ret = -1;
+		for(uint8_t i = 0; !ret && i < count; i++) {
+			for(uint16_t j = 0; j < segments[i].length; j++) {
+				if(write(segments[i].data[j]) != 1) {
+					ret = -1;
+					break;
+				}
+			}
+		}
+		stop();
+		return ret;
+	}
+
+	void (*error_handler)(uint8_t DeviceAddr, int error);
+	I2CTraceWriter *trace_writer;
+	I2CTraceReader *trace_reader;
+	I2CArbiter *arbiter;
+	I2CStats *stats;
 };
 
 #endif /* __DEV_I2C_H */
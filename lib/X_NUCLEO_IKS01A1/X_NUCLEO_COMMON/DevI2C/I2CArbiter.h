@@ -0,0 +1,48 @@
+/**
+ ******************************************************************************
+ * @file    I2CArbiter.h
+ * @brief   Hook for serialising DevI2C transfers between threads and ISRs
+ ******************************************************************************
+ *
+ * DevI2C itself has no notion of who else is on the bus. An arbiter
+ * attached to it is asked for the bus before every transfer and told when
+ * the transfer is over, so transfers from different contexts never
+ * interleave and the arbiter decides who goes next. Nothing here depends on
+ * the RTOS; the arbiter implementation brings its own.
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent from recursive inclusion --------------------------------*/
+#ifndef __I2C_ARBITER_H
+#define __I2C_ARBITER_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Definitions ---------------------------------------------------------------*/
+#define I2C_ARBITER_BUSY		-3	/*!< transfer result when the bus can't be had */
+
+/* Classes -------------------------------------------------------------------*/
+/** Grants the bus one transfer at a time */
+class I2CArbiter
+{
+ public:
+	virtual ~I2CArbiter() {}
+
+	/** Take the bus for a transfer to DeviceAddr, waiting if needed
+	 *  @param  DeviceAddr 8 bit device address, as passed to i2c_read/i2c_write
+	 *  @retval true once the bus is ours,
+	 *  @retval false if it can't be had without blocking where blocking
+	 *          isn't allowed (an ISR); the transfer then fails with
+	 *          I2C_ARBITER_BUSY
+	 */
+	virtual bool acquire(uint8_t DeviceAddr) = 0;
+
+	/** Give the bus back after a transfer acquire() allowed
+	 *  @param  DeviceAddr the same address
+	 */
+	virtual void release(uint8_t DeviceAddr) = 0;
+};
+
+#endif /* __I2C_ARBITER_H */
@@ -0,0 +1,104 @@
+/**
+ ******************************************************************************
+ * @file    I2CStats.h
+ * @brief   Per device accounting of DevI2C transfers
+ ******************************************************************************
+ *
+ * Counts transactions, data bytes, failed transfers and time on the bus for
+ * every 7 bit device address that DevI2C talks to, so the share of the bus
+ * each sensor takes can be measured rather than guessed. Time on the bus runs
+ * from the first START to the STOP of a transfer, so it includes addressing,
+ * clock stretching and the time the MCU takes between bytes. Nothing here
+ * depends on mbed.
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent from recursive inclusion --------------------------------*/
+#ifndef __I2C_STATS_H
+#define __I2C_STATS_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <string.h>
+
+/* Definitions ---------------------------------------------------------------*/
+#ifndef I2C_STATS_MAX_DEVICES
+#define I2C_STATS_MAX_DEVICES		8	/*!< addresses tracked, others share the last entry */
+#endif
+
+/** What one device used of the bus */
+typedef struct
+{
+	uint8_t address;		/*!< 7 bit */
+	uint32_t transactions;
+	uint32_t bytes;			/*!< data bytes, register address not included */
+	uint32_t errors;		/*!< transfers the bus failed */
+	uint32_t bus_us;
+} I2CDeviceStats;
+
+/* Classes -------------------------------------------------------------------*/
+/** Accumulates I2CDeviceStats per device address. record() runs inside the
+ *  transfer, so it relies on the same serialisation the bus itself needs;
+ *  read and reset the counts under that serialisation too.
+ */
+class I2CStats
+{
+ public:
+	I2CStats()
+	{
+		reset();
+	}
+
+	/** Forget every device */
+	void reset(void)
+	{
+		memset(devices, 0, sizeof(devices));
+		count = 0;
+	}
+
+	/** Account for one transfer
+	 *  @param DeviceAddr 8 bit device address, as passed to i2c_read/i2c_write
+	 *  @param bytes data bytes requested
+	 *  @param error the transfer failed on the bus
+	 *  @param bus_us time from START to STOP
+	 */
+	void record(uint8_t DeviceAddr, uint16_t bytes, bool error, uint32_t bus_us)
+	{
+		I2CDeviceStats *d = find(DeviceAddr >> 1);
+		d->transactions++;
+		d->bytes += bytes;
+		d->bus_us += bus_us;
+		if(error) d->errors++;
+	}
+
+	/** Copy the counts out and zero them, keeping the device table
+	 *  @param out room for I2C_STATS_MAX_DEVICES entries
+	 *  @retval the number of devices copied
+	 */
+	uint8_t take(I2CDeviceStats *out)
+	{
+		for(uint8_t i = 0; i < count; i++) {
+			out[i] = devices[i];
+			memset(&devices[i], 0, sizeof(devices[i]));
+			devices[i].address = out[i].address;
+		}
+		return count;
+	}
+
+ private:
+	I2CDeviceStats *find(uint8_t address)
+	{
+		for(uint8_t i = 0; i < count; i++) {
+			if(devices[i].address == address) return &devices[i];
+		}
+		if(count == I2C_STATS_MAX_DEVICES) return &devices[count - 1];
+		devices[count].address = address;
+		return &devices[count++];
+	}
+
+	I2CDeviceStats devices[I2C_STATS_MAX_DEVICES];
+	uint8_t count;
+};
+
+#endif /* __I2C_STATS_H */
@@ -0,0 +1,295 @@
+/**
+ ******************************************************************************
+ * @file    I2CTrace.h
+ * @brief   Compact binary trace of DevI2C transfers, for capturing real bus
+ *          traffic on the target and replaying it into unmodified drivers
+ ******************************************************************************
+ *
+ * Trace layout (all multi-byte fixed fields little endian):
+ *
+ *   header:  'I' '2' 'C' 'T', version (1 byte), start time in us (4 bytes)
+ *   record:  flags (1 byte)    I2C_TRACE_FLAG_*
+ *            device address    8 bit, as passed to i2c_read/i2c_write
+ *            register address
+ *            length            varint, bytes requested
+ *            delta             varint, us since the previous record started
+ *            duration          varint, us the transfer took
+ *            data              length bytes, omitted when the transfer failed
+ *
+ * Varints are unsigned LEB128, so a typical 6 byte axis read at a steady
+ * rate costs 14 bytes. Nothing here depends on mbed, so the same code
+ * decodes traces in a host build.
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent from recursive inclusion --------------------------------*/
+#ifndef __I2C_TRACE_H
+#define __I2C_TRACE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <string.h>
+
+/* Definitions ---------------------------------------------------------------*/
+#define I2C_TRACE_VERSION		1
+#define I2C_TRACE_HEADER_SIZE		9
+
+#define I2C_TRACE_FLAG_READ		0x01	/*!< i2c_read, otherwise i2c_write */
+#define I2C_TRACE_FLAG_ERROR		0x02	/*!< transfer returned non-zero, no data follows */
+
+/** A contiguous piece of a transfer's data; DevI2C writes gather several */
+typedef struct
+{
+	const uint8_t *data;
+	uint16_t length;
+} I2CSegment;
+
+/** One decoded trace record */
+typedef struct
+{
+	uint8_t flags;
+	uint8_t address;
+	uint8_t reg;
+	uint16_t length;
+	uint32_t time_us;		/*!< start, relative to the trace start */
+	uint32_t duration_us;
+	const uint8_t *data;		/*!< points into the trace buffer, NULL on error */
+} I2CTraceRecord;
+
+/* Classes -------------------------------------------------------------------*/
+/** Appends transfer records to a caller provided buffer. Recording stops,
+ *  and full() turns true, at the first record that doesn't fit whole.
+ *  record() runs inside the transfer, so it relies on the same serialisation
+ *  the bus itself needs.
+ */
+class I2CTraceWriter
+{
+ public:
+	/** @param buffer trace storage
+	 *  @param size size of buffer in bytes
+	 */
+	I2CTraceWriter(uint8_t *buffer, uint32_t size) : buf(buffer), capacity(size)
+	{
+		reset(0);
+	}
+
+	/** Discard what was recorded and start a new trace
+	 *  @param now_us current time, the trace start
+	 */
+	void reset(uint32_t now_us)
+	{
+		pos = 0;
+		overflow = false;
+		last_us = now_us;
+		if(capacity < I2C_TRACE_HEADER_SIZE) {
+			overflow = true;
+			return;
+		}
+		buf[pos++] = 'I';
+		buf[pos++] = '2';
+		buf[pos++] = 'C';
+		buf[pos++] = 'T';
+		buf[pos++] = I2C_TRACE_VERSION;
+		for(int i = 0; i < 4; i++) buf[pos++] = (uint8_t)(now_us >> (8 * i));
+	}
+
+	/** Append one transfer
+	 *  @param flags I2C_TRACE_FLAG_* bits
+	 *  @param start_time_us when the transfer started
+	 *  @param end_time_us when the transfer returned
+	 */
+	void record(uint8_t flags, uint8_t DeviceAddr, uint8_t RegisterAddr,
+		    const uint8_t *pBuffer, uint16_t NumBytes,
+		    uint32_t start_time_us, uint32_t end_time_us)
+	{
+		I2CSegment segment = { pBuffer, NumBytes };
+		record(flags, DeviceAddr, RegisterAddr, &segment, 1, start_time_us, end_time_us);
+	}
+
+	/** Append one transfer whose data is in pieces, as a single record
+	 *  @param segments the data, in order
+	 *  @param count number of segments
+	 */
+	void record(uint8_t flags, uint8_t DeviceAddr, uint8_t RegisterAddr,
+		    const I2CSegment *segments, uint8_t count,
+		    uint32_t start_time_us, uint32_t end_time_us)
+	{
+		uint8_t head[3 + 3 * 5];
+		uint32_t n = 0;
+		uint32_t NumBytes = 0;
+		uint32_t data_len;
+
+		if(overflow) return;
+
+		for(uint8_t i = 0; i < count; i++) NumBytes += segments[i].length;
+		data_len = (flags & I2C_TRACE_FLAG_ERROR) ? 0 : NumBytes;
+
+		head[n++] = flags;
+		head[n++] = DeviceAddr;
+		head[n++] = RegisterAddr;
+		n += put_varint(head + n, NumBytes);
+		n += put_varint(head + n, start_time_us - last_us);
+		n += put_varint(head + n, end_time_us - start_time_us);
+
+		if(pos + n + data_len > capacity) {
+			overflow = true;
+			return;
+		}
+		memcpy(buf + pos, head, n);
+		pos += n;
+		for(uint8_t i = 0; data_len && i < count; i++) {
+			memcpy(buf + pos, segments[i].data, segments[i].length);
+			pos += segments[i].length;
+		}
+		last_us = start_time_us;
+	}
+
+	const uint8_t *data(void) const { return buf; }
+	uint32_t size(void) const { return pos; }
+	bool full(void) const { return overflow; }
+
+ private:
+	static uint32_t put_varint(uint8_t *out, uint32_t value)
+	{
+		uint32_t n = 0;
+		while(value >= 0x80) {
+			out[n++] = (uint8_t)(value | 0x80);
+			value >>= 7;
+		}
+		out[n++] = (uint8_t)value;
+		return n;
+	}
+
+	uint8_t *buf;
+	uint32_t capacity;
+	uint32_t pos;
+	bool overflow;
+	uint32_t last_us;
+};
+
+/** Walks a trace and serves its transfers back in order. Used by DevI2C in
+ *  replay mode: each i2c_read/i2c_write consumes the next record, which must
+ *  match in direction, device, register and length.
+ */
+class I2CTraceReader
+{
+ public:
+	/** @param trace a complete trace, header included
+	 *  @param size trace size in bytes
+	 */
+	I2CTraceReader(const uint8_t *trace, uint32_t size) : buf(trace), capacity(size)
+	{
+		rewind();
+	}
+
+	/** Go back to the first record
+	 *  @retval true if the header is valid
+	 */
+	bool rewind(void)
+	{
+		pos = I2C_TRACE_HEADER_SIZE;
+		time_us = 0;
+		mismatches = 0;
+		valid = capacity >= I2C_TRACE_HEADER_SIZE && memcmp(buf, "I2CT", 4) == 0 &&
+			buf[4] == I2C_TRACE_VERSION;
+		return valid;
+	}
+
+	/** Decode the next record
+	 *  @retval 1 on success, 0 at the end of the trace, -1 if it is corrupt
+	 */
+	int next(I2CTraceRecord *rec)
+	{
+		uint32_t length, delta, duration;
+
+		if(!valid || pos >= capacity) return 0;
+		if(pos + 3 > capacity) return -1;
+		rec->flags = buf[pos++];
+		rec->address = buf[pos++];
+		rec->reg = buf[pos++];
+		if(!get_varint(&length) || !get_varint(&delta) || !get_varint(&duration)) return -1;
+		if(length > 0xFFFF) return -1;
+
+		time_us += delta;
+		rec->length = (uint16_t)length;
+		rec->time_us = time_us;
+		rec->duration_us = duration;
+		rec->data = NULL;
+		if(!(rec->flags & I2C_TRACE_FLAG_ERROR)) {
+			if(pos + length > capacity) return -1;
+			rec->data = buf + pos;
+			pos += length;
+		}
+		return 1;
+	}
+
+	/** Serve an i2c_read from the trace
+	 *  @retval 0 if ok, -1 if the recorded transfer failed, didn't match or
+	 *          the trace ran out
+	 */
+	int replay_read(uint8_t *pBuffer, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToRead)
+	{
+		I2CTraceRecord rec;
+		if(!take(&rec, I2C_TRACE_FLAG_READ, DeviceAddr, RegisterAddr, NumByteToRead)) return -1;
+		if(rec.flags & I2C_TRACE_FLAG_ERROR) return -1;
+		memcpy(pBuffer, rec.data, NumByteToRead);
+		return 0;
+	}
+
+	/** Consume an i2c_write; the written bytes aren't compared since a
+	 *  pipeline change may legitimately configure the sensor differently
+	 *  @retval 0 if ok, -1 if the recorded transfer failed, didn't match or
+	 *          the trace ran out
+	 */
+	int replay_write(uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumByteToWrite)
+	{
+		I2CTraceRecord rec;
+		if(!take(&rec, 0, DeviceAddr, RegisterAddr, NumByteToWrite)) return -1;
+		return (rec.flags & I2C_TRACE_FLAG_ERROR) ? -1 : 0;
+	}
+
+	/** Trace time of the last record served, for a simulated clock */
+	uint32_t now_us(void) const { return time_us; }
+
+	/** Transfers that didn't match the trace (or came after its end) */
+	uint32_t divergences(void) const { return mismatches; }
+
+	bool at_end(void) const { return !valid || pos >= capacity; }
+
+ private:
+	bool take(I2CTraceRecord *rec, uint8_t dir, uint8_t DeviceAddr, uint8_t RegisterAddr, uint16_t NumBytes)
+	{
+		if(next(rec) != 1 ||
+		   (rec->flags & I2C_TRACE_FLAG_READ) != dir ||
+		   rec->address != DeviceAddr || rec->reg != RegisterAddr || rec->length != NumBytes) {
+			mismatches++;
+			return false;
+		}
+		return true;
+	}
+
+	bool get_varint(uint32_t *value)
+	{
+		uint32_t result = 0;
+		for(int shift = 0; shift < 35; shift += 7) {
+			if(pos >= capacity) return false;
+			uint8_t byte = buf[pos++];
+			result |= (uint32_t)(byte & 0x7F) << shift;
+			if(!(byte & 0x80)) {
+				*value = result;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const uint8_t *buf;
+	uint32_t capacity;
+	uint32_t pos;
+	uint32_t time_us;
+	uint32_t mismatches;
+	bool valid;
+};
+
+#endif /* __I2C_TRACE_H */
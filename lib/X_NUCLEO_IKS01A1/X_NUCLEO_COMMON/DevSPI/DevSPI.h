@@ -42,6 +42,10 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "mbed.h"
+#include "I2CArbiter.h"
+#if DEVICE_SPI_ASYNCH
+#include "rtos.h"
+#endif
 
 /* Macros --------------------------------------------------------------------*/
 #if (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)) /* GCC */ || \
@@ -50,6 +54,11 @@
 #define __DEV_SPI_BIG_ENDIAN
 #endif
 
+/* Definitions ---------------------------------------------------------------*/
+#ifndef DEV_SPI_ASYNC_MIN
+#define DEV_SPI_ASYNC_MIN	16	/*!< blocks this long or longer go through the asynchronous API */
+#endif
+
 /* Classes -------------------------------------------------------------------*/
 /** Helper class DevSPI providing functions for synchronous SPI communication
  *  common for a series of SPI devices.
@@ -63,10 +72,13 @@ class DevSPI : public SPI
      * @param miso pin name of the MISO pin of the SPI device to be used for communication.
      * @param sclk pin name of the SCLK pin of the SPI device to be used for communication.
      */
-    DevSPI(PinName mosi, PinName miso, PinName sclk) : SPI(mosi, miso, sclk)
+    DevSPI(PinName mosi, PinName miso, PinName sclk) : SPI(mosi, miso, sclk), arbiter(NULL)
     {
         /* Set default configuration. */
         setup(8, 3, 1E6);
+#if DEVICE_SPI_ASYNCH
+        set_dma_usage(DMA_USAGE_OPPORTUNISTIC);
+#endif
     }
 
     /*
@@ -97,6 +109,18 @@ class DevSPI : public SPI
         frequency(frequency_hz);
     }
 
+    /**
+     * @brief  Serialise the register transfers (spi_read_reg, spi_write_reg)
+     *         through an arbiter, as DevI2C does; the device address they
+     *         are given identifies the device to it. The other transfers
+     *         are left to the caller.
+     * @param  a the arbiter, NULL to detach
+     */
+    void attach_arbiter(I2CArbiter *a)
+    {
+        arbiter = a;
+    }
+
     /**
      * @brief      Writes a buffer to the SPI peripheral device in 8-bit data mode 
      *             using synchronous SPI communication.
@@ -117,9 +141,7 @@ class DevSPI : public SPI
         ssel = 0;
         
         /* Write data. */
-	for (int i = 0; i < NumBytesToWrite; i++) {
-            write(pBuffer[i]);
-	}
+	block(pBuffer, NULL, NumBytesToWrite);
 
         /* Unselect the chip. */
         ssel = 1;
@@ -147,9 +169,7 @@ class DevSPI : public SPI
         ssel = 0;
         
         /* Read data. */
-	for (int i = 0; i < NumBytesToRead; i++) {
-	    pBuffer[i] = write(0);
-	}
+	block(NULL, pBuffer, NumBytesToRead);
 
         /* Unselect the chip. */
         ssel = 1;
@@ -178,9 +198,7 @@ class DevSPI : public SPI
         ssel = 0;
         
         /* Read and write data at the same time. */
-	for (int i = 0; i < NumBytes; i++) {
-            pBufferToRead[i] = write(pBufferToWrite[i]);
-	}
+	block(pBufferToWrite, pBufferToRead, NumBytes);
 
         /* Unselect the chip. */
         ssel = 1;
@@ -188,6 +206,97 @@ class DevSPI : public SPI
         return 0;
     }
 
+    /**
+     * @brief      Reads a block of registers in 8-bit data mode: sends a command
+     *             byte, the register address with whatever read and auto
+     *             increment bits the device wants, then reads the data, all
+     *             under one chip select.
+     * @param[out] pBuffer pointer to the buffer to read data into.
+     * @param[in]  DeviceAddr the device's I2C address, for the arbiter.
+     * @param[in]  Command the command byte.
+     * @param[in]  ssel GPIO of the SSEL pin of the SPI device to be used for communication.
+     * @param[in]  NumBytesToRead number of bytes to read.
+     * @retval     0 if ok.
+     * @retval     -1 if data format error.
+     * @retval     I2C_ARBITER_BUSY if the arbiter refused the bus.
+     */
+    int spi_read_reg(uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t Command,
+                     DigitalOut &ssel, uint16_t NumBytesToRead)
+    {
+	/* Check data format */
+	if(_bits != 8) return -1;
+	if(arbiter && !arbiter->acquire(DeviceAddr)) return I2C_ARBITER_BUSY;
+
+        ssel = 0;
+        write(Command);
+	block(NULL, pBuffer, NumBytesToRead);
+        ssel = 1;
+
+	if(arbiter) arbiter->release(DeviceAddr);
+        return 0;
+    }
+
+    /**
+     * @brief      Writes a block of registers in 8-bit data mode: the command
+     *             byte, then the data, under one chip select.
+     * @param[in]  pBuffer pointer to the buffer of data to send.
+     * @param[in]  DeviceAddr the device's I2C address, for the arbiter.
+     * @param[in]  Command the command byte.
+     * @param[in]  ssel GPIO of the SSEL pin of the SPI device to be used for communication.
+     * @param[in]  NumBytesToWrite number of bytes to write.
+     * @retval     0 if ok.
+     * @retval     -1 if data format error.
+     * @retval     I2C_ARBITER_BUSY if the arbiter refused the bus.
+     */
+    int spi_write_reg(const uint8_t* pBuffer, uint8_t DeviceAddr, uint8_t Command,
+                      DigitalOut &ssel, uint16_t NumBytesToWrite)
+    {
+	/* Check data format */
+	if(_bits != 8) return -1;
+	if(arbiter && !arbiter->acquire(DeviceAddr)) return I2C_ARBITER_BUSY;
+
+        ssel = 0;
+        write(Command);
+	block(pBuffer, NULL, NumBytesToWrite);
+        ssel = 1;
+
+	if(arbiter) arbiter->release(DeviceAddr);
+        return 0;
+    }
+
+    /**
+     * @brief      As above, with the data gathered from several buffers, so a
+     *             caller can prepend values without copying into a staging
+     *             buffer first.
+     * @param[in]  Segments buffers to send in order, anything with a data
+     *             pointer and a length member (I2CSegment, say).
+     * @param[in]  Count number of segments.
+     * @param[in]  DeviceAddr the device's I2C address, for the arbiter.
+     * @param[in]  Command the command byte.
+     * @param[in]  ssel GPIO of the SSEL pin of the SPI device to be used for communication.
+     * @retval     0 if ok.
+     * @retval     -1 if data format error.
+     * @retval     I2C_ARBITER_BUSY if the arbiter refused the bus.
+     */
+    template <typename Segment>
+    int spi_write_reg(const Segment* Segments, uint8_t Count, uint8_t DeviceAddr,
+                      uint8_t Command, DigitalOut &ssel)
+    {
+	/* Check data format */
+	if(_bits != 8) return -1;
+	if(arbiter && !arbiter->acquire(DeviceAddr)) return I2C_ARBITER_BUSY;
+
+        ssel = 0;
+        write(Command);
+	for (uint8_t i = 0; i < Count; i++) {
+	    block(Segments[i].data, NULL, Segments[i].length);
+	}
+        ssel = 1;
+
+	if(arbiter) arbiter->release(DeviceAddr);
+        return 0;
+    }
+
     /**
      * @brief      Writes a buffer to the SPI peripheral device in 16-bit data mode 
      *             using synchronous SPI communication.
@@ -286,6 +395,45 @@ class DevSPI : public SPI
     }
 
 protected:
+    /**
+     * @brief      Clocks a block of 8-bit frames: sends pTx, or the fill value
+     *             if it is NULL, and keeps what comes back in pRx unless it is
+     *             NULL. Blocks of DEV_SPI_ASYNC_MIN bytes and more go through
+     *             the asynchronous API (DMA where the HAL has it) on targets
+     *             with DEVICE_SPI_ASYNCH, the calling thread blocked on a
+     *             semaphore until it completes so other threads run meanwhile,
+     *             rather than polling the peripheral a byte at a time.
+     *             ISRs can't block and keep the byte loop.
+     */
+    void block(const uint8_t* pTx, uint8_t* pRx, uint16_t NumBytes)
+    {
+#if DEVICE_SPI_ASYNCH
+	if (NumBytes >= DEV_SPI_ASYNC_MIN && __get_IPSR() == 0) {
+	    if (transfer(pTx, pTx ? NumBytes : 0, pRx, pRx ? NumBytes : 0,
+	                 event_callback_t(this, &DevSPI::on_transfer), SPI_EVENT_ALL) == 0) {
+		transfer_done.wait();
+		return;
+	    }
+	}
+#endif
+	for (uint16_t i = 0; i < NumBytes; i++) {
+	    uint8_t value = write(pTx ? pTx[i] : 0);
+	    if (pRx) pRx[i] = value;
+	}
+    }
+
+#if DEVICE_SPI_ASYNCH
+    /* From the SPI interrupt, one release per transfer started */
+    void on_transfer(int)
+    {
+	transfer_done.release();
+    }
+
+    Semaphore transfer_done;
+#endif
+
+    I2CArbiter *arbiter;
+
     inline uint16_t htons(uint16_t x) {
 #ifndef __DEV_SPI_BIG_ENDIAN
 	return (((x)<<8)|((x)>>8));
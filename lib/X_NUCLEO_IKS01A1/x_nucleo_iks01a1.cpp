@@ -36,34 +36,59 @@
 */ 
     
 /* Includes ------------------------------------------------------------------*/
+#include <new>
 #include "mbed.h"
 #include "x_nucleo_iks01a1.h"
 
+/* Types ---------------------------------------------------------------------*/
+/** Room for one T, to be constructed in place */
+template <class T>
+struct StaticStorage {
+	alignas(T) unsigned char bytes[sizeof(T)];
+};
+
 /* Static variables ----------------------------------------------------------*/
 X_NUCLEO_IKS01A1* X_NUCLEO_IKS01A1::_instance = NULL;
 
+/* The singleton, a DevI2C of its own and each sensor it can have, so that
+   bringing the board up never touches the heap */
+static StaticStorage<X_NUCLEO_IKS01A1> board_storage;
+static StaticStorage<DevI2C> i2c_storage;
+static StaticStorage<HTS221> ht_storage;
+static StaticStorage<LIS3MDL> mag_storage;
+static StaticStorage<LPS25H> pt_storage;
+static StaticStorage<LSM6DS0> lsm6ds0_storage;
+static StaticStorage<LSM6DS3> lsm6ds3_storage;
+
 
 /* Methods -------------------------------------------------------------------*/
 /**
  * @brief  Constructor
+ * @note   the LSM6DS3 goes on imu_spi, selected by imu_cs, if imu_spi is
+ *         given, and on the I2C bus with the other sensors otherwise
  */
-X_NUCLEO_IKS01A1::X_NUCLEO_IKS01A1(DevI2C *ext_i2c, PinName ff_irq_pin) : dev_i2c(ext_i2c),
-	ht_sensor(new HTS221(*dev_i2c)),
-	magnetometer(new LIS3MDL(*dev_i2c)),
-	pt_sensor(new LPS25H(*dev_i2c)),
-	gyro_lsm6ds0(new LSM6DS0(*dev_i2c))
+X_NUCLEO_IKS01A1::X_NUCLEO_IKS01A1(DevI2C *ext_i2c, PinName ff_irq_pin,
+				   DevSPI *imu_spi, PinName imu_cs) : dev_i2c(ext_i2c),
+	gyro_lsm6ds0(new(lsm6ds0_storage.bytes) LSM6DS0(*dev_i2c)),
+	ht_sensor(new(ht_storage.bytes) HTS221(*dev_i2c)),
+	magnetometer(new(mag_storage.bytes) LIS3MDL(*dev_i2c)),
+	pt_sensor(new(pt_storage.bytes) LPS25H(*dev_i2c)),
+	ht_state(SENSOR_PENDING),
+	mag_state(SENSOR_PENDING),
+	pt_state(SENSOR_PENDING)
 { 
 	if(ff_irq_pin == NC) {
 		gyro_lsm6ds3 = NULL;
+	} else if(imu_spi != NULL) {
+		gyro_lsm6ds3 = new(lsm6ds3_storage.bytes) LSM6DS3(SPITransport(imu_spi, imu_cs), ff_irq_pin);
 	} else {
-		gyro_lsm6ds3 = new LSM6DS3(*dev_i2c, ff_irq_pin);
+		gyro_lsm6ds3 = new(lsm6ds3_storage.bytes) LSM6DS3(*dev_i2c, ff_irq_pin);
 	}
 }
 
 /**
  * @brief     Get singleton instance
  * @return    a pointer to the initialized singleton instance of class X_NUCLEO_IKS01A1.
- *            A return value of NULL indicates an out of memory situation.
  * @param[in] ext_i2c (optional) pointer to an instance of DevI2C to be used
  *            for communication on the expansion board. 
  *            Defaults to NULL.
@@ -81,10 +106,10 @@ X_NUCLEO_IKS01A1::X_NUCLEO_IKS01A1(DevI2C *ext_i2c, PinName ff_irq_pin) : dev_i2
 X_NUCLEO_IKS01A1* X_NUCLEO_IKS01A1::Instance(DevI2C *ext_i2c, PinName ff_irq_pin) {
 	if(_instance == NULL) {
 		if(ext_i2c == NULL)
-			ext_i2c = new DevI2C(IKS01A1_PIN_I2C_SDA, IKS01A1_PIN_I2C_SCL);
+			ext_i2c = new(i2c_storage.bytes) DevI2C(IKS01A1_PIN_I2C_SDA, IKS01A1_PIN_I2C_SCL);
 
 		if(ext_i2c != NULL)
-			_instance = new X_NUCLEO_IKS01A1(ext_i2c, ff_irq_pin);
+			_instance = new(board_storage.bytes) X_NUCLEO_IKS01A1(ext_i2c, ff_irq_pin);
 	
 		if(_instance != NULL) {
 			bool ret = _instance->Init();
@@ -100,7 +125,6 @@ X_NUCLEO_IKS01A1* X_NUCLEO_IKS01A1::Instance(DevI2C *ext_i2c, PinName ff_irq_pin
 /**
  * @brief     Get singleton instance
  * @return    a pointer to the initialized singleton instance of class X_NUCLEO_IKS01A1.
- *            A return value of NULL indicates an out of memory situation.
  * @param[in] sda I2C data line pin.
  *            Taken into account only on the very first call of one of the 'Instance' functions.
  *            A new DevI2C will be created based on parameters 'sda' and 'scl'.
@@ -118,10 +142,47 @@ X_NUCLEO_IKS01A1* X_NUCLEO_IKS01A1::Instance(DevI2C *ext_i2c, PinName ff_irq_pin
  */
 X_NUCLEO_IKS01A1* X_NUCLEO_IKS01A1::Instance(PinName sda, PinName scl, PinName ff_irq_pin) {
 	if(_instance == NULL) {
-		DevI2C *ext_i2c = new DevI2C(sda, scl);
+		DevI2C *ext_i2c = new(i2c_storage.bytes) DevI2C(sda, scl);
 
 		if(ext_i2c != NULL)
-			_instance = new X_NUCLEO_IKS01A1(ext_i2c, ff_irq_pin);
+			_instance = new(board_storage.bytes) X_NUCLEO_IKS01A1(ext_i2c, ff_irq_pin);
+	
+		if(_instance != NULL) {
+			bool ret = _instance->Init();
+			if(!ret) {
+				error("Failed to init X_NUCLEO_IKS01A1 expansion board!\n");
+			}
+		}
+	}
+
+	return _instance;
+}
+
+/**
+ * @brief     Get singleton instance, with a LSM6DS3 on SPI
+ * @return    a pointer to the initialized singleton instance of class X_NUCLEO_IKS01A1.
+ * @param[in] ext_i2c (optional) pointer to an instance of DevI2C to be used
+ *            for communication with the sensors on the expansion board.
+ *            If NULL a new DevI2C will be created with standard
+ *            configuration parameters.
+ *            Taken into account only on the very first call of one of the 'Instance' functions.
+ * @param[in] imu_spi DevSPI the LSM6DS3 mounted on top of the DIL 24-pin socket
+ *            is wired to, instead of the expansion board's I2C bus. The
+ *            other sensors are hard-wired to I2C.
+ *            Taken into account only on the very first call of one of the 'Instance' functions.
+ * @param[in] imu_cs PinName of the LSM6DS3 chip select.
+ * @param[in] ff_irq_pin (optional) PinName of the pin associated to asynchronous 
+ *            (i.e. interrupt based) free fall detection of the LSM6DS3.
+ *            Defaults to IKS01A1_PIN_FF.
+ *            A value of 'NC' will avoid instantiation of the LSM6DS3 even if present.
+ */
+X_NUCLEO_IKS01A1* X_NUCLEO_IKS01A1::Instance(DevI2C *ext_i2c, DevSPI *imu_spi, PinName imu_cs, PinName ff_irq_pin) {
+	if(_instance == NULL) {
+		if(ext_i2c == NULL)
+			ext_i2c = new(i2c_storage.bytes) DevI2C(IKS01A1_PIN_I2C_SDA, IKS01A1_PIN_I2C_SCL);
+
+		if(ext_i2c != NULL)
+			_instance = new(board_storage.bytes) X_NUCLEO_IKS01A1(ext_i2c, ff_irq_pin, imu_spi, imu_cs);
 	
 		if(_instance != NULL) {
 			bool ret = _instance->Init();
@@ -136,7 +197,7 @@ X_NUCLEO_IKS01A1* X_NUCLEO_IKS01A1::Instance(PinName sda, PinName scl, PinName f
 
 /**
  * @brief  Initialize the singleton's HT sensor
- * @retval true if initialization successful, 
+ * @retval true if present and initialized, 
  * @retval false otherwise
  */
 bool X_NUCLEO_IKS01A1::Init_HTS221(void) {
@@ -147,9 +208,7 @@ bool X_NUCLEO_IKS01A1::Init_HTS221(void) {
 	if((ht_sensor->ReadID(&ht_id) != HUM_TEMP_OK) ||
 	   (ht_id != I_AM_HTS221))
 		{
-			delete ht_sensor;
-			ht_sensor = NULL;
-			return true;
+			return false;
 		}
 	
 	/* Configure sensor */
@@ -165,7 +224,7 @@ bool X_NUCLEO_IKS01A1::Init_HTS221(void) {
 
 /**
  * @brief  Initialize the singleton's magnetometer
- * @retval true if initialization successful, 
+ * @retval true if present and initialized, 
  * @retval false otherwise
  */
 bool X_NUCLEO_IKS01A1::Init_LIS3MDL(void) {
@@ -176,9 +235,7 @@ bool X_NUCLEO_IKS01A1::Init_LIS3MDL(void) {
 	if((magnetometer->ReadID(&m_id) != MAGNETO_OK) ||
 	   (m_id != I_AM_LIS3MDL_M))
 		{
-			delete magnetometer;
-			magnetometer = NULL;
-			return true;
+			return false;
 		}
       
 	/* Configure sensor */
@@ -197,7 +254,7 @@ bool X_NUCLEO_IKS01A1::Init_LIS3MDL(void) {
 
 /**
  * @brief  Initialize the singleton's pressure sensor
- * @retval true if initialization successful, 
+ * @retval true if present and initialized, 
  * @retval false otherwise
  */
 bool X_NUCLEO_IKS01A1::Init_LPS25H(void) {
@@ -208,9 +265,7 @@ bool X_NUCLEO_IKS01A1::Init_LPS25H(void) {
 	if((pt_sensor->ReadID(&p_id) != PRESSURE_OK) ||
 	   (p_id != I_AM_LPS25H))
 		{
-			delete pt_sensor;
-			pt_sensor = NULL;
-			return true;
+			return false;
 		}
             
 	/* Configure sensor */
@@ -243,7 +298,7 @@ bool X_NUCLEO_IKS01A1::Init_LSM6DS0(void) {
 	   (gyro_lsm6ds0->ReadID(&xg_id) != IMU_6AXES_OK) ||
 	   (xg_id != I_AM_LSM6DS0_XG))
 		{
-			delete gyro_lsm6ds0;
+			gyro_lsm6ds0->~LSM6DS0();
 			gyro_lsm6ds0 = NULL;
 			return true;
 		}
@@ -284,7 +339,7 @@ bool X_NUCLEO_IKS01A1::Init_LSM6DS3(void) {
 	if((gyro_lsm6ds3->ReadID(&xg_id) != IMU_6AXES_OK) ||
 	   (xg_id != I_AM_LSM6DS3_XG))
 		{
-			delete gyro_lsm6ds3;
+			gyro_lsm6ds3->~LSM6DS3();
 			gyro_lsm6ds3 = NULL;
 			return true;
 		}
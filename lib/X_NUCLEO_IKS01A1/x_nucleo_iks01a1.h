@@ -49,6 +49,7 @@
 #include "lsm6ds0/lsm6ds0_class.h"
 #include "lsm6ds3/lsm6ds3_class.h"
 #include "DevI2C.h"
+#include "DevSPI.h"
 
 /* Macros -------------------------------------------------------------------*/
 #define CALL_METH(obj, meth, param, ret) ((obj == NULL) ?		\
@@ -77,22 +78,28 @@
  * // Inertial & Environmental expansion board singleton instance
  * static X_NUCLEO_IKS01A1 *<TODO>_expansion_board = X_NUCLEO_IKS01A1::Instance();
  * @endcode
+ *
+ * The singleton and its sensors are built in static storage, nothing is
+ * allocated on the heap (see IKS01A1_STORAGE_BYTES).
+ *
+ * `Instance()` brings up only the accelerometer and gyroscope. The humidity,
+ * pressure and magnetic sensors are probed and configured on the first call
+ * of their getter, off the boot path and on the thread that uses them.
  */
 class X_NUCLEO_IKS01A1
 {
  protected:
-	X_NUCLEO_IKS01A1(DevI2C *ext_i2c, PinName ff_irq_pin);
+	X_NUCLEO_IKS01A1(DevI2C *ext_i2c, PinName ff_irq_pin,
+			 DevSPI *imu_spi = NULL, PinName imu_cs = NC);
 
 	/**
-	 * @brief  Initialize the singleton's sensors to default settings
+	 * @brief  Initialize the singleton's motion sensor to default settings,
+	 *         the other sensors are initialized on first use
 	 * @retval true if initialization successful, 
 	 * @retval false otherwise
 	 */
 	bool Init(void) {
-		return (Init_HTS221() &&
-			Init_LIS3MDL() &&
-			Init_LPS25H() &&
-			Init_Gyro());
+		return Init_Gyro();
 	}
 	
 	/**
@@ -118,12 +125,48 @@ class X_NUCLEO_IKS01A1
 	static X_NUCLEO_IKS01A1* Instance(DevI2C *ext_i2c = NULL, 
 					  PinName ff_irq_pin = IKS01A1_PIN_FF);
 	static X_NUCLEO_IKS01A1* Instance(PinName sda, PinName scl, PinName ff_irq_pin = NC);
+	static X_NUCLEO_IKS01A1* Instance(DevI2C *ext_i2c, DevSPI *imu_spi, PinName imu_cs,
+					  PinName ff_irq_pin = IKS01A1_PIN_FF);
 
 	DevI2C  *dev_i2c;
 
-	HTS221  *ht_sensor;
-	LIS3MDL *magnetometer;
-	LPS25H  *pt_sensor;
+	/**
+	 * @brief  The humidity and temperature sensor, probed and configured
+	 *         on the first call so that boot doesn't wait for it
+	 * @retval NULL if not present
+	 * @note   the first call makes the bus transfers, so make it from the
+	 *         thread that will use the sensor; the lazy getters aren't
+	 *         meant to be raced from several threads
+	 */
+	HTS221 *GetHumiditySensor(void) {
+		if(ht_state == SENSOR_PENDING)
+			ht_state = Init_HTS221() ? SENSOR_READY : SENSOR_ABSENT;
+		return (ht_state == SENSOR_READY) ? ht_sensor : NULL;
+	}
+	/**
+	 * @brief  The pressure sensor, like GetHumiditySensor()
+	 */
+	LPS25H *GetPressureSensor(void) {
+		if(pt_state == SENSOR_PENDING)
+			pt_state = Init_LPS25H() ? SENSOR_READY : SENSOR_ABSENT;
+		return (pt_state == SENSOR_READY) ? pt_sensor : NULL;
+	}
+	/**
+	 * @brief  The magnetometer, like GetHumiditySensor()
+	 */
+	LIS3MDL *GetMagnetometer(void) {
+		if(mag_state == SENSOR_PENDING)
+			mag_state = Init_LIS3MDL() ? SENSOR_READY : SENSOR_ABSENT;
+		return (mag_state == SENSOR_READY) ? magnetometer : NULL;
+	}
+
+	/**
+	 * @brief  Whether the sensor may be there, without touching the bus
+	 * @retval false once its getter found it missing
+	 */
+	bool HasHumiditySensor(void) const { return ht_state != SENSOR_ABSENT; }
+	bool HasPressureSensor(void) const { return pt_state != SENSOR_ABSENT; }
+	bool HasMagnetometer(void) const { return mag_state != SENSOR_ABSENT; }
 
 	GyroSensor *GetGyroscope(void) {
 		return ((gyro_lsm6ds3 == NULL) ? 
@@ -136,8 +179,32 @@ class X_NUCLEO_IKS01A1
 	LSM6DS0 *gyro_lsm6ds0;
 	LSM6DS3 *gyro_lsm6ds3;
 
+ protected:
+	/** Bring-up state of a sensor initialized on first use */
+	enum SensorState {
+		SENSOR_PENDING,
+		SENSOR_READY,
+		SENSOR_ABSENT
+	};
+
+	HTS221  *ht_sensor;
+	LIS3MDL *magnetometer;
+	LPS25H  *pt_sensor;
+
+	volatile uint8_t ht_state;
+	volatile uint8_t mag_state;
+	volatile uint8_t pt_state;
+
  private:
 	static X_NUCLEO_IKS01A1 *_instance;
 };
 
+/* Definitions ---------------------------------------------------------------*/
+/** Static RAM the singleton is built in: itself, every sensor it may
+ *  instantiate and the DevI2C the 'Instance' functions create when not
+ *  given one (alignment padding aside) */
+#define IKS01A1_STORAGE_BYTES	(sizeof(X_NUCLEO_IKS01A1) + sizeof(DevI2C) +	\
+				 sizeof(HTS221) + sizeof(LIS3MDL) + sizeof(LPS25H) +	\
+				 sizeof(LSM6DS0) + sizeof(LSM6DS3))
+
 #endif /* __X_NUCLEO_IKS01A1_H */
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Print the samples of a flash time series image between two log times.
+
+The image is flashlog.bin from a host run, or the log sectors read off the
+board, e.g. for sectors 5-7 of the F401:
+
+    st-flash read flash.bin 0x08020000 0x60000
+    ./scripts/tsquery.py flash.bin 60000 120000
+
+Blocks are read in place from the mapped file; see src/flashlog.hpp and
+src/timeseries.hpp for the layout.
+"""
+
+import argparse
+import mmap
+import struct
+import zlib
+
+SECTOR_MAGIC = 0x474F4C46
+BLOCK_MAGIC = 0xB10C
+SECTOR_HEADER = 24
+BLOCK_HEADER = 16
+SERIES_HEADER = struct.Struct('<QQIHH')
+SERIES_BLOCK = 256
+
+
+def sectors(image, sector_size):
+    """(sequence, offset) of the sectors in use, oldest first"""
+    result = []
+    for offset in range(0, len(image) - SECTOR_HEADER + 1, sector_size):
+        magic, sequence, erases, first, check = struct.unpack_from('<5I', image, offset)
+        if magic == SECTOR_MAGIC and sequence != 0 and \
+                check == ~(magic ^ sequence ^ erases ^ first) & 0xFFFFFFFF:
+            result.append((sequence, offset))
+    return sorted(result)
+
+
+def blocks(image, sector_size):
+    """Committed, intact time series blocks as memoryviews, oldest first"""
+    view = memoryview(image)
+    for _, start in sectors(image, sector_size):
+        offset = start + SECTOR_HEADER
+        while offset + BLOCK_HEADER <= start + sector_size:
+            word0, number, crc, commit = struct.unpack_from('<4I', image, offset)
+            length = word0 & 0xFFFF
+            end = offset + BLOCK_HEADER + ((length + 3) & ~3)
+            if word0 >> 16 != BLOCK_MAGIC or end > start + sector_size:
+                break
+            payload = view[offset + BLOCK_HEADER:offset + BLOCK_HEADER + length]
+            if commit == 0 and length == SERIES_BLOCK and zlib.crc32(payload) & 0xFFFFFFFF == crc:
+                yield payload
+            offset = end
+
+
+def decode(payload):
+    """(log time us, x, y, z) of every sample in a block"""
+    first_us, _, period_us, count, used = SERIES_HEADER.unpack_from(payload)
+    data = payload[SERIES_HEADER.size:SERIES_HEADER.size + used]
+    at = 0
+    sample = [0, 0, 0]
+    for i in range(count):
+        for axis in range(3):
+            zigzag = shift = 0
+            while True:
+                byte = data[at]
+                at += 1
+                zigzag |= (byte & 0x7F) << shift
+                shift += 7
+                if not byte & 0x80:
+                    break
+            sample[axis] = (sample[axis] + ((zigzag >> 1) ^ -(zigzag & 1)) + 0x8000) % 0x10000 - 0x8000
+        yield (first_us + i * period_us,) + tuple(sample)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('image')
+    parser.add_argument('from_ms', type=int, nargs='?', default=0)
+    parser.add_argument('to_ms', type=int, nargs='?', default=2 ** 53)
+    parser.add_argument('--sector-size', type=int, default=128 * 1024)
+    args = parser.parse_args()
+    from_us = args.from_ms * 1000
+    to_us = args.to_ms * 1000 + 999
+
+    with open(args.image, 'rb') as f:
+        image = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        for payload in blocks(image, args.sector_size):
+            first_us, last_us = struct.unpack_from('<QQ', payload)
+            if last_us < from_us or first_us > to_us:
+                continue
+            for us, x, y, z in decode(payload):
+                if from_us <= us <= to_us:
+                    print('log,%d.%03d,%d,%d,%d' % (us // 1000, us % 1000, x, y, z))
+
+
+if __name__ == '__main__':
+    main()
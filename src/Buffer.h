@@ -1,29 +1,32 @@
+#ifndef __BUFFER_H__
+#define __BUFFER_H__
 #include <atomic>
 #include <cstddef>
+#include <stdint.h>
 
+// Single producer / single consumer ring, safe between one ISR and one thread.
+// Holds m_capacity - 1 items.
 template <class T, int32_t m_capacity>
 class Buffer {
-  int32_t m_size;
   std::atomic<int32_t> m_head;
   std::atomic<int32_t> m_tail;
 
-  T* m_data;
+  T m_data[m_capacity];
 
 public:
-  Buffer() : m_size(0), m_head(0), m_tail(0) {
-    m_data = new T[m_capacity];
-  }
-  ~Buffer();
+  Buffer() : m_head(0), m_tail(0) {};
 
+  // Both indices are owned by different sides, so derive the size from them
   int32_t size() {
-    return m_size;
+    int32_t size = m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    return size < 0 ? size + m_capacity : size;
   }
 
   int32_t capacity() {
     return m_capacity;
   }
 
-  bool push(T& item) {
+  bool push(const T& item) {
     int32_t head = m_head.load(std::memory_order_relaxed);
     int32_t nextHead = (head + 1) % m_capacity;
 
@@ -33,8 +36,6 @@ public:
 
     m_data[head] = item;
     m_head.store(nextHead, std::memory_order_release);
-
-    m_size++;
     return true;
 
     // if ((m_head == 0 && m_tail == m_capacity) || m_head == m_tail + 1) {
@@ -59,8 +60,6 @@ public:
 
     item = m_data[tail];
     m_tail.store((tail + 1) % m_capacity, std::memory_order_release);
-
-    m_size--;
     return true;
     // T result = nullptr;
     // if (m_head == -1 && m_tail == -1) {
@@ -74,3 +73,5 @@ public:
     // }
   }
 };
+
+#endif //__BUFFER_H__
@@ -0,0 +1,273 @@
+#ifndef __AHRS_H__
+#define __AHRS_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define AHRS_DEG_TO_RAD ((float) M_PI / 180.0f)
+#define AHRS_RAD_TO_DEG (180.0f / (float) M_PI)
+
+// Fast inverse square root, one Newton step is ~0.2% accurate which is well
+// inside the sensor noise and much cheaper than sqrtf + divide
+inline float invSqrt(float x) {
+  float half = 0.5f * x;
+  int32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  bits = 0x5f3759df - (bits >> 1);
+  memcpy(&x, &bits, sizeof(x));
+  return x * (1.5f - half * x * x);
+}
+
+struct Euler {
+  float roll;
+  float pitch;
+  float yaw;
+};
+
+// Orientation of the sensor frame relative to the earth frame
+struct Quaternion {
+  float w, x, y, z;
+
+  Quaternion() : w(1.0f), x(0.0f), y(0.0f), z(0.0f) {};
+
+  void normalise() {
+    float n = invSqrt(w * w + x * x + y * y + z * z);
+    w *= n;
+    x *= n;
+    y *= n;
+    z *= n;
+  }
+
+  // Aerospace sequence (yaw, pitch, roll) in degrees
+  Euler toEuler() const {
+    Euler e;
+    e.roll = atan2f(2.0f * (w * x + y * z), 1.0f - 2.0f * (x * x + y * y)) * AHRS_RAD_TO_DEG;
+    float s = 2.0f * (w * y - z * x);
+    e.pitch = (s >= 1.0f ? 90.0f : s <= -1.0f ? -90.0f : asinf(s) * AHRS_RAD_TO_DEG);
+    e.yaw = atan2f(2.0f * (w * z + x * y), 1.0f - 2.0f * (y * y + z * z)) * AHRS_RAD_TO_DEG;
+    return e;
+  }
+};
+
+// Madgwick gradient descent filter. Units are taken straight from the
+// drivers: accelerometer in mg and magnetometer in mgauss (only the
+// direction matters), gyroscope in mdps.
+class MadgwickAhrs {
+  Quaternion _q;
+  float _beta;
+
+public:
+  MadgwickAhrs(float beta = 0.1f) : _beta(beta) {};
+
+  const Quaternion& quaternion() const {
+    return _q;
+  }
+
+  // 6 axis update, used when there's no magnetometer or it reads zero
+  void update(const int32_t* accel, const int32_t* gyro, float dt) {
+    float gx = gyro[0] * (AHRS_DEG_TO_RAD / 1000.0f);
+    float gy = gyro[1] * (AHRS_DEG_TO_RAD / 1000.0f);
+    float gz = gyro[2] * (AHRS_DEG_TO_RAD / 1000.0f);
+    float q0 = _q.w, q1 = _q.x, q2 = _q.y, q3 = _q.z;
+
+    float qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    float ax = (float) accel[0], ay = (float) accel[1], az = (float) accel[2];
+    if (ax != 0.0f || ay != 0.0f || az != 0.0f) {
+      float n = invSqrt(ax * ax + ay * ay + az * az);
+      ax *= n;
+      ay *= n;
+      az *= n;
+
+      float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+      float _4q0 = 4.0f * q0, _4q1 = 4.0f * q1, _4q2 = 4.0f * q2;
+      float _8q1 = 8.0f * q1, _8q2 = 8.0f * q2;
+      float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+      float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+      float s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+      float s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+      float s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+      n = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+      if (n > 0.0f) {
+        n = invSqrt(n);
+        qDot1 -= _beta * s0 * n;
+        qDot2 -= _beta * s1 * n;
+        qDot3 -= _beta * s2 * n;
+        qDot4 -= _beta * s3 * n;
+      }
+    }
+
+    _q.w = q0 + qDot1 * dt;
+    _q.x = q1 + qDot2 * dt;
+    _q.y = q2 + qDot3 * dt;
+    _q.z = q3 + qDot4 * dt;
+    _q.normalise();
+  }
+
+  // 9 axis update
+  void update(const int32_t* accel, const int32_t* gyro, const int32_t* mag, float dt) {
+    float mx = (float) mag[0], my = (float) mag[1], mz = (float) mag[2];
+    float ax = (float) accel[0], ay = (float) accel[1], az = (float) accel[2];
+    if ((mx == 0.0f && my == 0.0f && mz == 0.0f) || (ax == 0.0f && ay == 0.0f && az == 0.0f)) {
+      update(accel, gyro, dt);
+      return;
+    }
+
+    float gx = gyro[0] * (AHRS_DEG_TO_RAD / 1000.0f);
+    float gy = gyro[1] * (AHRS_DEG_TO_RAD / 1000.0f);
+    float gz = gyro[2] * (AHRS_DEG_TO_RAD / 1000.0f);
+    float q0 = _q.w, q1 = _q.x, q2 = _q.y, q3 = _q.z;
+
+    float qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    float n = invSqrt(ax * ax + ay * ay + az * az);
+    ax *= n;
+    ay *= n;
+    az *= n;
+    n = invSqrt(mx * mx + my * my + mz * mz);
+    mx *= n;
+    my *= n;
+    mz *= n;
+
+    float _2q0mx = 2.0f * q0 * mx, _2q0my = 2.0f * q0 * my, _2q0mz = 2.0f * q0 * mz;
+    float _2q1mx = 2.0f * q1 * mx;
+    float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+    float _2q0q2 = 2.0f * q0 * q2, _2q2q3 = 2.0f * q2 * q3;
+    float q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+    float q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+    float q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+
+    // Reference direction of the earth's magnetic field
+    float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+    float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+    float _2bx = sqrtf(hx * hx + hy * hy);
+    float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+    float _4bx = 2.0f * _2bx, _4bz = 2.0f * _2bz;
+
+    float s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - ax) + _2q1 * (2.0f * q0q1 + _2q2q3 - ay)
+             - _2bz * q2 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx)
+             + (-_2bx * q3 + _2bz * q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my)
+             + _2bx * q2 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+    float s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax) + _2q0 * (2.0f * q0q1 + _2q2q3 - ay)
+             - 4.0f * q1 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az)
+             + _2bz * q3 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx)
+             + (_2bx * q2 + _2bz * q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my)
+             + (_2bx * q3 - _4bz * q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+    float s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax) + _2q3 * (2.0f * q0q1 + _2q2q3 - ay)
+             - 4.0f * q2 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az)
+             + (-_4bx * q2 - _2bz * q0) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx)
+             + (_2bx * q1 + _2bz * q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my)
+             + (_2bx * q0 - _4bz * q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+    float s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax) + _2q2 * (2.0f * q0q1 + _2q2q3 - ay)
+             + (-_4bx * q3 + _2bz * q1) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx)
+             + (-_2bx * q0 + _2bz * q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my)
+             + _2bx * q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+    n = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+    if (n > 0.0f) {
+      n = invSqrt(n);
+      qDot1 -= _beta * s0 * n;
+      qDot2 -= _beta * s1 * n;
+      qDot3 -= _beta * s2 * n;
+      qDot4 -= _beta * s3 * n;
+    }
+
+    _q.w = q0 + qDot1 * dt;
+    _q.x = q1 + qDot2 * dt;
+    _q.y = q2 + qDot3 * dt;
+    _q.z = q3 + qDot4 * dt;
+    _q.normalise();
+  }
+};
+
+// Mahony complementary filter with PI feedback, cheaper than Madgwick but
+// needs kp/ki tuning per board
+class MahonyAhrs {
+  Quaternion _q;
+  float _kp;
+  float _ki;
+  float _ix, _iy, _iz;
+
+public:
+  MahonyAhrs(float kp = 1.0f, float ki = 0.0f) : _kp(kp), _ki(ki), _ix(0.0f), _iy(0.0f), _iz(0.0f) {};
+
+  const Quaternion& quaternion() const {
+    return _q;
+  }
+
+  // 9 axis update; pass mag == NULL for 6 axis
+  void update(const int32_t* accel, const int32_t* gyro, const int32_t* mag, float dt) {
+    float gx = gyro[0] * (AHRS_DEG_TO_RAD / 1000.0f);
+    float gy = gyro[1] * (AHRS_DEG_TO_RAD / 1000.0f);
+    float gz = gyro[2] * (AHRS_DEG_TO_RAD / 1000.0f);
+    float q0 = _q.w, q1 = _q.x, q2 = _q.y, q3 = _q.z;
+
+    float ax = (float) accel[0], ay = (float) accel[1], az = (float) accel[2];
+    if (ax != 0.0f || ay != 0.0f || az != 0.0f) {
+      float n = invSqrt(ax * ax + ay * ay + az * az);
+      ax *= n;
+      ay *= n;
+      az *= n;
+
+      // Estimated direction of gravity, error is the cross product with the measurement
+      float vx = q1 * q3 - q0 * q2;
+      float vy = q0 * q1 + q2 * q3;
+      float vz = q0 * q0 - 0.5f + q3 * q3;
+      float ex = ay * vz - az * vy;
+      float ey = az * vx - ax * vz;
+      float ez = ax * vy - ay * vx;
+
+      if (mag != NULL && (mag[0] != 0 || mag[1] != 0 || mag[2] != 0)) {
+        float mx = (float) mag[0], my = (float) mag[1], mz = (float) mag[2];
+        n = invSqrt(mx * mx + my * my + mz * mz);
+        mx *= n;
+        my *= n;
+        mz *= n;
+        float hx = 2.0f * (mx * (0.5f - q2 * q2 - q3 * q3) + my * (q1 * q2 - q0 * q3) + mz * (q1 * q3 + q0 * q2));
+        float hy = 2.0f * (mx * (q1 * q2 + q0 * q3) + my * (0.5f - q1 * q1 - q3 * q3) + mz * (q2 * q3 - q0 * q1));
+        float bx = sqrtf(hx * hx + hy * hy);
+        float bz = 2.0f * (mx * (q1 * q3 - q0 * q2) + my * (q2 * q3 + q0 * q1) + mz * (0.5f - q1 * q1 - q2 * q2));
+        float wx = bx * (0.5f - q2 * q2 - q3 * q3) + bz * (q1 * q3 - q0 * q2);
+        float wy = bx * (q1 * q2 - q0 * q3) + bz * (q0 * q1 + q2 * q3);
+        float wz = bx * (q0 * q2 + q1 * q3) + bz * (0.5f - q1 * q1 - q2 * q2);
+        ex += my * wz - mz * wy;
+        ey += mz * wx - mx * wz;
+        ez += mx * wy - my * wx;
+      }
+
+      if (_ki > 0.0f) {
+        _ix += _ki * ex * dt;
+        _iy += _ki * ey * dt;
+        _iz += _ki * ez * dt;
+        gx += _ix;
+        gy += _iy;
+        gz += _iz;
+      }
+      gx += _kp * ex;
+      gy += _kp * ey;
+      gz += _kp * ez;
+    }
+
+    gx *= 0.5f * dt;
+    gy *= 0.5f * dt;
+    gz *= 0.5f * dt;
+    _q.w = q0 - q1 * gx - q2 * gy - q3 * gz;
+    _q.x = q1 + q0 * gx + q2 * gz - q3 * gy;
+    _q.y = q2 + q0 * gy - q1 * gz + q3 * gx;
+    _q.z = q3 + q0 * gz + q1 * gy - q2 * gx;
+    _q.normalise();
+  }
+};
+
+#endif //__AHRS_H__
@@ -0,0 +1,33 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+#include "mbed.h"
+#include <inttypes.h>
+#include "cycles.hpp"
+
+// Minimal on-target benchmark harness. Each case runs a kernel over a block
+// of `samples` samples and reports the cost in cycles per sample through the
+// supplied log function.
+class Benchmark {
+  void (*_report)(const char*);
+
+public:
+  Benchmark(void (*report)(const char*)) : _report(report) {
+    CycleCounter::enable();
+  }
+
+  template <class Fn>
+  uint32_t run(const char* name, uint32_t samples, Fn kernel) {
+    // Warm up caches and the flash accelerator before timing
+    kernel();
+    uint32_t start = CycleCounter::now();
+    kernel();
+    uint32_t cycles = CycleCounter::now() - start;
+
+    char message[64];
+    sprintf(message, "Bench %-16s %6" PRIu32 " cycles/sample\r\n", name, cycles / samples);
+    _report(message);
+    return cycles / samples;
+  }
+};
+
+#endif //__BENCHMARK_H__
@@ -0,0 +1,57 @@
+#ifndef __BOOT_H__
+#define __BOOT_H__
+#include "mbed.h"
+
+#ifndef BOOT_MAX_PHASES
+#define BOOT_MAX_PHASES 8
+#endif
+
+struct BootPhase {
+  const char* name;
+  uint32_t us;
+};
+
+// Where the time from reset to the first sample goes. Each mark() closes a
+// phase that began at the previous mark, or at construction: declare the
+// timer ahead of every other static so it starts first. What runs before
+// static constructors (clock setup, the C library) isn't seen. Marks past
+// BOOT_MAX_PHASES fold into the last phase.
+class BootTimer {
+  uint32_t _startUs;
+  uint32_t _lastUs;
+  BootPhase _phases[BOOT_MAX_PHASES];
+  uint8_t _count;
+
+public:
+  BootTimer() : _startUs(us_ticker_read()), _lastUs(_startUs), _count(0) {};
+
+  // Close the current phase as `name`, returns its length
+  uint32_t mark(const char* name) {
+    uint32_t now = us_ticker_read();
+    uint32_t us = now - _lastUs;
+    _lastUs = now;
+    if (_count == BOOT_MAX_PHASES) {
+      _phases[_count - 1].us += us;
+      return us;
+    }
+    _phases[_count].name = name;
+    _phases[_count].us = us;
+    _count++;
+    return us;
+  }
+
+  uint8_t count() const {
+    return _count;
+  }
+
+  const BootPhase& phase(uint8_t i) const {
+    return _phases[i];
+  }
+
+  // From construction to the last mark
+  uint32_t totalUs() const {
+    return _lastUs - _startUs;
+  }
+};
+
+#endif //__BOOT_H__
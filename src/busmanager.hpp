@@ -0,0 +1,344 @@
+#ifndef __BUSMANAGER_H__
+#define __BUSMANAGER_H__
+#include "mbed.h"
+#include "rtos.h"
+#include "DevI2C.h"
+
+#ifndef BUS_MAX_WAITERS
+#define BUS_MAX_WAITERS 8
+#endif
+#ifndef BUS_MAX_DEVICES
+#define BUS_MAX_DEVICES 8
+#endif
+#ifndef BUS_MAX_THREADS
+#define BUS_MAX_THREADS 4
+#endif
+// A transfer waiting longer than this without an explicit deadline is late
+#ifndef BUS_DEFAULT_SLACK_US
+#define BUS_DEFAULT_SLACK_US 10000
+#endif
+// Thread signal that hands the bus to a waiter
+#ifndef BUS_GRANT_SIGNAL
+#define BUS_GRANT_SIGNAL 0x40
+#endif
+
+enum BusPriority {
+  BUS_PRIORITY_LOW,       // environmental sensors, housekeeping
+  BUS_PRIORITY_NORMAL,
+  BUS_PRIORITY_HIGH       // sample acquisition
+};
+
+// What one device got out of the bus since the last snapshot
+struct BusDeviceStats {
+  uint8_t address;
+  uint32_t grants;
+  uint32_t busyUs;        // held, from grant to release
+  uint32_t maxWaitUs;     // longest from asking to getting it
+  uint32_t late;          // granted after their deadline
+  uint32_t refused;       // ISR transfers that found the bus taken
+};
+
+// Serialises the I2C bus between threads and ISRs as the DevI2C arbiter.
+//
+// Whoever holds the bus can take it again (a session around several driver
+// calls, say), and only the outermost release hands it on. Waiters queue by
+// priority, then deadline, so a FIFO drain waiting behind an HTS221 one-shot
+// poll goes next even if the poll asked first; since drivers take the bus
+// per transfer, a slow device never holds it for more than one transfer
+// unless a session says so. Transfers made through the drivers without a
+// session get their thread's priority, above normal mapping to high, unless
+// the thread was given one with setThreadPriority().
+//
+// The owner inherits the RTOS priority of its highest waiter until it
+// releases, as an RTX mutex would: a below normal environment poll holding
+// the bus can't be kept off the CPU by middle priority threads while the
+// FIFO drain waits on it. Deadlines order the queue and are counted as late
+// when missed; a waiter is never abandoned, with inheritance its wait is
+// bounded by the owner's transfer.
+//
+// ISRs can't wait. A transfer from an ISR gets the bus only if it is free
+// and fails with I2C_ARBITER_BUSY otherwise, counted as refused.
+//
+// Sessions that aren't about one device, swapping DevI2C hooks say, use
+// address 0, the general call address, and aren't accounted to any device.
+//
+// The queue and statistics are guarded by masking interrupts for a few
+// instructions, never across a transfer.
+class BusManager : public I2CArbiter {
+  struct Waiter {
+    osThreadId thread;
+    uint8_t priority;
+    uint32_t deadlineUs;
+    uint32_t askedUs;
+    uint8_t address;
+    osPriority rtosPriority;
+  };
+  struct ThreadPriority {
+    osThreadId thread;
+    BusPriority priority;
+  };
+
+  osThreadId _owner;          // NULL when free
+  bool _isrOwned;
+  uint32_t _depth;
+  uint8_t _ownerAddress;
+  uint32_t _grantedUs;
+  osPriority _ownerBase;      // the owner's own RTOS priority
+  osPriority _ownerPriority;  // and what its waiters lend it
+  Waiter _waiters[BUS_MAX_WAITERS];
+  uint32_t _waiterCount;
+  BusDeviceStats _devices[BUS_MAX_DEVICES];
+  uint32_t _deviceCount;
+  uint32_t _windowStartUs;
+  ThreadPriority _threads[BUS_MAX_THREADS];
+  uint32_t _threadCount;
+
+  static bool inIsr() {
+    return __get_IPSR() != 0;
+  }
+
+  static bool before(uint32_t a, uint32_t b) {
+    return (int32_t) (a - b) < 0;
+  }
+
+  // The last entry collects addresses that don't fit
+  BusDeviceStats& device(uint8_t address) {
+    for (uint32_t i = 0; i < _deviceCount; i++) {
+      if (_devices[i].address == address) {
+        return _devices[i];
+      }
+    }
+    if (_deviceCount < BUS_MAX_DEVICES) {
+      BusDeviceStats& stats = _devices[_deviceCount++];
+      memset(&stats, 0, sizeof(stats));
+      stats.address = address;
+      return stats;
+    }
+    return _devices[BUS_MAX_DEVICES - 1];
+  }
+
+  static bool above(osPriority a, osPriority b) {
+    return a != osPriorityError && (b == osPriorityError || a > b);
+  }
+
+  void grant(osThreadId thread, uint8_t address, uint32_t askedUs, uint32_t deadlineUs, osPriority priority) {
+    uint32_t now = us_ticker_read();
+    _owner = thread;
+    _depth = 1;
+    _ownerAddress = address;
+    _grantedUs = now;
+    _ownerBase = _ownerPriority = priority;
+    if (address == 0) {
+      return;
+    }
+    BusDeviceStats& stats = device(address);
+    stats.grants++;
+    if (now - askedUs > stats.maxWaitUs) {
+      stats.maxWaitUs = now - askedUs;
+    }
+    if (before(deadlineUs, now)) {
+      stats.late++;
+    }
+  }
+
+  // Bring `owner` up to the priority lent to it. The RTX call can't be made
+  // with interrupts masked, so look again after it: a waiter that preempted
+  // us in between may have lent more.
+  void lend(osThreadId owner) {
+    osPriority applied = osPriorityError;
+    while (true) {
+      __disable_irq();
+      osPriority target = _owner == owner ? _ownerPriority : applied;
+      __enable_irq();
+      if (target == applied) {
+        return;
+      }
+      osThreadSetPriority(owner, target);
+      applied = target;
+    }
+  }
+
+  BusPriority threadPriority() const {
+    osThreadId self = osThreadGetId();
+    for (uint32_t i = 0; i < _threadCount; i++) {
+      if (_threads[i].thread == self) {
+        return _threads[i].priority;
+      }
+    }
+    osPriority priority = osThreadGetPriority(self);
+    return priority == osPriorityError ? BUS_PRIORITY_NORMAL
+         : priority > osPriorityNormal ? BUS_PRIORITY_HIGH
+         : priority < osPriorityNormal ? BUS_PRIORITY_LOW : BUS_PRIORITY_NORMAL;
+  }
+
+public:
+  BusManager()
+      : _owner(NULL), _isrOwned(false), _depth(0), _ownerAddress(0), _grantedUs(0),
+        _ownerBase(osPriorityError), _ownerPriority(osPriorityError), _waiterCount(0),
+        _deviceCount(0), _windowStartUs(0), _threadCount(0) {};
+
+  // Bus priority of `thread`'s transfers outside sessions, for threads whose
+  // RTOS priority says otherwise: one that runs above normal to keep ahead
+  // of the serial port, say, without its reads being urgent.
+  bool setThreadPriority(osThreadId thread, BusPriority priority) {
+    bool ok = true;
+    __disable_irq();
+    uint32_t i = 0;
+    while (i < _threadCount && _threads[i].thread != thread) {
+      i++;
+    }
+    if (i < BUS_MAX_THREADS) {
+      _threads[i].thread = thread;
+      _threads[i].priority = priority;
+      if (i == _threadCount) {
+        _threadCount++;
+      }
+    } else {
+      ok = false;
+    }
+    __enable_irq();
+    return ok;
+  }
+
+  // Take the bus for `address`, waiting behind higher priority and earlier
+  // deadline requests. Returns false only in an ISR with the bus taken, or
+  // with the wait queue full.
+  bool acquire(uint8_t address, BusPriority priority, uint32_t deadlineUs) {
+    uint32_t now = us_ticker_read();
+    if (inIsr()) {
+      bool ok = false;
+      __disable_irq();
+      if (_owner == NULL && !_isrOwned) {
+        _isrOwned = true;
+        _depth = 1;
+        _ownerAddress = address;
+        _grantedUs = now;
+        if (address != 0) {
+          device(address).grants++;
+        }
+        ok = true;
+      } else if (address != 0) {
+        device(address).refused++;
+      }
+      __enable_irq();
+      return ok;
+    }
+
+    osThreadId self = osThreadGetId();
+    osPriority mine = osThreadGetPriority(self);
+    __disable_irq();
+    if (_owner == self) {
+      _depth++;
+      __enable_irq();
+      return true;
+    }
+    if (_owner == NULL && !_isrOwned && _waiterCount == 0) {
+      grant(self, address, now, deadlineUs, mine);
+      __enable_irq();
+      return true;
+    }
+    if (_waiterCount == BUS_MAX_WAITERS) {
+      if (address != 0) {
+        device(address).refused++;
+      }
+      __enable_irq();
+      return false;
+    }
+    Waiter& waiter = _waiters[_waiterCount++];
+    waiter.thread = self;
+    waiter.priority = priority;
+    waiter.deadlineUs = deadlineUs;
+    waiter.askedUs = now;
+    waiter.address = address;
+    waiter.rtosPriority = mine;
+    osThreadId owner = NULL;
+    if (_owner != NULL && above(mine, _ownerPriority)) {
+      _ownerPriority = mine;
+      owner = _owner;
+    }
+    __enable_irq();
+    if (owner != NULL) {
+      lend(owner);
+    }
+
+    // release() makes us the owner before it signals
+    Thread::signal_wait(BUS_GRANT_SIGNAL);
+    return true;
+  }
+
+  // DevI2C entry point: the thread's priority, BUS_DEFAULT_SLACK_US to go
+  bool acquire(uint8_t address) {
+    return acquire(address, inIsr() ? BUS_PRIORITY_HIGH : threadPriority(), us_ticker_read() + BUS_DEFAULT_SLACK_US);
+  }
+
+  void release(uint8_t) {
+    __disable_irq();
+    if (_depth == 0 || --_depth > 0) {
+      __enable_irq();
+      return;
+    }
+    if (_ownerAddress != 0) {
+      device(_ownerAddress).busyUs += us_ticker_read() - _grantedUs;
+    }
+    // Back to our own priority once the bus is handed on
+    osThreadId self = _owner;
+    osPriority base = _ownerBase;
+    bool restore = self != NULL && _ownerPriority != base;
+    _owner = NULL;
+    _isrOwned = false;
+    if (_waiterCount == 0) {
+      __enable_irq();
+      if (restore) {
+        osThreadSetPriority(self, base);
+      }
+      return;
+    }
+    uint32_t best = 0;
+    for (uint32_t i = 1; i < _waiterCount; i++) {
+      const Waiter& w = _waiters[i];
+      const Waiter& b = _waiters[best];
+      if (w.priority > b.priority || (w.priority == b.priority && before(w.deadlineUs, b.deadlineUs))) {
+        best = i;
+      }
+    }
+    Waiter next = _waiters[best];
+    _waiters[best] = _waiters[--_waiterCount];
+    grant(next.thread, next.address, next.askedUs, next.deadlineUs, next.rtosPriority);
+    // Bus priority picked it, those still waiting may be more urgent to RTX
+    for (uint32_t i = 0; i < _waiterCount; i++) {
+      if (above(_waiters[i].rtosPriority, _ownerPriority)) {
+        _ownerPriority = _waiters[i].rtosPriority;
+      }
+    }
+    bool lent = _ownerPriority != _ownerBase && !inIsr();
+    __enable_irq();
+    if (lent) {
+      lend(next.thread);
+    }
+    osSignalSet(next.thread, BUS_GRANT_SIGNAL);
+    if (restore) {
+      osThreadSetPriority(self, base);
+    }
+  }
+
+  // Copy the per device statistics into `out` (room for BUS_MAX_DEVICES)
+  // and start a new window. Returns the number of devices; `windowUs` is
+  // the time the numbers cover, for turning busyUs into occupancy.
+  uint32_t snapshot(BusDeviceStats* out, uint32_t* windowUs) {
+    __disable_irq();
+    uint32_t now = us_ticker_read();
+    *windowUs = now - _windowStartUs;
+    _windowStartUs = now;
+    uint32_t count = _deviceCount;
+    for (uint32_t i = 0; i < count; i++) {
+      out[i] = _devices[i];
+      uint8_t address = _devices[i].address;
+      memset(&_devices[i], 0, sizeof(_devices[i]));
+      _devices[i].address = address;
+    }
+    __enable_irq();
+    return count;
+  }
+};
+
+#endif //__BUSMANAGER_H__
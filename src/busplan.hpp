@@ -0,0 +1,98 @@
+#ifndef __BUSPLAN_H__
+#define __BUSPLAN_H__
+#include <stdint.h>
+
+#ifndef BUS_PLAN_MAX_LOADS
+#define BUS_PLAN_MAX_LOADS 8
+#endif
+// MCU time per transfer on top of the clocks: the blocking mbed I2C driver
+// polls the peripheral between bytes and DevI2C copies and traces
+#ifndef BUS_PLAN_TRANSFER_US
+#define BUS_PLAN_TRANSFER_US 20
+#endif
+
+// A burst of register reads that comes round `hz` times a second
+struct BusLoad {
+  const char* name;
+  uint8_t address;        // 7 bit
+  float hz;
+  uint16_t transfers;     // register reads per burst
+  uint16_t bytes;         // data bytes per burst
+};
+
+// Predicts the share of the bus a set of periodic loads takes at a given
+// clock, to catch a rate that can't fit before it is applied rather than
+// from late samples afterwards. Every transfer is costed as a register read:
+// address, register and address again at 9 clocks each, a clock each for
+// START, repeated START and STOP, 9 clocks a data byte, plus
+// BUS_PLAN_TRANSFER_US. Writes are cheaper, so the estimate errs high.
+class BusPlanner {
+  uint32_t _busHz;
+  BusLoad _loads[BUS_PLAN_MAX_LOADS];
+  uint8_t _count;
+
+public:
+  BusPlanner(uint32_t busHz) : _busHz(busHz), _count(0) {};
+
+  uint32_t busHz() const {
+    return _busHz;
+  }
+
+  void clear() {
+    _count = 0;
+  }
+
+  bool add(const char* name, uint8_t address, float hz, uint16_t transfers, uint16_t bytes) {
+    if (_count == BUS_PLAN_MAX_LOADS || hz <= 0.0f) {
+      return false;
+    }
+    BusLoad& load = _loads[_count++];
+    load.name = name;
+    load.address = address;
+    load.hz = hz;
+    load.transfers = transfers;
+    load.bytes = bytes;
+    return true;
+  }
+
+  uint8_t count() const {
+    return _count;
+  }
+
+  const BusLoad& load(uint8_t i) const {
+    return _loads[i];
+  }
+
+  // Bus time one burst of `load` takes
+  float burstUs(const BusLoad& load) const {
+    uint32_t clocks = load.transfers * (3 * 9 + 3) + load.bytes * 9;
+    return clocks * 1000000.0f / _busHz + load.transfers * BUS_PLAN_TRANSFER_US;
+  }
+
+  // Share of the bus in permille, of one load
+  uint32_t permille(const BusLoad& load) const {
+    return (uint32_t) (load.hz * burstUs(load) / 1000.0f + 0.5f);
+  }
+
+  // of one device, by 7 bit address
+  uint32_t permille(uint8_t address) const {
+    float us = 0.0f;
+    for (uint8_t i = 0; i < _count; i++) {
+      if (_loads[i].address == address) {
+        us += _loads[i].hz * burstUs(_loads[i]);
+      }
+    }
+    return (uint32_t) (us / 1000.0f + 0.5f);
+  }
+
+  // and of everything
+  uint32_t permille() const {
+    float us = 0.0f;
+    for (uint8_t i = 0; i < _count; i++) {
+      us += _loads[i].hz * burstUs(_loads[i]);
+    }
+    return (uint32_t) (us / 1000.0f + 0.5f);
+  }
+};
+
+#endif //__BUSPLAN_H__
@@ -0,0 +1,109 @@
+#ifndef __COMMANDS_H__
+#define __COMMANDS_H__
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef COMMAND_LINE_SIZE
+#define COMMAND_LINE_SIZE 48
+#endif
+#ifndef COMMAND_MAX_ARGS
+#define COMMAND_MAX_ARGS 4
+#endif
+
+// argv[0] is the command name. Return false to print the usage line.
+typedef bool (*CommandHandler)(int argc, char** argv);
+
+struct Command {
+  const char* name;
+  const char* usage;
+  CommandHandler handler;
+};
+
+// Line based command parser for the serial console. Characters are fed one
+// at a time; a CR or LF runs the line against the command table. Overlong
+// lines are dropped rather than run truncated.
+class CommandParser {
+  const Command* _commands;
+  int _count;
+  void (*_reply)(const char*);
+  char _line[COMMAND_LINE_SIZE];
+  int _length;
+  bool _overflow;
+
+  void execute() {
+    char* argv[COMMAND_MAX_ARGS];
+    int argc = 0;
+    char* p = _line;
+    while (*p != 0 && argc < COMMAND_MAX_ARGS) {
+      while (*p == ' ' || *p == '\t') {
+        *p++ = 0;
+      }
+      if (*p == 0) {
+        break;
+      }
+      argv[argc++] = p;
+      while (*p != 0 && *p != ' ' && *p != '\t') {
+        p++;
+      }
+    }
+    if (argc == 0) {
+      return;
+    }
+
+    if (strcmp(argv[0], "help") == 0) {
+      help();
+      return;
+    }
+    for (int i = 0; i < _count; i++) {
+      if (strcmp(argv[0], _commands[i].name) == 0) {
+        if (!_commands[i].handler(argc, argv)) {
+          usage(_commands[i]);
+        }
+        return;
+      }
+    }
+    char message[COMMAND_LINE_SIZE + 32];
+    sprintf(message, "Unknown command '%s', try help\r\n", argv[0]);
+    _reply(message);
+  }
+
+  void usage(const Command& command) {
+    char message[COMMAND_LINE_SIZE + 64];
+    sprintf(message, "Usage: %s %s\r\n", command.name, command.usage);
+    _reply(message);
+  }
+
+public:
+  CommandParser(const Command* commands, int count, void (*reply)(const char*))
+    : _commands(commands), _count(count), _reply(reply), _length(0), _overflow(false) {};
+
+  void feed(char c) {
+    if (c == '\r' || c == '\n') {
+      _line[_length] = 0;
+      if (_overflow) {
+        _reply("Command too long\r\n");
+      } else {
+        execute();
+      }
+      _length = 0;
+      _overflow = false;
+    } else if (c == '\b' || c == 0x7F) {
+      if (_length > 0) {
+        _length--;
+      }
+    } else if (_length < COMMAND_LINE_SIZE - 1) {
+      _line[_length++] = c;
+    } else {
+      _overflow = true;
+    }
+  }
+
+  void help() {
+    for (int i = 0; i < _count; i++) {
+      usage(_commands[i]);
+    }
+  }
+};
+
+#endif //__COMMANDS_H__
@@ -0,0 +1,20 @@
+#ifndef __CYCLES_H__
+#define __CYCLES_H__
+#include "mbed.h"
+
+// DWT cycle counter, available on the Cortex-M4. Wraps every ~51s at 84MHz,
+// so only use it for differences.
+class CycleCounter {
+public:
+  static void enable() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  }
+
+  static uint32_t now() {
+    return DWT->CYCCNT;
+  }
+};
+
+#endif //__CYCLES_H__
@@ -6,10 +6,12 @@ class Data {
   int32_t _x;
   int32_t _y;
   int32_t _z;
+  uint32_t _timestamp;
 
 public:
-  Data() : _x(0), _y(0), _z(0) {};
-  Data(int32_t x, int32_t y, int32_t z) : _x(x), _y(y), _z(z) {};
+  Data() : _x(0), _y(0), _z(0), _timestamp(0) {};
+  // timestamp is the acquisition time in us from the free running us ticker
+  Data(int32_t x, int32_t y, int32_t z, uint32_t timestamp = 0) : _x(x), _y(y), _z(z), _timestamp(timestamp) {};
 
   Data operator+ (const Data& rhs) {
     _x += rhs.x();
@@ -38,6 +40,10 @@ public:
   int32_t z() const {
     return _z;
   }
+
+  uint32_t timestamp() const {
+    return _timestamp;
+  }
 };
 
 #endif //__DATA_H__
@@ -0,0 +1,241 @@
+#ifndef __DECIMATE_H__
+#define __DECIMATE_H__
+#include <stdint.h>
+#include <math.h>
+#include "filter.hpp"
+
+// N stage CIC decimator on Q15 samples: N integrators at the input rate,
+// keep every R-th sample, N combs at the output rate. No multiplies, but the
+// gain is R^N; it is taken out with a shift and a Q15 correction for R that
+// aren't powers of 2, which limits R^N to 2^30. The integrators wrap by
+// design, in two's complement the combs still come out right as long as the
+// result fits the registers.
+template <int N>
+class CicDecimatorQ15 {
+  uint64_t _integrator[N];
+  uint64_t _comb[N];        // comb inputs one output back
+  uint32_t _rate;
+  uint32_t _phase;
+  uint8_t _shift;
+  int32_t _correction;      // Q15, 2^_shift / R^N
+
+public:
+  CicDecimatorQ15() {
+    configure(1);
+  }
+
+  bool configure(uint32_t rate) {
+    uint64_t gain = 1;
+    for (int i = 0; i < N && rate > 0; i++) {
+      gain *= rate;
+      if (gain > (1u << 30)) {
+        return false;
+      }
+    }
+    if (rate == 0) {
+      return false;
+    }
+    _rate = rate;
+    _shift = 0;
+    while ((1ull << _shift) < gain) {
+      _shift++;
+    }
+    _correction = (int32_t) (((1ull << (_shift + 15)) + gain / 2) / gain);
+    reset();
+    return true;
+  }
+
+  void reset() {
+    for (int i = 0; i < N; i++) {
+      _integrator[i] = 0;
+      _comb[i] = 0;
+    }
+    _phase = 0;
+  }
+
+  uint32_t rate() const {
+    return _rate;
+  }
+
+  // Returns true with the next output in `out` every R-th sample
+  bool process(q15_t x, q15_t* out) {
+    uint64_t value = (uint64_t) (int64_t) x;
+    for (int i = 0; i < N; i++) {
+      _integrator[i] += value;
+      value = _integrator[i];
+    }
+    if (++_phase < _rate) {
+      return false;
+    }
+    _phase = 0;
+    for (int i = 0; i < N; i++) {
+      uint64_t delayed = _comb[i];
+      _comb[i] = value;
+      value -= delayed;
+    }
+    *out = saturate15(((int64_t) value * _correction) >> (_shift + 15));
+    return true;
+  }
+};
+
+// Taps for a T tap FIR at the output of an N stage CIC decimating by
+// `rate`: the inverse of the CIC's sinc^N droop up to `passband` (a fraction
+// of the output rate, below 0.5) and nothing above it, so it also keeps
+// what the CIC lets alias out of the next stage. Frequency sampling with a
+// Hamming window, normalised to unity gain at DC. Float, configuration time
+// only.
+template <int N, int T>
+void cicCompensator(uint32_t rate, float passband, q15_t* taps) {
+  const int half = T / 2;
+  float h[T];
+  float sum = 0.0f;
+  for (int n = 0; n < T; n++) {
+    float value = 0.0f;
+    for (int k = 0; k <= half; k++) {
+      float f = (float) k / T;
+      float response = 0.0f;
+      if (f <= passband) {
+        float droop = k == 0 ? 1.0f : sinf((float) M_PI * f) / (rate * sinf((float) M_PI * f / rate));
+        response = 1.0f / powf(fabsf(droop), N);
+      }
+      value += (k == 0 ? 1.0f : 2.0f) * response * cosf(2.0f * (float) M_PI * k * (n - half) / T);
+    }
+    h[n] = value / T * (0.54f - 0.46f * cosf(2.0f * (float) M_PI * n / (T - 1)));
+    sum += h[n];
+  }
+  for (int n = 0; n < T; n++) {
+    taps[n] = saturate15((int64_t) lrintf(h[n] / sum * 32767.0f));
+  }
+}
+
+// One lower rate copy of an interleaved X/Y/Z stream: CIC then compensator
+// on each axis. A rate of 1 passes samples through untouched.
+template <int N, int T>
+class XyzDecimator {
+  CicDecimatorQ15<N> _cic[3];
+  FirQ15<T> _fir[3];
+
+public:
+  bool configure(uint32_t rate, float passband = 0.2f) {
+    q15_t taps[T];
+    cicCompensator<N, T>(rate, passband, taps);
+    for (int axis = 0; axis < 3; axis++) {
+      if (!_cic[axis].configure(rate)) {
+        return false;
+      }
+      _fir[axis].configure(taps);
+      _fir[axis].reset();
+    }
+    return true;
+  }
+
+  uint32_t rate() const {
+    return _cic[0].rate();
+  }
+
+  // Decimate `count` samples from `in` into `out`, returning how many came
+  // out. `positions` gets the index in `in` each output completed on.
+  uint16_t process(const q15_t* in, uint16_t count, q15_t* out, uint16_t* positions) {
+    uint16_t produced = 0;
+    for (uint16_t i = 0; i < count; i++) {
+      if (rate() == 1) {
+        out[3 * produced] = in[3 * i];
+        out[3 * produced + 1] = in[3 * i + 1];
+        out[3 * produced + 2] = in[3 * i + 2];
+        positions[produced++] = i;
+        continue;
+      }
+      // All three axes are in phase, they are ready together
+      bool ready = false;
+      for (int axis = 0; axis < 3; axis++) {
+        q15_t y;
+        if (_cic[axis].process(in[3 * i + axis], &y)) {
+          out[3 * produced + axis] = _fir[axis].process(y);
+          ready = true;
+        }
+      }
+      if (ready) {
+        positions[produced++] = i;
+      }
+    }
+    return produced;
+  }
+};
+
+// Several output rates from one acquisition. Each tap decimates the input or
+// an earlier tap by an integer factor, so a 1Hz tap fed from a 100Hz one
+// only does 100Hz worth of work, and process() leaves every tap's samples
+// for the block in place for its consumer. Blocks are at most MAX_BLOCK.
+// Taps start from zero, after configure() a tap's first N + T / 2 outputs
+// are its filters settling.
+template <int TAPS, int MAX_BLOCK, int N = 3, int T = 15>
+class MultiRateDecimator {
+  struct Tap {
+    XyzDecimator<N, T> decimator;
+    int8_t source;          // tap fed from, -1 for the input
+    bool enabled;
+    uint16_t count;
+    q15_t xyz[3 * MAX_BLOCK];
+    uint16_t positions[MAX_BLOCK];
+  };
+  Tap _taps[TAPS];
+
+public:
+  MultiRateDecimator() {
+    for (int i = 0; i < TAPS; i++) {
+      _taps[i].enabled = false;
+      _taps[i].count = 0;
+    }
+  }
+
+  // Tap `tap` takes every factor-th sample of tap `source` (an earlier tap,
+  // or -1 for the input) through the anti-alias filters. Returns false if
+  // the factor is out of range, leaving the tap off.
+  bool configure(int tap, int source, uint32_t factor, float passband = 0.2f) {
+    Tap& t = _taps[tap];
+    t.enabled = source < tap && t.decimator.configure(factor, passband);
+    t.source = source;
+    t.count = 0;
+    return t.enabled;
+  }
+
+  void disable(int tap) {
+    _taps[tap].enabled = false;
+    _taps[tap].count = 0;
+  }
+
+  void process(const q15_t* xyz, uint16_t count) {
+    if (count > MAX_BLOCK) {
+      count = MAX_BLOCK;
+    }
+    for (int i = 0; i < TAPS; i++) {
+      Tap& t = _taps[i];
+      t.count = 0;
+      if (!t.enabled || (t.source >= 0 && !_taps[t.source].enabled)) {
+        continue;
+      }
+      if (t.source < 0) {
+        t.count = t.decimator.process(xyz, count, t.xyz, t.positions);
+        continue;
+      }
+      // Positions are kept in terms of the input block
+      const Tap& from = _taps[t.source];
+      t.count = t.decimator.process(from.xyz, from.count, t.xyz, t.positions);
+      for (uint16_t j = 0; j < t.count; j++) {
+        t.positions[j] = from.positions[t.positions[j]];
+      }
+    }
+  }
+
+  // Samples tap `tap` produced from the last block, and the index in that
+  // block of the input sample each one completed on
+  uint16_t output(int tap, const q15_t** xyz, const uint16_t** positions = NULL) const {
+    *xyz = _taps[tap].xyz;
+    if (positions != NULL) {
+      *positions = _taps[tap].positions;
+    }
+    return _taps[tap].count;
+  }
+};
+
+#endif //__DECIMATE_H__
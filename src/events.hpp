@@ -0,0 +1,221 @@
+#ifndef __EVENTS_H__
+#define __EVENTS_H__
+#include "mbed.h"
+#include "rtos.h"
+#include "x_nucleo_iks01a1.h"
+#include "Buffer.h"
+#include "busmanager.hpp"
+#include "metrics.hpp"
+
+// INT1 edges that can be waiting for the worker. Edges that arrive while the
+// worker is busy are coalesced into the next source read anyway.
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 8
+#endif
+#ifndef EVENT_MAX_SUBSCRIBERS
+#define EVENT_MAX_SUBSCRIBERS 4
+#endif
+// How soon after the edge the source read is due
+#ifndef EVENT_DEADLINE_US
+#define EVENT_DEADLINE_US 1000
+#endif
+// A failed source read is tried again after EVENT_RETRY_MIN_MS, doubling up
+// to EVENT_RETRY_MAX_MS, until one succeeds
+#ifndef EVENT_RETRY_MIN_MS
+#define EVENT_RETRY_MIN_MS 1
+#endif
+#ifndef EVENT_RETRY_MAX_MS
+#define EVENT_RETRY_MAX_MS 64
+#endif
+
+enum EventType {
+  EVENT_FREE_FALL = 0x01,
+  EVENT_WAKE_UP = 0x02,
+  EVENT_TAP = 0x04,
+  EVENT_TILT = 0x08,
+  EVENT_ORIENTATION = 0x10
+};
+
+struct Event {
+  EventType type;
+  uint32_t timestampUs;   // INT1 edge
+  uint32_t latencyUs;     // edge to dispatch
+  uint8_t detail;         // axis / sign / position bits from the source register
+};
+
+typedef void (*EventHandler)(const Event&);
+
+// Interrupt driven LSM6DS3 events. The INT1 ISR only timestamps the edge and
+// wakes the worker; the worker reads the source registers once per wakeup,
+// decodes every flag that is set and hands typed events to the subscribers
+// whose mask matches. Nothing polls the status registers. Edges that don't
+// fit in the queue are counted in dropped(). A source read that fails is
+// retried until it succeeds: the latch holds INT1 high until then, so
+// giving up would leave no edge for any later event.
+class EventPipeline {
+  struct Subscriber {
+    uint32_t mask;
+    EventHandler handler;
+  };
+
+  LSM6DS3* _sensor;
+  BusManager* _bus;
+  Buffer<uint32_t, EVENT_QUEUE_SIZE + 1> _edges;
+  Subscriber _subscribers[EVENT_MAX_SUBSCRIBERS];
+  int _subscriberCount;
+  uint32_t _mask;
+  volatile osThreadId _worker;
+  volatile bool _waiting;     // the worker holds an edge it hasn't served
+  Counter _dropped;
+
+  void publish(EventType type, uint8_t detail, uint32_t timestamp, uint32_t latency) {
+    Event event;
+    event.type = type;
+    event.timestampUs = timestamp;
+    event.latencyUs = latency;
+    event.detail = detail;
+    for (int i = 0; i < _subscriberCount; i++) {
+      if (_subscribers[i].mask & type) {
+        _subscribers[i].handler(event);
+      }
+    }
+  }
+
+  // One session for all four source registers
+  bool readSources(uint8_t* sources, uint32_t deadline) {
+    if (!_bus->acquire(LSM6DS3_XG_MEMS_ADDRESS, BUS_PRIORITY_HIGH, deadline)) {
+      return false;
+    }
+    IMU_6AXES_StatusTypeDef status = _sensor->Get_Event_Sources(sources, (_mask & EVENT_TILT) != 0);
+    _bus->release(LSM6DS3_XG_MEMS_ADDRESS);
+    return status == IMU_6AXES_OK;
+  }
+
+  // False if the sources couldn't be read, the latch still holds them
+  bool dispatch(uint32_t timestamp, uint32_t deadline) {
+    uint8_t sources[4];
+    if (!readSources(sources, deadline)) {
+      return false;
+    }
+
+    uint32_t latency = us_ticker_read() - timestamp;
+    if (sources[0] & LSM6DS3_XG_WAKE_UP_SRC_FF_IA_MASK) {
+      publish(EVENT_FREE_FALL, 0, timestamp, latency);
+    }
+    if (sources[0] & LSM6DS3_XG_WAKE_UP_SRC_WU_IA_MASK) {
+      publish(EVENT_WAKE_UP, sources[0] & 0x07, timestamp, latency);
+    }
+    if (sources[1] & LSM6DS3_XG_TAP_SRC_TAP_IA_MASK) {
+      publish(EVENT_TAP, sources[1] & LSM6DS3_XG_TAP_SRC_AXES_MASK, timestamp, latency);
+    }
+    if (sources[2] & LSM6DS3_XG_D6D_SRC_D6D_IA_MASK) {
+      publish(EVENT_ORIENTATION, sources[2] & LSM6DS3_XG_D6D_SRC_POSITION_MASK, timestamp, latency);
+    }
+    if (sources[3] & LSM6DS3_XG_FUNC_SRC_TILT_IA_MASK) {
+      publish(EVENT_TILT, 0, timestamp, latency);
+    }
+    return true;
+  }
+
+public:
+  static const int32_t SIGNAL = 0x01;
+
+  EventPipeline(LSM6DS3* sensor, BusManager* bus)
+    : _sensor(sensor), _bus(bus), _subscriberCount(0), _mask(0), _worker(NULL), _waiting(false) {};
+
+  // Register before configure(), the subscriber table isn't locked
+  bool subscribe(uint32_t mask, EventHandler handler) {
+    if (_subscriberCount == EVENT_MAX_SUBSCRIBERS) {
+      return false;
+    }
+    _subscribers[_subscriberCount].mask = mask;
+    _subscribers[_subscriberCount].handler = handler;
+    _subscriberCount++;
+    _mask |= mask;
+    return true;
+  }
+
+  // Turn on only the detectors someone listens to, latched so short events
+  // like a tap are still in the source registers when the worker reads them
+  bool configure() {
+    if (_sensor == NULL || _sensor->Enable_Event_Latch() != IMU_6AXES_OK) {
+      return false;
+    }
+    if ((_mask & EVENT_FREE_FALL) && _sensor->Enable_Free_Fall_Detection() != IMU_6AXES_OK) {
+      return false;
+    }
+    if ((_mask & EVENT_WAKE_UP) && _sensor->Enable_Wake_Up_Detection() != IMU_6AXES_OK) {
+      return false;
+    }
+    if ((_mask & EVENT_TAP) && _sensor->Enable_Single_Tap_Detection() != IMU_6AXES_OK) {
+      return false;
+    }
+    if ((_mask & EVENT_TILT) && _sensor->Enable_Tilt_Detection() != IMU_6AXES_OK) {
+      return false;
+    }
+    return true;
+  }
+
+  // INT1 ISR: timestamp and wake the worker, no bus traffic here. Also
+  // from a thread that found INT1 was an event after all, with the edge's
+  // time.
+  void onInterrupt() {
+    onInterrupt(us_ticker_read());
+  }
+
+  void onInterrupt(uint32_t edgeUs) {
+    if (!_edges.push(edgeUs)) {
+      _dropped.increment();
+    }
+    if (_worker != NULL) {
+      osSignalSet(_worker, SIGNAL);
+    }
+  }
+
+  // True while an edge is queued or its source read not yet done, so INT1
+  // being high is already accounted for
+  bool pending() {
+    return _waiting || _edges.size() > 0;
+  }
+
+  // Since start, for the metrics registry
+  const Counter& dropped() const {
+    return _dropped;
+  }
+
+  // Worker thread body. All queued edges are served by one source read,
+  // stamped with the oldest edge, retried with backoff until it succeeds.
+  void run() {
+    _worker = osThreadGetId();
+    uint32_t first = 0;
+    uint32_t backoff = EVENT_RETRY_MIN_MS;
+    while (true) {
+      uint32_t edge;
+      while (_edges.pop(edge)) {
+        if (!_waiting) {
+          first = edge;
+          _waiting = true;
+        }
+      }
+      if (_waiting) {
+        uint32_t deadline = backoff == EVENT_RETRY_MIN_MS ? first + EVENT_DEADLINE_US
+                                                          : us_ticker_read() + EVENT_DEADLINE_US;
+        if (dispatch(first, deadline)) {
+          _waiting = false;
+          backoff = EVENT_RETRY_MIN_MS;
+        } else {
+          Thread::signal_wait(SIGNAL, backoff);
+          backoff = backoff < EVENT_RETRY_MAX_MS ? backoff * 2 : EVENT_RETRY_MAX_MS;
+          continue;
+        }
+      }
+      Thread::signal_wait(SIGNAL);
+    }
+  }
+
+  static void thread(void const* pipeline) {
+    ((EventPipeline*) pipeline)->run();
+  }
+};
+
+#endif //__EVENTS_H__
@@ -0,0 +1,318 @@
+#ifndef __FILTER_H__
+#define __FILTER_H__
+#include <stdint.h>
+#include <math.h>
+#include "data.hpp"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Fixed point helpers. Samples are raw sensor LSBs or mg, both fit in Q15
+// (int16) for the accelerometer ranges we use; Q31 is there for streams
+// that have been scaled up or accumulated.
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+
+inline q15_t saturate15(int64_t value) {
+  return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : (q15_t) value;
+}
+
+inline q31_t saturate31(int64_t value) {
+  return value > INT32_MAX ? INT32_MAX : value < INT32_MIN ? INT32_MIN : (q31_t) value;
+}
+
+// Highest cutoff a design takes, as a fraction of the sample rate. At
+// Nyquist (0.5) the poles reach the unit circle and past it the filter runs
+// away, so a cutoff above this at a low rate is brought down to it. Half of
+// Nyquist keeps the quantised recursion within 1 LSB of a steady input.
+#ifndef BIQUAD_MAX_CUTOFF
+#define BIQUAD_MAX_CUTOFF 0.25f
+#endif
+
+// Normalised biquad coefficients (a0 == 1), designed in float at configuration
+// time only and quantised for the fixed point kernels
+struct BiquadCoeffs {
+  float b0, b1, b2, a1, a2;
+
+  static float limitCutoff(float cutoff, float sampleRate) {
+    return cutoff < BIQUAD_MAX_CUTOFF * sampleRate ? cutoff : BIQUAD_MAX_CUTOFF * sampleRate;
+  }
+
+  // Both poles inside the unit circle (the stability triangle)
+  bool stable() const {
+    return fabsf(a2) < 1.0f && fabsf(a1) < 1.0f + a2;
+  }
+
+  // RBJ cookbook 2nd order low pass, q = 0.7071 for Butterworth
+  static BiquadCoeffs lowPass(float cutoff, float sampleRate, float q = 0.7071f) {
+    float w0 = 2.0f * (float) M_PI * limitCutoff(cutoff, sampleRate) / sampleRate;
+    float alpha = sinf(w0) / (2.0f * q);
+    float cosw0 = cosf(w0);
+    float a0 = 1.0f + alpha;
+    BiquadCoeffs c;
+    c.b0 = (1.0f - cosw0) / 2.0f / a0;
+    c.b1 = (1.0f - cosw0) / a0;
+    c.b2 = c.b0;
+    c.a1 = -2.0f * cosw0 / a0;
+    c.a2 = (1.0f - alpha) / a0;
+    return c;
+  }
+
+  // RBJ cookbook 2nd order high pass
+  static BiquadCoeffs highPass(float cutoff, float sampleRate, float q = 0.7071f) {
+    float w0 = 2.0f * (float) M_PI * limitCutoff(cutoff, sampleRate) / sampleRate;
+    float alpha = sinf(w0) / (2.0f * q);
+    float cosw0 = cosf(w0);
+    float a0 = 1.0f + alpha;
+    BiquadCoeffs c;
+    c.b0 = (1.0f + cosw0) / 2.0f / a0;
+    c.b1 = -(1.0f + cosw0) / a0;
+    c.b2 = c.b0;
+    c.a1 = -2.0f * cosw0 / a0;
+    c.a2 = (1.0f - alpha) / a0;
+    return c;
+  }
+};
+
+// Direct form I biquad on Q15 samples. Coefficients are Q30 so a low
+// cutoff against a high rate keeps its precision (b0 is ~2.4e-4 at 2Hz of
+// 400Hz), products and sum go in 64 bits. The fraction the output drops is
+// fed into the next sample (first order error feedback), without which the
+// recursion stalls short of small inputs and holds a dead band around zero.
+class BiquadQ15 {
+  int32_t _b0, _b1, _b2, _a1, _a2;
+  q15_t _x1, _x2, _y1, _y2;
+  int64_t _error;
+
+  static int32_t toQ30(float c) {
+    return saturate31((int64_t) llrintf(c * 1073741824.0f));
+  }
+
+public:
+  BiquadQ15() : _b0(1 << 30), _b1(0), _b2(0), _a1(0), _a2(0), _x1(0), _x2(0), _y1(0), _y2(0), _error(0) {};
+  BiquadQ15(const BiquadCoeffs& c) : _x1(0), _x2(0), _y1(0), _y2(0), _error(0) {
+    configure(c);
+  }
+
+  // An unstable set is refused and the filter passes samples through
+  bool configure(const BiquadCoeffs& c) {
+    if (!c.stable()) {
+      _b0 = 1 << 30;
+      _b1 = _b2 = _a1 = _a2 = 0;
+      return false;
+    }
+    _b0 = toQ30(c.b0);
+    _b1 = toQ30(c.b1);
+    _b2 = toQ30(c.b2);
+    _a1 = toQ30(c.a1);
+    _a2 = toQ30(c.a2);
+    return true;
+  }
+
+  void reset() {
+    _x1 = _x2 = _y1 = _y2 = 0;
+    _error = 0;
+  }
+
+  q15_t process(q15_t x) {
+    int64_t acc = (int64_t) _b0 * x + (int64_t) _b1 * _x1 + (int64_t) _b2 * _x2
+                - (int64_t) _a1 * _y1 - (int64_t) _a2 * _y2 + _error;
+    int64_t whole = acc >> 30;
+    q15_t y = saturate15(whole);
+    // A clipped output has nothing worth carrying
+    _error = y == whole ? acc - (whole << 30) : 0;
+    _x2 = _x1;
+    _x1 = x;
+    _y2 = _y1;
+    _y1 = y;
+    return y;
+  }
+
+  // Block entry point, `stride` walks one axis of interleaved X/Y/Z data.
+  // In place processing (in == out) is fine.
+  void process(const q15_t* in, q15_t* out, uint16_t count, uint8_t stride = 1) {
+    for (uint16_t i = 0; i < count; i++) {
+      out[i * stride] = process(in[i * stride]);
+    }
+  }
+};
+
+// Direct form I biquad on Q31 samples with Q30 coefficients. Each product is
+// scaled back before accumulating so the 64 bit sum has headroom.
+class BiquadQ31 {
+  int32_t _b0, _b1, _b2, _a1, _a2;
+  q31_t _x1, _x2, _y1, _y2;
+
+  static int32_t toQ30(float c) {
+    return saturate31((int64_t) llrintf(c * 1073741824.0f));
+  }
+
+public:
+  BiquadQ31() : _b0(1 << 30), _b1(0), _b2(0), _a1(0), _a2(0), _x1(0), _x2(0), _y1(0), _y2(0) {};
+  BiquadQ31(const BiquadCoeffs& c) : _x1(0), _x2(0), _y1(0), _y2(0) {
+    configure(c);
+  }
+
+  // An unstable set is refused and the filter passes samples through
+  bool configure(const BiquadCoeffs& c) {
+    if (!c.stable()) {
+      _b0 = 1 << 30;
+      _b1 = _b2 = _a1 = _a2 = 0;
+      return false;
+    }
+    _b0 = toQ30(c.b0);
+    _b1 = toQ30(c.b1);
+    _b2 = toQ30(c.b2);
+    _a1 = toQ30(c.a1);
+    _a2 = toQ30(c.a2);
+    return true;
+  }
+
+  void reset() {
+    _x1 = _x2 = _y1 = _y2 = 0;
+  }
+
+  q31_t process(q31_t x) {
+    int64_t acc = (((int64_t) _b0 * x) >> 30) + (((int64_t) _b1 * _x1) >> 30)
+                + (((int64_t) _b2 * _x2) >> 30) - (((int64_t) _a1 * _y1) >> 30)
+                - (((int64_t) _a2 * _y2) >> 30);
+    q31_t y = saturate31(acc);
+    _x2 = _x1;
+    _x1 = x;
+    _y2 = _y1;
+    _y1 = y;
+    return y;
+  }
+
+  void process(const q31_t* in, q31_t* out, uint16_t count, uint8_t stride = 1) {
+    for (uint16_t i = 0; i < count; i++) {
+      out[i * stride] = process(in[i * stride]);
+    }
+  }
+};
+
+// FIR on Q15 samples with Q15 taps. The delay line is stored twice so the
+// newest N samples are always contiguous and the dot product needs no modulo.
+template <int N>
+class FirQ15 {
+  q15_t _taps[N];         // reversed, oldest sample first
+  q15_t _delay[2 * N];
+  int32_t _pos;
+
+public:
+  FirQ15() : _pos(0) {
+    for (int i = 0; i < N; i++) {
+      _taps[i] = 0;
+    }
+    _taps[N - 1] = INT16_MAX;
+    reset();
+  }
+
+  FirQ15(const q15_t* taps) : _pos(0) {
+    configure(taps);
+    reset();
+  }
+
+  // taps[0] applies to the newest sample
+  void configure(const q15_t* taps) {
+    for (int i = 0; i < N; i++) {
+      _taps[i] = taps[N - 1 - i];
+    }
+  }
+
+  void reset() {
+    for (int i = 0; i < 2 * N; i++) {
+      _delay[i] = 0;
+    }
+    _pos = 0;
+  }
+
+  q15_t process(q15_t x) {
+    _delay[_pos] = x;
+    _delay[_pos + N] = x;
+    const q15_t* window = &_delay[_pos + 1];
+    int64_t acc = 0;
+    for (int i = 0; i < N; i++) {
+      acc += (int32_t) _taps[i] * window[i];
+    }
+    _pos = _pos + 1 == N ? 0 : _pos + 1;
+    return saturate15(acc >> 15);
+  }
+
+  void process(const q15_t* in, q15_t* out, uint16_t count, uint8_t stride = 1) {
+    for (uint16_t i = 0; i < count; i++) {
+      out[i * stride] = process(in[i * stride]);
+    }
+  }
+};
+
+// First order DC blocker, y[n] = x[n] - x[n-1] + R * y[n-1], R in Q15.
+// R = 0.995 puts the corner at ~fs/1250.
+class DcBlockerQ15 {
+  int16_t _r;
+  q15_t _x1;
+  int32_t _y1;
+
+public:
+  DcBlockerQ15(float r = 0.995f) : _r(saturate15((int64_t) lrintf(r * 32768.0f))), _x1(0), _y1(0) {};
+
+  void reset() {
+    _x1 = 0;
+    _y1 = 0;
+  }
+
+  q15_t process(q15_t x) {
+    int32_t y = (int32_t) x - _x1 + (int32_t) (((int64_t) _r * _y1) >> 15);
+    _x1 = x;
+    _y1 = y;
+    return saturate15(y);
+  }
+
+  void process(const q15_t* in, q15_t* out, uint16_t count, uint8_t stride = 1) {
+    for (uint16_t i = 0; i < count; i++) {
+      out[i * stride] = process(in[i * stride]);
+    }
+  }
+};
+
+// Configurable per-stream filter stage: optional DC removal followed by a
+// biquad on each axis. Each stream owns its own instance and coefficients.
+class StreamFilter {
+  BiquadQ15 _axis[3];
+  DcBlockerQ15 _dc[3];
+  bool _removeDc;
+
+public:
+  StreamFilter() : _removeDc(false) {};
+
+  // False if the coefficients were unstable and refused
+  bool configure(const BiquadCoeffs& c, bool removeDc = false) {
+    bool stable = true;
+    for (int i = 0; i < 3; i++) {
+      stable = _axis[i].configure(c) && stable;
+      _axis[i].reset();
+      _dc[i].reset();
+    }
+    _removeDc = removeDc;
+    return stable;
+  }
+
+  // Interleaved X/Y/Z block, as read from the sensor FIFO
+  void process(q15_t* xyz, uint16_t count) {
+    for (int axis = 0; axis < 3; axis++) {
+      if (_removeDc) {
+        _dc[axis].process(xyz + axis, xyz + axis, count, 3);
+      }
+      _axis[axis].process(xyz + axis, xyz + axis, count, 3);
+    }
+  }
+
+  Data process(const Data& sample) {
+    q15_t xyz[3] = { saturate15(sample.x()), saturate15(sample.y()), saturate15(sample.z()) };
+    process(xyz, 1);
+    return Data(xyz[0], xyz[1], xyz[2]);
+  }
+};
+
+#endif //__FILTER_H__
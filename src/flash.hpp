@@ -0,0 +1,203 @@
+#ifndef __FLASH_H__
+#define __FLASH_H__
+#include "mbed.h"
+
+// A run of equally sized flash sectors with NOR semantics: erase sets a
+// whole sector to 0xFF, programming can only clear bits and works in 4 byte
+// words at 4 byte aligned addresses. Addresses are relative to the region.
+class FlashDevice {
+public:
+  virtual ~FlashDevice() {};
+
+  virtual uint32_t sectorSize() const = 0;
+  virtual uint32_t sectorCount() const = 0;
+  virtual bool read(uint32_t address, void* data, uint32_t size) = 0;
+  virtual bool program(uint32_t address, const void* data, uint32_t size) = 0;
+  virtual bool erase(uint32_t sector) = 0;
+};
+
+#if defined(TARGET_STM32F4)
+// End of the firmware image, from the GCC_ARM linker script
+extern "C" char __etext[];
+
+// Internal flash sectors through the STM32 HAL. On the F401 sectors 5-7 are
+// 128KB each and nothing lives there as long as the image stays under
+// 128KB; the constructor refuses a region the image reaches into.
+//
+// There is only one bank, so the CPU stalls on instruction fetches while a
+// program or erase runs. A sector erase takes about a second, during which
+// no ISR runs either: the LSM6DS3 FIFO rides through it, Ticker sampling
+// loses those samples.
+class Stm32Flash : public FlashDevice {
+  static const uint32_t SECTOR_SIZE = 128 * 1024;
+  static const uint32_t FIRST_128K_SECTOR = 5;
+  static const uint32_t FIRST_128K_ADDRESS = 0x08020000;
+
+  uint32_t _firstSector;
+  uint32_t _count;
+  uint32_t _base;
+
+public:
+  Stm32Flash(uint32_t firstSector, uint32_t count)
+      : _firstSector(firstSector), _count(count),
+        _base(FIRST_128K_ADDRESS + (firstSector - FIRST_128K_SECTOR) * SECTOR_SIZE) {
+    if (firstSector < FIRST_128K_SECTOR || firstSector + count > FIRST_128K_SECTOR + 3 ||
+        (uint32_t) __etext > _base) {
+      _count = 0;
+    }
+  }
+
+  uint32_t sectorSize() const {
+    return SECTOR_SIZE;
+  }
+
+  uint32_t sectorCount() const {
+    return _count;
+  }
+
+  // Memory mapped
+  bool read(uint32_t address, void* data, uint32_t size) {
+    memcpy(data, (const void*) (_base + address), size);
+    return true;
+  }
+
+  bool program(uint32_t address, const void* data, uint32_t size) {
+    if ((address | size) & 3) {
+      return false;
+    }
+    const uint8_t* bytes = (const uint8_t*) data;
+    bool ok = true;
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    for (uint32_t i = 0; i < size && ok; i += 4) {
+      uint32_t word;
+      memcpy(&word, bytes + i, 4);
+      ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, _base + address + i, word) == HAL_OK;
+    }
+    HAL_FLASH_Lock();
+    return ok;
+  }
+
+  bool erase(uint32_t sector) {
+    FLASH_EraseInitTypeDef erase;
+    uint32_t failed = 0;
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+    erase.Sector = _firstSector + sector;
+    erase.NbSectors = 1;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                           FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+    bool ok = HAL_FLASHEx_Erase(&erase, &failed) == HAL_OK;
+    HAL_FLASH_Lock();
+    return ok;
+  }
+};
+
+#else
+// Flash emulated in a file, for host runs and tests. Enforces the NOR rules
+// (programming ANDs into what is there, alignment), takes about as long as
+// the F401 does, counts erases per sector, and can cut the power: after
+// failAfter() more programmed words every program call fails, having written
+// only what came before, the way a brown-out tears a write.
+class FileFlash : public FlashDevice {
+  static const uint32_t MAX_SECTORS = 16;
+  static const uint32_t PROGRAM_WORD_US = 16;
+  static const uint32_t ERASE_US_PER_KB = 8000;
+
+  FILE* _file;
+  uint32_t _sectorSize;
+  uint32_t _count;
+  uint32_t _erases[MAX_SECTORS];
+  int32_t _wordsLeft;
+
+public:
+  FileFlash(const char* path, uint32_t sectorSize, uint32_t count)
+      : _sectorSize(sectorSize), _count(count > MAX_SECTORS ? MAX_SECTORS : count), _wordsLeft(-1) {
+    memset(_erases, 0, sizeof(_erases));
+    _file = fopen(path, "r+b");
+    if (_file == NULL) {
+      _file = fopen(path, "w+b");
+      for (uint32_t i = 0; _file != NULL && i < _count * _sectorSize; i++) {
+        fputc(0xFF, _file);
+      }
+    }
+    if (_file == NULL) {
+      _count = 0;
+    }
+  }
+
+  ~FileFlash() {
+    if (_file != NULL) {
+      fclose(_file);
+    }
+  }
+
+  uint32_t sectorSize() const {
+    return _sectorSize;
+  }
+
+  uint32_t sectorCount() const {
+    return _count;
+  }
+
+  uint32_t erases(uint32_t sector) const {
+    return sector < _count ? _erases[sector] : 0;
+  }
+
+  // Negative runs forever
+  void failAfter(int32_t words) {
+    _wordsLeft = words;
+  }
+
+  bool read(uint32_t address, void* data, uint32_t size) {
+    if (address + size > _count * _sectorSize) {
+      return false;
+    }
+    fseek(_file, address, SEEK_SET);
+    return fread(data, 1, size, _file) == size;
+  }
+
+  bool program(uint32_t address, const void* data, uint32_t size) {
+    if (((address | size) & 3) || address + size > _count * _sectorSize) {
+      return false;
+    }
+    const uint8_t* bytes = (const uint8_t*) data;
+    for (uint32_t i = 0; i < size; i += 4) {
+      if (_wordsLeft == 0) {
+        return false;
+      }
+      if (_wordsLeft > 0) {
+        _wordsLeft--;
+      }
+      uint8_t word[4];
+      read(address + i, word, 4);
+      for (int b = 0; b < 4; b++) {
+        word[b] &= bytes[i + b];
+      }
+      fseek(_file, address + i, SEEK_SET);
+      fwrite(word, 1, 4, _file);
+    }
+    fflush(_file);
+    wait_us(size / 4 * PROGRAM_WORD_US);
+    return true;
+  }
+
+  bool erase(uint32_t sector) {
+    if (sector >= _count || _wordsLeft == 0) {
+      return false;
+    }
+    fseek(_file, sector * _sectorSize, SEEK_SET);
+    for (uint32_t i = 0; i < _sectorSize; i++) {
+      fputc(0xFF, _file);
+    }
+    fflush(_file);
+    _erases[sector]++;
+    wait_us(_sectorSize / 1024 * ERASE_US_PER_KB);
+    return true;
+  }
+};
+#endif
+
+#endif //__FLASH_H__
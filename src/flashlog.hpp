@@ -0,0 +1,396 @@
+#ifndef __FLASHLOG_H__
+#define __FLASHLOG_H__
+#include <stdint.h>
+#include <string.h>
+#include "flash.hpp"
+
+#ifndef FLASH_LOG_MAX_SECTORS
+#define FLASH_LOG_MAX_SECTORS 8
+#endif
+#ifndef FLASH_LOG_MAX_BLOCK
+#define FLASH_LOG_MAX_BLOCK 1024
+#endif
+
+// Where a reader is in the log
+struct FlashLogCursor {
+  uint32_t sector;      // sector sequence number, not index
+  uint32_t offset;
+  uint32_t fromBlock;   // blocks before this are skipped
+};
+
+struct FlashLogInfo {
+  uint32_t blocks;      // committed or torn blocks still in flash
+  uint32_t usedBytes;
+  uint32_t capacityBytes;
+  uint32_t minErases;
+  uint32_t maxErases;
+  uint32_t badSectors;
+};
+
+// Log structured ring of blocks over a FlashDevice.
+//
+// Each sector starts with a header carrying its place in the ring (a
+// sequence number that only grows), its erase count and the sequence number
+// of its first block, padded to 24 bytes so payloads whose length is a
+// multiple of 8 stay 8 byte aligned. Blocks are appended behind it:
+//
+//   word 0  0xB10C << 16 | payload length
+//   word 1  block sequence number
+//   word 2  CRC-32 of the payload
+//   word 3  commit, programmed to 0 once the payload is in
+//   payload, padded to 4 bytes
+//
+// Crash safety comes from the write order. A block whose commit word is
+// still erased was torn and is skipped; its length is known, so appending
+// carries on behind it. A header that doesn't parse (torn in word 0) seals
+// the sector and appending moves to the next one. A sector whose own header
+// doesn't check out was torn while being recycled and is erased again.
+//
+// Mounting reads the sector headers and walks block headers in the newest
+// sector only, never a payload. When the ring is full the oldest sector is
+// erased next, so every sector is erased once per lap and wear stays level;
+// a sector that fails to erase or program is skipped from then on.
+class FlashLog {
+  static const uint32_t SECTOR_MAGIC = 0x474F4C46;   // "FLOG"
+  static const uint32_t BLOCK_MAGIC = 0xB10C;
+  static const uint32_t SECTOR_HEADER = 24;
+  static const uint32_t BLOCK_HEADER = 16;
+  static const uint32_t COMMITTED = 0;
+
+  struct Sector {
+    bool valid;
+    bool bad;
+    uint32_t sequence;
+    uint32_t erases;
+    uint32_t firstBlock;
+  };
+
+  FlashDevice& _device;
+  Sector _sectors[FLASH_LOG_MAX_SECTORS];
+  uint32_t _count;
+  int32_t _head;          // sector being appended to, -1 when empty
+  uint32_t _offset;       // append offset in the head sector
+  uint32_t _nextBlock;
+
+  static uint32_t pad(uint32_t length) {
+    return (length + 3) & ~3u;
+  }
+
+  static uint32_t crc32(const uint8_t* data, uint32_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < length; i++) {
+      crc ^= data[i];
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+      }
+    }
+    return ~crc;
+  }
+
+  static uint32_t sectorCheck(const uint32_t* header) {
+    return ~(header[0] ^ header[1] ^ header[2] ^ header[3]);
+  }
+
+  void readSector(uint32_t index) {
+    uint32_t header[6];
+    Sector& sector = _sectors[index];
+    sector.valid = _device.read(index * _device.sectorSize(), header, sizeof(header)) &&
+                   header[0] == SECTOR_MAGIC && header[4] == sectorCheck(header);
+    sector.sequence = header[1];
+    sector.erases = sector.valid ? header[2] : 0;
+    sector.firstBlock = header[3];
+  }
+
+  // Formatted sectors have a header with sequence 0 to keep their count
+  bool used(uint32_t index) const {
+    return _sectors[index].valid && _sectors[index].sequence != 0;
+  }
+
+  int32_t find(uint32_t sequence) const {
+    for (uint32_t i = 0; i < _count; i++) {
+      if (used(i) && _sectors[i].sequence == sequence) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  int32_t oldest() const {
+    int32_t result = -1;
+    for (uint32_t i = 0; i < _count; i++) {
+      if (used(i) && (result < 0 || _sectors[i].sequence < _sectors[result].sequence)) {
+        result = i;
+      }
+    }
+    return result;
+  }
+
+  // Erase counts are known for sectors with a header, and for any erased
+  // since mount
+  uint32_t maxErases() const {
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < _count; i++) {
+      if (_sectors[i].erases > result) {
+        result = _sectors[i].erases;
+      }
+    }
+    return result;
+  }
+
+  // Recycle the sector after the head, skipping bad ones
+  bool advance() {
+    uint32_t sequence = _head < 0 ? 1 : _sectors[_head].sequence + 1;
+    uint32_t erases = maxErases();
+    // An empty log starts on the least worn sector
+    uint32_t first = _head + 1;
+    for (uint32_t i = 0; _head < 0 && i < _count; i++) {
+      if (_sectors[i].erases < _sectors[first].erases) {
+        first = i;
+      }
+    }
+    for (uint32_t tries = 0; tries < _count; tries++) {
+      uint32_t index = (first + tries) % _count;
+      Sector& sector = _sectors[index];
+      if (sector.bad) {
+        continue;
+      }
+      // A sector that lost its header lost its count, assume the worst one
+      uint32_t count = sector.erases ? sector.erases + 1 : (erases ? erases : 1);
+      sector.valid = false;
+      uint32_t header[6] = { SECTOR_MAGIC, sequence, count, _nextBlock, 0, 0xFFFFFFFF };
+      header[4] = sectorCheck(header);
+      if (!_device.erase(index) ||
+          !_device.program(index * _device.sectorSize(), header, sizeof(header))) {
+        sector.bad = true;
+        continue;
+      }
+      sector.valid = true;
+      sector.sequence = sequence;
+      sector.erases = count;
+      sector.firstBlock = _nextBlock;
+      _head = index;
+      _offset = SECTOR_HEADER;
+      return true;
+    }
+    return false;
+  }
+
+  // Block header at `offset` of sector `index`. Returns false at the end of
+  // the sector's blocks, erased space or a header that doesn't parse.
+  bool readBlock(uint32_t index, uint32_t offset, uint32_t* header) {
+    if (offset + BLOCK_HEADER > _device.sectorSize() ||
+        !_device.read(index * _device.sectorSize() + offset, header, BLOCK_HEADER)) {
+      return false;
+    }
+    uint32_t length = header[0] & 0xFFFF;
+    return (header[0] >> 16) == BLOCK_MAGIC && length <= FLASH_LOG_MAX_BLOCK &&
+           offset + BLOCK_HEADER + pad(length) <= _device.sectorSize();
+  }
+
+  // Move the cursor past the next committed block from fromBlock on,
+  // returning its header and address
+  bool step(FlashLogCursor& cursor, uint32_t* header, uint32_t* address) {
+    while (_head >= 0 && cursor.sector <= _sectors[_head].sequence) {
+      int32_t index = find(cursor.sector);
+      if (index < 0 || !readBlock(index, cursor.offset, header)) {
+        // Recycled since, or the end of this sector's blocks
+        int32_t start = oldest();
+        cursor.sector = start >= 0 && _sectors[start].sequence > cursor.sector + 1 ? _sectors[start].sequence
+                                                                                   : cursor.sector + 1;
+        cursor.offset = SECTOR_HEADER;
+        continue;
+      }
+      *address = index * _device.sectorSize() + cursor.offset;
+      cursor.offset += BLOCK_HEADER + pad(header[0] & 0xFFFF);
+      if (header[3] == COMMITTED && header[1] >= cursor.fromBlock) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+public:
+  FlashLog(FlashDevice& device) : _device(device), _count(0), _head(-1), _offset(0), _nextBlock(0) {
+    memset(_sectors, 0, sizeof(_sectors));
+  };
+
+  // Find the newest sector and the append point in it. Returns false if the
+  // device has no usable sectors.
+  bool mount() {
+    _count = _device.sectorCount() > FLASH_LOG_MAX_SECTORS ? FLASH_LOG_MAX_SECTORS : _device.sectorCount();
+    _head = -1;
+    _nextBlock = 0;
+    for (uint32_t i = 0; i < _count; i++) {
+      _sectors[i].bad = false;
+      readSector(i);
+      if (used(i) && (_head < 0 || _sectors[i].sequence > _sectors[_head].sequence)) {
+        _head = i;
+      }
+    }
+    if (_head < 0) {
+      return _count > 0;
+    }
+
+    uint32_t header[4] = { 0xFFFFFFFF };
+    uint32_t blocks = 0;
+    _offset = SECTOR_HEADER;
+    while (readBlock(_head, _offset, header)) {
+      _offset += BLOCK_HEADER + pad(header[0] & 0xFFFF);
+      blocks++;
+    }
+    if (_offset + BLOCK_HEADER <= _device.sectorSize() && header[0] != 0xFFFFFFFF) {
+      // Torn header, nothing more goes into this sector
+      _offset = _device.sectorSize();
+    }
+    _nextBlock = _sectors[_head].firstBlock + blocks;
+    return true;
+  }
+
+  // Erase everything, leaving each sector a header that only keeps its
+  // erase count
+  bool format() {
+    uint32_t erases = maxErases();
+    bool ok = true;
+    for (uint32_t i = 0; i < _count; i++) {
+      Sector& sector = _sectors[i];
+      sector.erases = sector.erases ? sector.erases + 1 : (erases ? erases : 1);
+      sector.sequence = 0;
+      sector.firstBlock = 0;
+      uint32_t header[6] = { SECTOR_MAGIC, 0, sector.erases, 0, 0, 0xFFFFFFFF };
+      header[4] = sectorCheck(header);
+      sector.valid = _device.erase(i) && _device.program(i * _device.sectorSize(), header, sizeof(header));
+      if (!sector.valid) {
+        sector.bad = true;
+        ok = false;
+      }
+    }
+    _head = -1;
+    _nextBlock = 0;
+    return ok;
+  }
+
+  // Append one block, moving to (and erasing) the next sector when it
+  // doesn't fit. A false return means the block is not in flash.
+  bool append(const void* data, uint16_t length) {
+    if (_count == 0 || length > FLASH_LOG_MAX_BLOCK ||
+        SECTOR_HEADER + BLOCK_HEADER + pad(length) > _device.sectorSize()) {
+      return false;
+    }
+    if ((_head < 0 || _offset + BLOCK_HEADER + pad(length) > _device.sectorSize()) && !advance()) {
+      return false;
+    }
+
+    uint32_t address = _head * _device.sectorSize() + _offset;
+    uint32_t header[3] = { BLOCK_MAGIC << 16 | length, _nextBlock, crc32((const uint8_t*) data, length) };
+    // Whatever happens from here the space is spent
+    _offset += BLOCK_HEADER + pad(length);
+    _nextBlock++;
+    if (!_device.program(address, header, sizeof(header))) {
+      return false;
+    }
+
+    uint32_t whole = length & ~3u;
+    if (whole > 0 && !_device.program(address + BLOCK_HEADER, data, whole)) {
+      return false;
+    }
+    if (whole < length) {
+      uint8_t tail[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+      memcpy(tail, (const uint8_t*) data + whole, length - whole);
+      if (!_device.program(address + BLOCK_HEADER + whole, tail, 4)) {
+        return false;
+      }
+    }
+    uint32_t commit = COMMITTED;
+    return _device.program(address + BLOCK_HEADER - 4, &commit, 4);
+  }
+
+  // Start reading at the oldest block still in flash, or at block
+  // `fromBlock` if that is newer
+  void begin(FlashLogCursor& cursor, uint32_t fromBlock = 0) const {
+    int32_t start = oldest();
+    cursor.sector = start < 0 ? 0 : _sectors[start].sequence;
+    cursor.offset = SECTOR_HEADER;
+    cursor.fromBlock = fromBlock;
+    // Jump straight to the sector holding fromBlock
+    for (uint32_t i = 0; i < _count; i++) {
+      if (used(i) && _sectors[i].firstBlock <= fromBlock && _sectors[i].sequence > cursor.sector) {
+        cursor.sector = _sectors[i].sequence;
+      }
+    }
+  }
+
+  // Copy the next intact block into `data`, torn and corrupt blocks are
+  // skipped. Returns false at the end of the log. `blockNumber` is optional.
+  bool next(FlashLogCursor& cursor, void* data, uint16_t size, uint16_t* length, uint32_t* blockNumber = NULL) {
+    uint32_t header[4];
+    uint32_t address;
+    while (step(cursor, header, &address)) {
+      uint16_t blockLength = header[0] & 0xFFFF;
+      if (blockLength > size || !_device.read(address + BLOCK_HEADER, data, blockLength) ||
+          crc32((const uint8_t*) data, blockLength) != header[2]) {
+        continue;
+      }
+      *length = blockLength;
+      if (blockNumber != NULL) {
+        *blockNumber = header[1];
+      }
+      return true;
+    }
+    return false;
+  }
+
+  // Copy up to `size` bytes from the start of the next committed block
+  // without checking its CRC, for scanning the headers payloads carry.
+  // `length` is the whole block's.
+  bool peek(FlashLogCursor& cursor, void* data, uint16_t size, uint16_t* length, uint32_t* blockNumber = NULL) {
+    uint32_t header[4];
+    uint32_t address;
+    while (step(cursor, header, &address)) {
+      uint16_t blockLength = header[0] & 0xFFFF;
+      if (!_device.read(address + BLOCK_HEADER, data, blockLength < size ? blockLength : size)) {
+        continue;
+      }
+      *length = blockLength;
+      if (blockNumber != NULL) {
+        *blockNumber = header[1];
+      }
+      return true;
+    }
+    return false;
+  }
+
+  // Sequence number the next appended block gets
+  uint32_t nextBlock() const {
+    return _nextBlock;
+  }
+
+  FlashLogInfo info() const {
+    FlashLogInfo result;
+    memset(&result, 0, sizeof(result));
+    int32_t start = oldest();
+    result.capacityBytes = _count * (_device.sectorSize() - SECTOR_HEADER);
+    result.minErases = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < _count; i++) {
+      if (_sectors[i].bad) {
+        result.badSectors++;
+      }
+      if (_sectors[i].valid) {
+        result.minErases = _sectors[i].erases < result.minErases ? _sectors[i].erases : result.minErases;
+        result.maxErases = _sectors[i].erases > result.maxErases ? _sectors[i].erases : result.maxErases;
+        if (used(i) && (int32_t) i != _head) {
+          result.usedBytes += _device.sectorSize() - SECTOR_HEADER;
+        }
+      }
+    }
+    if (_head >= 0) {
+      result.usedBytes += _offset - SECTOR_HEADER;
+      result.blocks = _nextBlock - _sectors[start].firstBlock;
+    }
+    if (result.minErases == 0xFFFFFFFF) {
+      result.minErases = 0;
+    }
+    return result;
+  }
+};
+
+#endif //__FLASHLOG_H__
@@ -0,0 +1,217 @@
+#ifndef __GYROBIAS_H__
+#define __GYROBIAS_H__
+#include <stdint.h>
+#include <string.h>
+#include "filter.hpp"
+#include "metrics.hpp"
+#include "GyroSensor.h"
+
+// Raw accelerometer samples the stillness variance is taken over, a power of
+// two
+#ifndef GYRO_STILL_WINDOW
+#define GYRO_STILL_WINDOW 16
+#endif
+// Still while the accelerometer variance, summed over the axes, stays under
+// this many mg^2: a few times the sensor's noise, far below a hand's tremor
+#ifndef GYRO_STILL_VARIANCE
+#define GYRO_STILL_VARIANCE 64
+#endif
+// and the corrected rate under this many mdps, so a steady turn that leaves
+// the accelerometer alone isn't learnt as bias
+#ifndef GYRO_STILL_MAX_MDPS
+#define GYRO_STILL_MAX_MDPS 10000
+#endif
+// Bias time constant while still, 2^x samples
+#ifndef GYRO_BIAS_SHIFT
+#define GYRO_BIAS_SHIFT 7
+#endif
+
+// Fraction bits of the bias
+#define GYRO_BIAS_Q 8
+
+// Gyroscope bias, learnt whenever the device is still.
+//
+// The gyroscope's zero rate offset drifts with temperature and integrates
+// into orientation drift. At rest the true rate is zero, so what the
+// gyroscope reads is its bias: the accelerometer says when that is, the
+// variance of its last GYRO_STILL_WINDOW raw samples being small, and gyro
+// readings taken while still are averaged into the bias. The first
+// 2^GYRO_BIAS_SHIFT are a plain mean so it settles in one rest; after that an
+// exponential average follows the drift. Integer only.
+class GyroBias {
+  q15_t _window[GYRO_STILL_WINDOW][3];
+  int64_t _sum[3];
+  int64_t _squares[3];
+  uint32_t _filled;
+  uint32_t _next;
+  int32_t _bias[3];           // mdps, Q8
+  uint32_t _updates;
+  bool _still;
+
+  static_assert((GYRO_STILL_WINDOW & (GYRO_STILL_WINDOW - 1)) == 0, "GYRO_STILL_WINDOW must be a power of two");
+
+  // Slide the window on by one sample
+  void slide(const q15_t* accel) {
+    q15_t* slot = _window[_next];
+    for (int i = 0; i < 3; i++) {
+      if (_filled == GYRO_STILL_WINDOW) {
+        _sum[i] -= slot[i];
+        _squares[i] -= (int64_t) slot[i] * slot[i];
+      }
+      slot[i] = accel[i];
+      _sum[i] += accel[i];
+      _squares[i] += (int64_t) accel[i] * accel[i];
+    }
+    _next = (_next + 1) & (GYRO_STILL_WINDOW - 1);
+    if (_filled < GYRO_STILL_WINDOW) {
+      _filled++;
+    }
+  }
+
+  // True if the window is full and its variance under the threshold
+  bool quiet() const {
+    if (_filled < GYRO_STILL_WINDOW) {
+      return false;
+    }
+    // N^2 variance = N sum(x^2) - sum(x)^2
+    int64_t spread = 0;
+    for (int i = 0; i < 3; i++) {
+      spread += GYRO_STILL_WINDOW * _squares[i] - _sum[i] * _sum[i];
+    }
+    return spread <= (int64_t) GYRO_STILL_VARIANCE * GYRO_STILL_WINDOW * GYRO_STILL_WINDOW;
+  }
+
+public:
+  GyroBias() {
+    reset();
+  };
+
+  void reset() {
+    memset(_window, 0, sizeof(_window));
+    memset(_sum, 0, sizeof(_sum));
+    memset(_squares, 0, sizeof(_squares));
+    memset(_bias, 0, sizeof(_bias));
+    _filled = _next = _updates = 0;
+    _still = false;
+  }
+
+  // Raw accelerometer samples (mg), interleaved X/Y/Z, every one of them
+  void addSamples(const q15_t* xyz, uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+      slide(&xyz[3 * i]);
+    }
+  }
+
+  // A gyroscope reading (mdps) taken after the samples added so far. Learns
+  // from it if they were still, then subtracts the bias in place.
+  void update(int32_t* gyro) {
+    _still = quiet();
+    for (int i = 0; _still && i < 3; i++) {
+      int32_t rate = gyro[i] - (_bias[i] >> GYRO_BIAS_Q);
+      _still = rate < GYRO_STILL_MAX_MDPS && rate > -GYRO_STILL_MAX_MDPS;
+    }
+    if (_still) {
+      uint32_t divisor = _updates < (1u << GYRO_BIAS_SHIFT) ? _updates + 1 : 1u << GYRO_BIAS_SHIFT;
+      for (int i = 0; i < 3; i++) {
+        _bias[i] += ((gyro[i] << GYRO_BIAS_Q) - _bias[i]) / (int32_t) divisor;
+      }
+      _updates++;
+    }
+    for (int i = 0; i < 3; i++) {
+      gyro[i] -= (_bias[i] + (1 << (GYRO_BIAS_Q - 1))) >> GYRO_BIAS_Q;
+    }
+  }
+
+  // mdps
+  int32_t bias(int axis) const {
+    return (_bias[axis] + (1 << (GYRO_BIAS_Q - 1))) >> GYRO_BIAS_Q;
+  }
+
+  bool still() const {
+    return _still;
+  }
+
+  // Still samples learnt from since start
+  uint32_t updates() const {
+    return _updates;
+  }
+};
+
+// The gyroscope with its bias taken off, standing in for the driver so
+// every reader gets corrected rates and every read teaches the bias. The
+// accelerometer side comes in through bias().addSamples().
+class BiasCorrectedGyro : public GyroSensor {
+  GyroSensor* _sensor;
+  GyroBias _bias;
+  Gauge _biasGauges[3];     // mdps
+  Gauge _still;
+
+public:
+  BiasCorrectedGyro(GyroSensor* sensor) : _sensor(sensor) {};
+
+  // False without a gyroscope to correct
+  bool present() const {
+    return _sensor != NULL;
+  }
+
+  GyroBias& bias() {
+    return _bias;
+  }
+
+  // For the metrics registry
+  const Gauge& biasGauge(int axis) const {
+    return _biasGauges[axis];
+  }
+
+  const Gauge& stillGauge() const {
+    return _still;
+  }
+
+  int Get_G_Axes(int32_t* pData) {
+    int status = _sensor->Get_G_Axes(pData);
+    if (status != 0) {
+      return status;
+    }
+    _bias.update(pData);
+    for (int i = 0; i < 3; i++) {
+      _biasGauges[i].set(_bias.bias(i));
+    }
+    _still.set(_bias.still());
+    return 0;
+  }
+
+  // Raw LSBs are the sensor's own, uncorrected
+  int Get_G_AxesRaw(int16_t* pData) {
+    return _sensor->Get_G_AxesRaw(pData);
+  }
+
+  int Get_G_Sensitivity(float* pfData) {
+    return _sensor->Get_G_Sensitivity(pfData);
+  }
+
+  int Get_G_ODR(float* pfData) {
+    return _sensor->Get_G_ODR(pfData);
+  }
+
+  int Set_G_ODR(float odr) {
+    return _sensor->Set_G_ODR(odr);
+  }
+
+  int Get_G_FS(float* pfData) {
+    return _sensor->Get_G_FS(pfData);
+  }
+
+  int Set_G_FS(float fs) {
+    return _sensor->Set_G_FS(fs);
+  }
+
+  int Init(void* ptr) {
+    return _sensor->Init(ptr);
+  }
+
+  int ReadID(uint8_t* id) {
+    return _sensor->ReadID(id);
+  }
+};
+
+#endif //__GYROBIAS_H__
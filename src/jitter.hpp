@@ -0,0 +1,109 @@
+#ifndef __JITTER_H__
+#define __JITTER_H__
+#include <stdint.h>
+
+// Linear histogram bins around the nominal period, the outer bins catch
+// everything further out
+#ifndef JITTER_BINS
+#define JITTER_BINS 64
+#endif
+
+struct JitterStats {
+  uint32_t intervals;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint32_t meanUs;
+  uint32_t p99Us;
+};
+
+// Inter-sample interval statistics per reporting period. Intervals come from
+// sample timestamps, so the 32 bit us ticker wrapping is harmless. The p99 is
+// read off a histogram of JITTER_BINS bins of binUs centred on the nominal
+// period, so it is exact to one bin as long as the jitter stays within
+// +/- JITTER_BINS / 2 bins.
+class JitterTracker {
+  uint32_t _nominalUs;
+  int32_t _binUs;
+  uint32_t _last;
+  bool _started;
+  uint32_t _count;
+  uint32_t _min;
+  uint32_t _max;
+  uint64_t _sum;
+  uint16_t _bins[JITTER_BINS];
+
+  void clear() {
+    _count = 0;
+    _min = UINT32_MAX;
+    _max = 0;
+    _sum = 0;
+    for (int i = 0; i < JITTER_BINS; i++) {
+      _bins[i] = 0;
+    }
+  }
+
+public:
+  JitterTracker(uint32_t nominalUs, uint32_t binUs)
+    : _nominalUs(nominalUs), _binUs(binUs ? binUs : 1), _last(0), _started(false) {
+    clear();
+  }
+
+  void record(uint32_t timestamp) {
+    if (!_started) {
+      _started = true;
+      _last = timestamp;
+      return;
+    }
+    uint32_t interval = timestamp - _last;
+    _last = timestamp;
+
+    _count++;
+    _sum += interval;
+    if (interval < _min) {
+      _min = interval;
+    }
+    if (interval > _max) {
+      _max = interval;
+    }
+
+    // Floor division so early and late samples don't share the centre bin
+    int32_t offset = (int32_t) (interval - _nominalUs);
+    int32_t bin = (offset >= 0 ? offset / _binUs : (offset - _binUs + 1) / _binUs) + JITTER_BINS / 2;
+    bin = bin < 0 ? 0 : bin >= JITTER_BINS ? JITTER_BINS - 1 : bin;
+    if (_bins[bin] < UINT16_MAX) {
+      _bins[bin]++;
+    }
+  }
+
+  uint32_t intervals() const {
+    return _count;
+  }
+
+  // Statistics for the period so far, then start a new period. The last
+  // timestamp is kept so the first interval of the next period isn't lost.
+  JitterStats close() {
+    JitterStats stats = { _count, 0, 0, 0, 0 };
+    if (_count > 0) {
+      stats.minUs = _min;
+      stats.maxUs = _max;
+      stats.meanUs = (uint32_t) (_sum / _count);
+
+      uint32_t target = _count - _count / 100;
+      uint32_t seen = 0;
+      int bin = 0;
+      for (; bin < JITTER_BINS - 1; bin++) {
+        seen += _bins[bin];
+        if (seen >= target) {
+          break;
+        }
+      }
+      // Upper edge of the bin, but never past what was actually seen
+      int64_t edge = (int64_t) _nominalUs + (int64_t) (bin - JITTER_BINS / 2 + 1) * _binUs;
+      stats.p99Us = bin == JITTER_BINS - 1 || edge > _max ? _max : edge < _min ? _min : (uint32_t) edge;
+    }
+    clear();
+    return stats;
+  }
+};
+
+#endif //__JITTER_H__
@@ -0,0 +1,74 @@
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+#include <stdint.h>
+#include <atomic>
+
+// Bucket 0 holds 0us, bucket i holds [2^(i-1), 2^i) us, the last bucket
+// everything from ~8s up
+#ifndef LATENCY_BUCKETS
+#define LATENCY_BUCKETS 25
+#endif
+
+// Log2 bucketed latency histogram. record() is a couple of relaxed atomic
+// increments, so stages in different threads (or an ISR) can all feed their
+// own histogram while another thread reads or resets it. Percentiles are
+// accurate to a factor of two, which is enough to see where things queue up.
+class LatencyHistogram {
+  std::atomic<uint32_t> _buckets[LATENCY_BUCKETS];
+  std::atomic<uint32_t> _count;
+  std::atomic<uint32_t> _max;
+
+  static int bucketOf(uint32_t us) {
+    int bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+  }
+
+public:
+  LatencyHistogram() {
+    reset();
+  }
+
+  void record(uint32_t us) {
+    _buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    uint32_t max = _max.load(std::memory_order_relaxed);
+    while (us > max && !_max.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+  }
+
+  uint32_t count() const {
+    return _count.load(std::memory_order_relaxed);
+  }
+
+  uint32_t max() const {
+    return _max.load(std::memory_order_relaxed);
+  }
+
+  // Upper edge of the bucket holding the given percentile, capped at max
+  uint32_t percentile(uint32_t percent) const {
+    uint32_t total = count();
+    if (total == 0) {
+      return 0;
+    }
+    uint32_t target = (uint32_t) (((uint64_t) total * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+      seen += _buckets[bucket].load(std::memory_order_relaxed);
+      if (seen >= target) {
+        uint32_t edge = bucket == 0 ? 0 : (bucket >= 32 ? UINT32_MAX : (1u << bucket) - 1);
+        return edge < max() ? edge : max();
+      }
+    }
+    return max();
+  }
+
+  void reset() {
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+      _buckets[bucket].store(0, std::memory_order_relaxed);
+    }
+    _count.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+  }
+};
+
+#endif //__LATENCY_H__
@@ -0,0 +1,386 @@
+#ifndef __MAGCAL_H__
+#define __MAGCAL_H__
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// Bumped whenever MagCalibration changes, stored ones of another layout are
+// ignored
+#define MAG_CAL_VERSION 1
+// Fit in units of this many mgauss, so the squares stay near 1 in floats
+#ifndef MAG_CAL_SCALE
+#define MAG_CAL_SCALE 1000.0f
+#endif
+// A sample goes into the fit only this far from the last one that did: a
+// device at rest adds nothing and can't wind the fit up
+#ifndef MAG_CAL_MIN_STEP_MGAUSS
+#define MAG_CAL_MIN_STEP_MGAUSS 25
+#endif
+// RLS forgetting factor per sample fitted, about 1 / (1 - x) samples of memory
+#ifndef MAG_CAL_FORGETTING
+#define MAG_CAL_FORGETTING 0.999f
+#endif
+#ifndef MAG_CAL_MIN_SAMPLES
+#define MAG_CAL_MIN_SAMPLES 100
+#endif
+#ifndef MAG_CAL_SOLVE_EVERY
+#define MAG_CAL_SOLVE_EVERY 20
+#endif
+// Consecutive solutions within MAG_CAL_SETTLE_MGAUSS of each other before
+// one is adopted
+#ifndef MAG_CAL_SETTLED_SOLVES
+#define MAG_CAL_SETTLED_SOLVES 3
+#endif
+#ifndef MAG_CAL_SETTLE_MGAUSS
+#define MAG_CAL_SETTLE_MGAUSS 4.0f
+#endif
+// Adopted solutions closer than this to the saved one aren't worth a write
+#ifndef MAG_CAL_SAVE_MGAUSS
+#define MAG_CAL_SAVE_MGAUSS 12
+#endif
+// Sanity limits: the earth's field is 250-650 mgauss, and soft iron that
+// squashes an axis by more than this is a fit gone wrong
+#ifndef MAG_CAL_MIN_FIELD_MGAUSS
+#define MAG_CAL_MIN_FIELD_MGAUSS 100
+#endif
+#ifndef MAG_CAL_MAX_FIELD_MGAUSS
+#define MAG_CAL_MAX_FIELD_MGAUSS 2000
+#endif
+#ifndef MAG_CAL_MAX_AXIS_RATIO
+#define MAG_CAL_MAX_AXIS_RATIO 2.0f
+#endif
+
+#define MAG_CAL_Q 14
+
+// A correction, as applied and as persisted: corrected = matrix * (raw - offset)
+struct MagCalibration {
+  uint32_t version;
+  int32_t offset[3];      // hard iron, mgauss
+  int32_t matrix[9];      // soft iron, Q14 row major
+  uint32_t fieldMgauss;   // magnitude of a corrected reading
+  uint32_t samples;       // samples the fit saw
+};
+
+// Online hard and soft iron calibration for a 3 axis magnetometer.
+//
+// Readings of a fixed field from a device turning through every direction
+// lie on an ellipsoid: shifted by the hard iron, stretched and skewed by the
+// soft iron. Each reading far enough from the last one updates a recursive
+// least squares fit of the general quadric
+//
+//   a x^2 + b y^2 + c z^2 + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z = 1
+//
+// which is nine floats of state and a 9x9 covariance, O(81) per reading.
+// Every MAG_CAL_SOLVE_EVERY readings the quadric is turned into a centre
+// (the hard iron offset) and the symmetric square root of its shape matrix
+// (the soft iron correction), scaled to keep the field's strength. Once the
+// readings cover every octant around the centre and a few solutions in a row
+// agree, every solution is adopted; correct() applies the newest in fixed
+// point and update() says when it has moved far enough from the one last
+// persisted to be worth writing again.
+class MagCalibrator {
+  float _theta[9];
+  float _p[9][9];
+  float _last[3];
+  float _min[3];
+  float _max[3];
+  uint32_t _fitted;
+  uint8_t _octants;
+  MagCalibration _candidate;
+  uint8_t _settled;
+  MagCalibration _active;
+  MagCalibration _saved;
+  bool _calibrated;
+
+  // Cyclic Jacobi rotations: `a` ends up diagonal, holding the eigenvalues,
+  // and the columns of `v` the eigenvectors
+  static void eigen(float a[3][3], float v[3][3]) {
+    static const int pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        v[i][j] = i == j ? 1.0f : 0.0f;
+      }
+    }
+    for (int sweep = 0; sweep < 12; sweep++) {
+      float off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+      float diagonal = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+      if (off <= 1e-14f * diagonal) {
+        return;
+      }
+      for (int r = 0; r < 3; r++) {
+        int p = pairs[r][0];
+        int q = pairs[r][1];
+        if (a[p][q] == 0.0f) {
+          continue;
+        }
+        float theta = (a[q][q] - a[p][p]) / (2.0f * a[p][q]);
+        float t = (theta >= 0.0f ? 1.0f : -1.0f) / (fabsf(theta) + sqrtf(theta * theta + 1.0f));
+        float c = 1.0f / sqrtf(t * t + 1.0f);
+        float s = t * c;
+        for (int k = 0; k < 3; k++) {
+          float kp = a[k][p];
+          float kq = a[k][q];
+          a[k][p] = c * kp - s * kq;
+          a[k][q] = s * kp + c * kq;
+        }
+        for (int k = 0; k < 3; k++) {
+          float pk = a[p][k];
+          float qk = a[q][k];
+          a[p][k] = c * pk - s * qk;
+          a[q][k] = s * pk + c * qk;
+        }
+        for (int k = 0; k < 3; k++) {
+          float kp = v[k][p];
+          float kq = v[k][q];
+          v[k][p] = c * kp - s * kq;
+          v[k][q] = s * kp + c * kq;
+        }
+      }
+    }
+  }
+
+  static void identity(MagCalibration& cal) {
+    memset(&cal, 0, sizeof(cal));
+    cal.version = MAG_CAL_VERSION;
+    cal.matrix[0] = cal.matrix[4] = cal.matrix[8] = 1 << MAG_CAL_Q;
+  }
+
+  static int32_t distance(const int32_t* a, const int32_t* b, int count) {
+    int32_t result = 0;
+    for (int i = 0; i < count; i++) {
+      int32_t d = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+      result = d > result ? d : result;
+    }
+    return result;
+  }
+
+  // The quadric as a correction, false if it isn't a plausible ellipsoid
+  bool solve(MagCalibration& out) {
+    const float* t = _theta;
+    float m[3][3] = { { t[0], t[3], t[4] }, { t[3], t[1], t[5] }, { t[4], t[5], t[2] } };
+    // Centre: m o = -(g h i)
+    float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    float det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+    if (!(fabsf(det) > 1e-12f)) {
+      return false;
+    }
+    float inverse[3][3] = {
+      { c00, m[0][2] * m[2][1] - m[0][1] * m[2][2], m[0][1] * m[1][2] - m[0][2] * m[1][1] },
+      { c01, m[0][0] * m[2][2] - m[0][2] * m[2][0], m[0][2] * m[1][0] - m[0][0] * m[1][2] },
+      { c02, m[0][1] * m[2][0] - m[0][0] * m[2][1], m[0][0] * m[1][1] - m[0][1] * m[1][0] },
+    };
+    float o[3];
+    for (int i = 0; i < 3; i++) {
+      o[i] = -(inverse[i][0] * t[6] + inverse[i][1] * t[7] + inverse[i][2] * t[8]) / det;
+    }
+    // (x - o)' m (x - o) = k
+    float k = 1.0f;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        k += o[i] * m[i][j] * o[j];
+      }
+    }
+    if (!(k > 0.0f)) {
+      return false;
+    }
+    float a[3][3];
+    float v[3][3];
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        a[i][j] = m[i][j] / k;
+      }
+    }
+    eigen(a, v);
+    float roots[3];
+    float axisMin = 0.0f;
+    float axisMax = 0.0f;
+    float volume = 1.0f;
+    for (int i = 0; i < 3; i++) {
+      if (!(a[i][i] > 0.0f)) {
+        return false;
+      }
+      roots[i] = sqrtf(a[i][i]);
+      float axis = 1.0f / roots[i];
+      axisMin = i == 0 || axis < axisMin ? axis : axisMin;
+      axisMax = axis > axisMax ? axis : axisMax;
+      volume *= axis;
+    }
+    // Radius of the sphere of the same volume, so the correction keeps the
+    // field's strength
+    float radius = cbrtf(volume);
+    float field = radius * MAG_CAL_SCALE;
+    if (axisMax > MAG_CAL_MAX_AXIS_RATIO * axisMin || field < MAG_CAL_MIN_FIELD_MGAUSS ||
+        field > MAG_CAL_MAX_FIELD_MGAUSS) {
+      return false;
+    }
+    out.version = MAG_CAL_VERSION;
+    for (int i = 0; i < 3; i++) {
+      out.offset[i] = (int32_t) lrintf(o[i] * MAG_CAL_SCALE);
+      for (int j = 0; j < 3; j++) {
+        float w = 0.0f;
+        for (int e = 0; e < 3; e++) {
+          w += v[i][e] * roots[e] * v[j][e];
+        }
+        out.matrix[3 * i + j] = (int32_t) lrintf(w * radius * (1 << MAG_CAL_Q));
+      }
+    }
+    out.fieldMgauss = (uint32_t) lrintf(field);
+    out.samples = _fitted;
+    return true;
+  }
+
+  // One RLS step towards phi . theta = 1
+  void fit(const float* phi) {
+    float u[9];
+    float denominator = MAG_CAL_FORGETTING;
+    for (int i = 0; i < 9; i++) {
+      u[i] = 0.0f;
+      for (int j = 0; j < 9; j++) {
+        u[i] += _p[i][j] * phi[j];
+      }
+      denominator += phi[i] * u[i];
+    }
+    float error = 1.0f;
+    for (int i = 0; i < 9; i++) {
+      error -= phi[i] * _theta[i];
+    }
+    for (int i = 0; i < 9; i++) {
+      _theta[i] += u[i] / denominator * error;
+    }
+    // P = (P - u u' / denominator) / forgetting, symmetric by construction
+    for (int i = 0; i < 9; i++) {
+      for (int j = i; j < 9; j++) {
+        _p[i][j] = _p[j][i] = (_p[i][j] - u[i] * u[j] / denominator) / MAG_CAL_FORGETTING;
+      }
+    }
+  }
+
+public:
+  MagCalibrator() {
+    identity(_active);
+    identity(_saved);
+    _calibrated = false;
+    reset();
+  };
+
+  // Start the fit over from a sphere of the earth's field, keeping whatever
+  // correction is active
+  void reset() {
+    memset(_theta, 0, sizeof(_theta));
+    memset(_p, 0, sizeof(_p));
+    float r = 500.0f / MAG_CAL_SCALE;
+    for (int i = 0; i < 3; i++) {
+      _theta[i] = 1.0f / (r * r);
+      _last[i] = 0.0f;
+      _min[i] = INFINITY;
+      _max[i] = -INFINITY;
+    }
+    for (int i = 0; i < 9; i++) {
+      _p[i][i] = 100.0f;
+    }
+    _fitted = 0;
+    _octants = 0;
+    _settled = 0;
+    identity(_candidate);
+  }
+
+  // Take a persisted correction, false if it is of another layout
+  bool load(const MagCalibration& cal) {
+    if (cal.version != MAG_CAL_VERSION) {
+      return false;
+    }
+    _active = _saved = cal;
+    _calibrated = true;
+    reset();
+    return true;
+  }
+
+  // Feed a raw reading in mgauss. Returns true when the correction adopted
+  // differs enough from the last one persisted to be worth persisting.
+  bool update(const int32_t* raw) {
+    float x[3] = { raw[0] / MAG_CAL_SCALE, raw[1] / MAG_CAL_SCALE, raw[2] / MAG_CAL_SCALE };
+    float step = fabsf(x[0] - _last[0]) + fabsf(x[1] - _last[1]) + fabsf(x[2] - _last[2]);
+    if (step < MAG_CAL_MIN_STEP_MGAUSS / MAG_CAL_SCALE) {
+      return false;
+    }
+    memcpy(_last, x, sizeof(_last));
+    float phi[9] = { x[0] * x[0], x[1] * x[1], x[2] * x[2],
+                     2.0f * x[0] * x[1], 2.0f * x[0] * x[2], 2.0f * x[1] * x[2],
+                     2.0f * x[0], 2.0f * x[1], 2.0f * x[2] };
+    fit(phi);
+    _fitted++;
+    // Coverage is judged around the middle of the range seen so far, which
+    // doesn't need a solution to find the hard iron
+    int octant = 0;
+    for (int i = 0; i < 3; i++) {
+      _min[i] = x[i] < _min[i] ? x[i] : _min[i];
+      _max[i] = x[i] > _max[i] ? x[i] : _max[i];
+      octant |= (x[i] > (_min[i] + _max[i]) / 2.0f) << i;
+    }
+    _octants |= 1 << octant;
+    if (_fitted < MAG_CAL_MIN_SAMPLES || _fitted % MAG_CAL_SOLVE_EVERY != 0 || _octants != 0xFF) {
+      return false;
+    }
+
+    MagCalibration solution;
+    if (!solve(solution)) {
+      _settled = 0;
+      return false;
+    }
+    // Matrix entries compared at the scale of the field
+    int32_t settle = (int32_t) MAG_CAL_SETTLE_MGAUSS;
+    bool agrees = distance(solution.offset, _candidate.offset, 3) <= settle &&
+                  distance(solution.matrix, _candidate.matrix, 9) * (int32_t) solution.fieldMgauss <=
+                  settle << MAG_CAL_Q;
+    _candidate = solution;
+    _settled = !agrees ? 0 : _settled < MAG_CAL_SETTLED_SOLVES ? _settled + 1 : _settled;
+    if (_settled < MAG_CAL_SETTLED_SOLVES) {
+      return false;
+    }
+    bool moved = !_calibrated || distance(solution.offset, _saved.offset, 3) > MAG_CAL_SAVE_MGAUSS ||
+                 distance(solution.matrix, _saved.matrix, 9) * (int32_t) solution.fieldMgauss >
+                 MAG_CAL_SAVE_MGAUSS << MAG_CAL_Q;
+    _active = solution;
+    _calibrated = true;
+    if (!moved) {
+      return false;
+    }
+    _saved = solution;
+    return true;
+  }
+
+  // Apply the active correction, in mgauss
+  void correct(const int32_t* raw, int32_t* out) const {
+    int32_t d[3] = { raw[0] - _active.offset[0], raw[1] - _active.offset[1], raw[2] - _active.offset[2] };
+    for (int i = 0; i < 3; i++) {
+      const int32_t* row = &_active.matrix[3 * i];
+      int64_t sum = (int64_t) row[0] * d[0] + (int64_t) row[1] * d[1] + (int64_t) row[2] * d[2];
+      out[i] = (int32_t) ((sum + (1 << (MAG_CAL_Q - 1))) >> MAG_CAL_Q);
+    }
+  }
+
+  bool calibrated() const {
+    return _calibrated;
+  }
+
+  const MagCalibration& calibration() const {
+    return _active;
+  }
+
+  // Progress of the running fit
+  uint32_t fitted() const {
+    return _fitted;
+  }
+
+  uint8_t octants() const {
+    uint8_t count = 0;
+    for (uint8_t bits = _octants; bits != 0; bits &= bits - 1) {
+      count++;
+    }
+    return count;
+  }
+};
+
+#endif //__MAGCAL_H__
@@ -64,79 +64,1890 @@
 #include "rtos.h"
 #include "x_nucleo_iks01a1.h"
 #include "cmsis_os.h"
+#include <atomic>
+#include <inttypes.h>
 #include "data.hpp"
+#include "power.hpp"
+#include "filter.hpp"
+#include "spectrum.hpp"
+#include "ahrs.hpp"
+#include "events.hpp"
+#include "jitter.hpp"
+#include "latency.hpp"
+#include "metrics.hpp"
+#include "commands.hpp"
+#include "timeseries.hpp"
+#include "decimate.hpp"
+#include "busmanager.hpp"
+#include "busplan.hpp"
+#include "Buffer.h"
+#include "benchmark.hpp"
+#include "boot.hpp"
+#include "membudget.hpp"
+#include "profiler.hpp"
+#include "pipeline.hpp"
+#include "magcal.hpp"
+#include "gyrobias.hpp"
 
 #define DEBUG 0
-#define MAX_MESSAGES 16
+#define BENCHMARK 0
+#define BENCH_SAMPLES 256
+#define MESSAGE_SIZE 128
 #define MAX_ITEMS 10
-#define CAPACITY (MAX_ITEMS + 1)
+// Largest averaging window the serial console can set
+#define MAX_WINDOW 50
+#define STRINGIFY(x) #x
+#define TO_STRING(x) STRINGIFY(x)
+#define SAMPLE_RATE 10
+#define SAMPLE_PERIOD_US (1000000 / SAMPLE_RATE)
+// Samples drained per wakeup when the LSM6DS3 FIFO is available, 0 disables
+// batching. AHRS takes fewer, see AHRS_RATE.
+#define BATCH_SIZE 25
+#define POWER_REPORT_SAMPLES 100
+// Ticker period jitter, reported every JITTER_REPORT_SAMPLES intervals
+#define JITTER_REPORT_SAMPLES 100
+#define JITTER_BIN_US 50
+// Per stage latency histograms, reported once LATENCY_REPORT_MESSAGES sample
+// driven messages have made it out of the serial port
+#define LATENCY_REPORT_MESSAGES 20
+// Counters and gauges snapshot period
+#define METRICS_PERIOD_S 10
+// Serial console for changing rate, window, ODR/FS and output format live.
+// The UART can't wake the MCU from STOP mode, so deep sleep starts off and
+// is turned on with "sleep deep" once the unit is tuned.
+#define COMMANDS 1
+#define COMMAND_RX_SIZE 64
+#define MAX_TICKER_RATE 200
+// Capture DevI2C traffic into a RAM trace that the console can dump as hex,
+// for replaying into the drivers on the host
+#define I2C_TRACE 0
+#define I2C_TRACE_SIZE 8192
+// Low pass the accelerometer stream at FILTER_CUTOFF Hz, or a quarter of the
+// rate below 8Hz (BIQUAD_MAX_CUTOFF)
+#define FILTER 1
+#define FILTER_CUTOFF 2.0f
+// Per-axis band energies and peak frequency over blocks of FFT_SIZE samples
+#define SPECTRUM 1
+#define FFT_SIZE 64
+#define SPECTRUM_BANDS 4
+// Fuse accelerometer, gyroscope and magnetometer into an orientation. Each
+// block is fused once, with a gyro and magnetometer read of its own, so with
+// AHRS FIFO batches are cut short to give at least AHRS_RATE blocks a second:
+// fusion runs at the sample rate up to AHRS_RATE and at AHRS_RATE above it,
+// at the cost of that many wakeups and reads.
+//
+// Limitation: fusion does not run at the IMU rate. The gyroscope is polled,
+// one read per fusion step, and is not batched in the FIFO alongside the
+// accelerometer, so above AHRS_RATE (and ORIENTATION_RATE with DECIMATE) the
+// accelerometer samples in between are not fused. BENCHMARK times the
+// kernel ("madgwick 9dof") to check against the 2.5ms a 400Hz sample allows;
+// the cap comes from the polled reads, two bus transfers per step, and is why
+// AHRS is off by default.
+#define AHRS 0
+#define AHRS_BETA 0.1f
+#define AHRS_RATE 50
+#define AHRS_REPORT_UPDATES 50
+// Learn the gyroscope's bias while the accelerometer says the device is
+// still and take it off every gyro read: the gyroscope every reader sees is
+// a BiasCorrectedGyro. Without AHRS nothing else reads it, processing does
+// at GYRO_BIAS_RATE so the bias is learnt all the same.
+#define GYRO_BIAS 1
+#define GYRO_BIAS_RATE 10
+// Fit the magnetometer's hard and soft iron while the device is turned about
+// and correct its readings before fusion. Needs AHRS for the reads. The fit
+// keeps each correction it adopts in two flash sectors of its own, taken
+// from the end of the log's, so recycling one never erases the newest. They
+// are saved from a thread below processing: an append that recycles erases
+// for about a second. Host builds use MAG_CAL_FILE.
+#define MAG_CAL 0
+#define MAG_CAL_FIRST_SECTOR 6
+#define MAG_CAL_SECTORS 2
+#define MAG_CAL_STACK_SIZE DEFAULT_STACK_SIZE
+#define MAG_CAL_FILE "magcal.bin"
+// Publish LSM6DS3 INT1 events (free-fall, wake-up, tap, tilt) from a worker
+// thread. Wake-up fires on any motion above 62mg, so it is opt in.
+#define EVENTS 1
+#define EVENT_MASK (EVENT_FREE_FALL | EVENT_TAP | EVENT_TILT)
+// Keep the raw accelerometer stream as a time series in a ring log in the
+// internal flash the image doesn't use (F401 sectors 5-7, 384KB) so it
+// survives the serial host going away: at rest about 3 hours at 10Hz, 4
+// minutes at 400Hz. Every lap erases each sector once, against 10k rated
+// cycles. With MAG_CAL only sector 5 is left, a third of that, and each lap
+// starts the log over. Host builds use FLASH_LOG_FILE.
+#define FLASH_LOG 1
+#define FLASH_LOG_FIRST_SECTOR 5
+#define FLASH_LOG_SECTORS (MAG_CAL ? 1 : 3)
+#define FLASH_LOG_FILE "flashlog.bin"
+// Lower rate copies of the raw stream through CIC decimators and compensating
+// FIRs, so every consumer shares one acquisition: orientation runs on at
+// most ORIENTATION_RATE and a dashboard line goes out at DASHBOARD_RATE
+#define DECIMATE 1
+#define ORIENTATION_RATE 100
+#define DASHBOARD_RATE 1
+// Poll temperature, humidity and pressure from a low priority thread whose
+// transfers wait behind sample acquisition on the shared I2C bus
+#define ENVIRONMENT 1
+#define ENVIRONMENT_PERIOD_S 10
+// Account I2C traffic per device and predict the bus load of a configuration
+// from its rates, warning when it goes over BUS_PLAN_LIMIT_PERMILLE; the rest
+// is slack for arbitration and events
+#define I2C_BUS_HZ 100000
+#define BUS_PLAN_LIMIT_PERMILLE 700
+// LSM6DS3 on its own SPI bus instead of the shared I2C one, for a DIL24
+// adapter wired to the Arduino SPI pins with chip select on IMU_SPI_CS. FIFO
+// batches then take tens of microseconds rather than tens of milliseconds
+#define IMU_SPI 0
+#define IMU_SPI_CS D10
+#define IMU_SPI_HZ 10000000
+
+#if IMU_SPI && !BATCH_SIZE
+#error "IMU_SPI is for FIFO batches, set BATCH_SIZE"
+#endif
+#if MAG_CAL && !AHRS
+#error "MAG_CAL corrects the AHRS magnetometer reads, set AHRS"
+#endif
+#if DECIMATE && DASHBOARD_RATE < 1
+#error "DASHBOARD_RATE is lines a second, at least 1"
+#endif
+// Acquisition, processing and output are threads joined by bounded lock-free
+// queues, so a slow serial port backs up into the output queue and never into
+// sampling. Acquisition reads the sensor when the Ticker or INT1 says and
+// hands blocks of samples on; processing filters, averages and reports; output
+// owns the serial port. Each queue has its own Backpressure (pipeline.hpp):
+// samples and the lines derived from them are dropped and counted when their
+// queue is full, anything else waits for room. The main thread only sleeps,
+// below all of them.
+#define ACQUIRE_PRIORITY osPriorityHigh
+#define ACQUIRE_STACK_SIZE DEFAULT_STACK_SIZE
+#define PROCESS_PRIORITY osPriorityAboveNormal
+#define PROCESS_STACK_SIZE (2 * DEFAULT_STACK_SIZE)
+#define OUTPUT_PRIORITY osPriorityNormal
+#define OUTPUT_STACK_SIZE DEFAULT_STACK_SIZE
+#define SAMPLE_QUEUE_BLOCKS 8
+#define SAMPLE_QUEUE_POLICY BACKPRESSURE_DROP
+#define OUTPUT_QUEUE_MESSAGES 16
+#define OUTPUT_QUEUE_POLICY BACKPRESSURE_DROP
+#define CONTROL_QUEUE_MESSAGES 8
+#define CONTROL_QUEUE_POLICY BACKPRESSURE_BLOCK
+// Nothing is allocated after reset: the board and its drivers, the thread
+// stacks and the queues are all static. NO_HEAP makes it a rule on the
+// target, a C++ allocation stops with an error. The static RAM is reported
+// by subsystem at boot and the build fails if it leaves less than
+// RAM_RESERVED_BYTES (membudget.hpp) of the F401's 96KB.
+#define NO_HEAP 0
+#define CONSOLE_STACK_SIZE DEFAULT_STACK_SIZE
+#define EVENTS_STACK_SIZE DEFAULT_STACK_SIZE
+#define ENVIRONMENT_STACK_SIZE DEFAULT_STACK_SIZE
+// CPU share per thread, sampled PROFILE_HZ times a second, time per ISR from
+// the DWT cycle counter, and each thread's stack high-water mark, reported
+// every PROFILE_PERIOD_S for sizing the stacks above. Deep sleep stays off
+// while profiling, the sampling Ticker doesn't run in STOP mode.
+#define PROFILE 0
+#define PROFILE_HZ 1000
+#define PROFILE_PERIOD_S 10
+
+// Reset to first sample, by phase. Ahead of the board so it starts first.
+BootTimer boot;
+
+static DevI2C boardI2c(D14, D15);
+#if IMU_SPI
+static DevSPI imuSpi(D11, D12, D13);
+#endif
+
+// Bring up the expansion board on a bus already at speed. Only the motion
+// sensor is set up here; the others wait for their first use.
+X_NUCLEO_IKS01A1* bringUpBoard() {
+  boardI2c.frequency(I2C_BUS_HZ);
+#if IMU_SPI
+  X_NUCLEO_IKS01A1* board = X_NUCLEO_IKS01A1::Instance(&boardI2c, &imuSpi, IMU_SPI_CS, IKS01A1_PIN_FF);
+#else
+  X_NUCLEO_IKS01A1* board = X_NUCLEO_IKS01A1::Instance(&boardI2c, IKS01A1_PIN_FF);
+#endif
+  boot.mark("board");
+  return board;
+}
 
 /* Instantiate the expansion board */
-static X_NUCLEO_IKS01A1 *mems_expansion_board = X_NUCLEO_IKS01A1::Instance(D14, D15);
+static X_NUCLEO_IKS01A1 *mems_expansion_board = bringUpBoard();
 
 /* Retrieve the composing elements of the expansion board */
 static MotionSensor *accelerometer = mems_expansion_board->GetAccelerometer();
+static LSM6DS3 *imu = mems_expansion_board->gyro_lsm6ds3;
+#if GYRO_BIAS
+static BiasCorrectedGyro correctedGyro(mems_expansion_board->GetGyroscope());
+static GyroSensor *gyroscope = correctedGyro.present() ? &correctedGyro : NULL;
+#else
+static GyroSensor *gyroscope = mems_expansion_board->GetGyroscope();
+#endif
 
 Serial pc(USBTX, USBRX);
 
-// Message struct for the message queue
+// Message struct for the message queue, owns a copy of the text so senders
+// can format into stack buffers. originUs is the capture time of the sample
+// the message reports on (0 if none), queuedUs when it entered the queue.
 struct Message {
-  const char* message;
+  char message[MESSAGE_SIZE];
+  uint32_t originUs;
+  uint32_t queuedUs;
+};
+
+// One wakeup's worth of samples, interleaved X/Y/Z in mg, samplePeriodUs
+// apart with the last taken at `timestamp`
+struct SampleBlock {
+  q15_t xyz[3 * (BATCH_SIZE ? BATCH_SIZE : 1)];
+  uint16_t count;
+  uint32_t timestamp;
 };
 
+// Stage boundaries a sample crosses on its way to the serial port
+enum LatencyStage {
+  STAGE_QUEUE,        // capture to the processing thread
+  STAGE_LOG_WAIT,     // waiting for room in the control queue
+  STAGE_LOG_QUEUE,    // queued, wait included, until the output thread picks it up
+  STAGE_PRINT,        // pc.printf
+  STAGE_END_TO_END,   // capture to the message leaving the serial port
+  STAGE_COUNT
+};
+static const char* const stageNames[STAGE_COUNT] = { "queue", "logwait", "logqueue", "print", "total" };
+
+// What a stage thread waits on for work
+#define STAGE_SIGNAL 0x1
+
 Ticker ticker;
-Mail<Data, MAX_ITEMS> dataMailBox;
-Mail<Message, MAX_MESSAGES> messageBox;
-Data samples[CAPACITY];
+// Ticker times not yet read by acquisition
+Buffer<uint32_t, 4> sampleTicks;
+StageQueue<SampleBlock, SAMPLE_QUEUE_BLOCKS> sampleQueue(SAMPLE_QUEUE_POLICY);
+// Lines reporting on a sample go to the output queue, everything else to the
+// control queue: an average can be dropped, a console reply or a flash dump
+// can't. Output serves control first.
+StageQueue<Message, OUTPUT_QUEUE_MESSAGES> outputQueue(OUTPUT_QUEUE_POLICY);
+StageQueue<Message, CONTROL_QUEUE_MESSAGES> controlQueue(CONTROL_QUEUE_POLICY);
+osThreadId acquireThread = NULL;
+Data samples[MAX_WINDOW];
 int32_t sampleCount = 0;
-Mutex* averageLock = new Mutex();
-Semaphore* logSemaphore = new Semaphore(MAX_MESSAGES);
 
-// Send a message to the message box
+// Runtime configuration. The console thread fills in pendingConfig and the
+// processing thread swaps it in between windows, so no window, FFT block or power
+// report ever mixes two configurations.
+enum OutputFormat {
+  FORMAT_TEXT,
+  FORMAT_CSV
+};
+struct Config {
+  uint32_t rate;        // Hz
+  uint32_t window;      // samples per average
+  float odr;            // accelerometer ODR in Hz, 0 leaves the driver default
+  float fs;             // accelerometer full scale in g, 0 leaves the driver default
+  OutputFormat format;
+  bool deepSleep;
+};
+Config config = { SAMPLE_RATE, MAX_ITEMS, 0.0f, 0.0f, FORMAT_TEXT, !COMMANDS };
+Config pendingConfig;
+std::atomic<bool> configPending(false);
+Mutex configLock;
+uint32_t samplePeriodUs = SAMPLE_PERIOD_US;
+// Queued or being printed, deep sleep waits for the UART to go quiet
+std::atomic<int32_t> pendingMessages(0);
+
+StreamFilter accelFilter;
+#if SPECTRUM
+SpectrumAnalyzer<FFT_SIZE, SPECTRUM_BANDS> spectrum(SAMPLE_RATE);
+#endif
+#if I2C_TRACE
+uint8_t traceStorage[I2C_TRACE_SIZE];
+I2CTraceWriter traceWriter(traceStorage, sizeof(traceStorage));
+#endif
+#if COMMANDS
+Buffer<char, COMMAND_RX_SIZE> commandInput;
+osThreadId commandThread = NULL;
+#endif
+#if FLASH_LOG
+#if defined(TARGET_STM32F4)
+Stm32Flash flashDevice(FLASH_LOG_FIRST_SECTOR, FLASH_LOG_SECTORS);
+#else
+FileFlash flashDevice(FLASH_LOG_FILE, 128 * 1024, FLASH_LOG_SECTORS);
+#endif
+FlashLog flashLog(flashDevice);
+TimeSeries series(flashLog);
+// Appends come from processing, the console reads and formats. The magcal
+// saver takes it too, both logs program through the one flash controller.
+Mutex flashLock;
+volatile bool flashMounted = false;
+#endif
+#if DECIMATE
+enum DecimationTap {
+  TAP_ORIENTATION,
+  TAP_DASHBOARD,
+  TAP_COUNT
+};
+MultiRateDecimator<TAP_COUNT, BATCH_SIZE ? BATCH_SIZE : 1> decimator;
+#endif
+#if AHRS
+MadgwickAhrs ahrs(AHRS_BETA);
+uint32_t lastOrientationUs = 0;
+uint32_t orientationUpdates = 0;
+#endif
+#if GYRO_BIAS && !AHRS
+uint32_t lastGyroUs = 0;
+#endif
+#if MAG_CAL
+MagCalibrator magCal;
+#if defined(TARGET_STM32F4)
+Stm32Flash calFlash(MAG_CAL_FIRST_SECTOR, MAG_CAL_SECTORS);
+#else
+FileFlash calFlash(MAG_CAL_FILE, 128 * 1024, MAG_CAL_SECTORS);
+#endif
+// Processing loads it before the saver thread starts, the saver is the only
+// one to touch it after that
+FlashLog calLog(calFlash);
+// The newest correction to save, handed from processing to the saver
+Mutex calLock;
+MagCalibration calToSave;
+bool calPending = false;
+osThreadId calSaver = NULL;
+#endif
+PowerManager power;
+
+// Throughput and loss, cheap enough to keep in release builds
+Counter samplesCaptured;
+Counter samplesDropped;
+Counter fifoOverruns;
+Gauge fifoLevel;
+Gauge logBacklog;
+Counter flashBlocks;
+Counter flashErrors;
+struct BusDevice {
+  uint8_t address;
+  const char* name;
+  Counter errors;
+
+  BusDevice(uint8_t address, const char* name) : address(address), name(name) {};
+};
+// The last entry catches any other address
+BusDevice busDevices[] = {
+  { LSM6DS3_XG_MEMS_ADDRESS, "i2c_ds3" },
+  { LSM6DS0_XG_MEMS_ADDRESS, "i2c_ds0" },
+  { LIS3MDL_M_MEMS_ADDRESS, "i2c_mag" },
+  { HTS221_ADDRESS, "i2c_hts" },
+  { LPS25H_ADDRESS_HIGH, "i2c_lps" },
+  { 0, "i2c_other" },
+};
+I2CStats i2cStats;
+// Plan of the running configuration, processing thread only
+BusPlanner busPlan(I2C_BUS_HZ);
+Gauge busPlanned;
+Gauge busUsed;
+MetricsRegistry metrics;
+uint32_t lastMetricsUs = 0;
+LatencyHistogram latency[STAGE_COUNT];
+JitterTracker jitter(SAMPLE_PERIOD_US, JITTER_BIN_US);
+// Arbitrates every DevI2C transfer between threads, and sessions of several
+// transfers that must not be split
+BusManager bus;
+#if IMU_SPI
+// and the same for the LSM6DS3's SPI bus
+BusManager spiBus;
+BusManager& imuBus = spiBus;
+#else
+BusManager& imuBus = bus;
+#endif
+#if EVENTS
+EventPipeline events(imu, &imuBus);
+#endif
+volatile bool dataReady = false;
+bool batched = false;
+// Samples per FIFO batch at the current rate, see fifoBatchSize()
+volatile uint16_t fifoBatch = BATCH_SIZE;
+bool bootReported = false;
+Timeout fifoPrime;
+float fifoSensitivity = 0.0f;
+
+// Thread stacks, uint64_t for the 8 byte alignment the ABI wants
+uint64_t acquireStack[ACQUIRE_STACK_SIZE / 8];
+uint64_t processStack[PROCESS_STACK_SIZE / 8];
+uint64_t outputStack[OUTPUT_STACK_SIZE / 8];
+#if COMMANDS
+uint64_t consoleStack[CONSOLE_STACK_SIZE / 8];
+#endif
+#if EVENTS
+uint64_t eventsStack[EVENTS_STACK_SIZE / 8];
+#endif
+#if ENVIRONMENT
+uint64_t environmentStack[ENVIRONMENT_STACK_SIZE / 8];
+#endif
+#if MAG_CAL
+uint64_t magCalStack[MAG_CAL_STACK_SIZE / 8];
+#endif
+
+#if PROFILE
+Profiler profiler;
+Ticker profileTicker;
+uint32_t lastProfileUs = 0;
+int sampleIsr = -1;
+int int1Isr = -1;
+int serialIsr = -1;
+int profileIsr = -1;
+#define PROFILE_ISR(id) IsrScope profileScope(profiler, id)
+#else
+#define PROFILE_ISR(id)
+#endif
+
+#if NO_HEAP && defined(TARGET_STM32F4)
+// Something still allocates, say what before anything else breaks
+void* operator new(size_t size) {
+  error("NO_HEAP: %u byte allocation\r\n", size);
+  return NULL;
+}
+
+void* operator new[](size_t size) {
+  error("NO_HEAP: %u byte array allocation\r\n", size);
+  return NULL;
+}
+#endif
+
+// Queue a message for the output thread, originUs is the capture time of the
+// sample it was derived from so its end to end latency can be measured.
+// Those may be dropped, the rest wait for room.
+void sendMessage(const char* msg, uint32_t originUs) {
+  Message m;
+  strncpy(m.message, msg, MESSAGE_SIZE - 1);
+  m.message[MESSAGE_SIZE - 1] = '\0';
+  m.originUs = originUs;
+  m.queuedUs = us_ticker_read();
+  // Counted first, output may print it before push returns
+  pendingMessages++;
+  bool queued = originUs != 0 ? outputQueue.push(m) : controlQueue.push(m);
+  if (!queued) {
+    pendingMessages--;
+    return;
+  }
+  latency[STAGE_LOG_WAIT].record(us_ticker_read() - m.queuedUs);
+}
+
 void sendMessage(const char* msg) {
-  logSemaphore->wait();
-  Message* m = messageBox.calloc();
-  m->message = msg;
-  messageBox.put(m);
+  sendMessage(msg, 0);
 }
 
-// Print all messages in the mailbox
+// Output stage, the one thread that writes to the serial port. Control
+// messages go first so a console reply never waits behind a backlog of
+// averages.
 void printMessages(void const*) {
+  controlQueue.setConsumer(osThreadGetId(), STAGE_SIGNAL);
+  outputQueue.setConsumer(osThreadGetId(), STAGE_SIGNAL);
+  Message m;
   while (true) {
-    osEvent evt = messageBox.get(1000);
-    if (evt.status == osEventMail) {
-      Message* m = (Message*) evt.value.p;
-      pc.printf(m->message);
-      messageBox.free(m);
+    while (controlQueue.pop(m) || outputQueue.pop(m)) {
+      uint32_t start = us_ticker_read();
+      latency[STAGE_LOG_QUEUE].record(start - m.queuedUs);
+      pc.printf("%s", m.message);
+      uint32_t done = us_ticker_read();
+      latency[STAGE_PRINT].record(done - start);
+      if (m.originUs != 0) {
+        latency[STAGE_END_TO_END].record(done - m.originUs);
+      }
+      pendingMessages--;
     }
-    logSemaphore->release();
+    Thread::signal_wait(STAGE_SIGNAL);
   }
 }
 
-// Sample data every 100ms, send error to log thread where applicable
+// Wake the acquisition thread, from an ISR
+void wakeAcquisition() {
+  if (acquireThread != NULL) {
+    osSignalSet(acquireThread, STAGE_SIGNAL);
+  }
+}
+
+// Ticker ISR, every sample period. The read happens on the acquisition
+// thread, which can wait for the bus where an ISR would have to give up.
 void sampleData() {
-    int32_t axes[3];
-    averageLock->lock();
-#if DEBUG
-    sendMessage("Sample data got lock\r\n");
+  PROFILE_ISR(sampleIsr);
+  // Stamp on entry, before the wakeup and the I2C transaction add their delay
+  if (!sampleTicks.push(us_ticker_read())) {
+    samplesDropped.increment();
+  }
+  wakeAcquisition();
+}
+
+BusDevice& busDevice(uint8_t address) {
+  const int count = sizeof(busDevices) / sizeof(busDevices[0]);
+  int i = 0;
+  while (i < count - 1 && busDevices[i].address != address) {
+    i++;
+  }
+  return busDevices[i];
+}
+
+// DevI2C error hook, on the thread doing the transfer. Refusals by the bus
+// manager aren't bus errors, it counts them itself.
+void countI2cError(uint8_t address, int status) {
+  if (status != I2C_ARBITER_BUSY) {
+    busDevice(address).errors.increment();
+  }
+}
+
+// INT1 carries both the FIFO threshold and the LSM6DS3 events. With the FIFO
+// running an edge is taken for the threshold and goes to acquisition, which
+// hands it on to the event worker only if INT1 is still high once the batch
+// is drained, so batch wakeups cost no source read. A latched event holding
+// INT1 high masks the threshold's edge, acquisition also drains on a timeout
+// for that.
+volatile uint32_t int1EdgeUs = 0;
+
+void int1Edge() {
+  PROFILE_ISR(int1Isr);
+  if (batched) {
+    int1EdgeUs = us_ticker_read();
+    wakeAcquisition();
+    return;
+  }
+#if EVENTS
+  events.onInterrupt();
 #endif
-    accelerometer->Get_X_Axes(axes);
-    Data* accelData = dataMailBox.alloc();
+}
 
-    accelData = new Data(axes[0], axes[1], axes[2]);
-    osStatus status = dataMailBox.put(accelData);
-    averageLock->unlock();
-#if DEBUG
-    sendMessage("Sample data lost lock\r\n");
+// The FIFO threshold is fifoBatch samples away at start, drain whatever is
+// there a couple of sample periods in so the first sample doesn't wait for it
+void primeFifo() {
+  wakeAcquisition();
+}
+
+// Store a sample, and print the average once a window is full
+void addSample(const Data& sample) {
+  samples[sampleCount++] = sample;
+  if (sampleCount == (int32_t) config.window) {
+    sampleCount = 0;
+    Data averages;
+    for (uint32_t i = 0; i < config.window; i++) {
+      averages = averages + samples[i];
+    }
+    averages = averages / config.window;
+    char message[64];
+    if (config.format == FORMAT_CSV) {
+      sprintf(message, "avg,%" PRIu32 ",%" PRId32 ",%" PRId32 ",%" PRId32 "\r\n", sample.timestamp(), averages.x(), averages.y(), averages.z());
+    } else {
+      sprintf(message, "Average: \tx: %" PRId32 "\t y: %" PRId32 "\t z: %" PRId32 "\r\n", averages.x(), averages.y(), averages.z());
+    }
+    sendMessage(message, sample.timestamp());
+  }
+}
+
+#if SPECTRUM
+// Send one compact line per axis instead of the raw block
+void reportSpectrum() {
+  const char axes[3] = { 'x', 'y', 'z' };
+  const SpectrumAnalyzer<FFT_SIZE, SPECTRUM_BANDS>::Summary& summary = spectrum.summary();
+  for (int axis = 0; axis < 3; axis++) {
+    char message[MESSAGE_SIZE];
+    int length = sprintf(message, "Spectrum %c: peak %" PRIu32 ".%03" PRIu32 "Hz bands", axes[axis],
+                         summary.peakMilliHz[axis] / 1000, summary.peakMilliHz[axis] % 1000);
+    for (int band = 0; band < SPECTRUM_BANDS; band++) {
+      length += sprintf(message + length, " %" PRIu32, summary.bandEnergy[axis][band]);
+    }
+    sprintf(message + length, "\r\n");
+    sendMessage(message);
+  }
+}
 #endif
 
-    if (status == osErrorResource) {
-#if DEBUG
-      char message[50];
-      sprintf(message, "Resource not available (%4Xh)\r\n", status);
+#if MAG_CAL
+void reportMagCalibration(const char* state, const MagCalibration& cal) {
+  char message[MESSAGE_SIZE];
+  sprintf(message, "Magcal: %s offset %" PRId32 " %" PRId32 " %" PRId32 " mgauss field %" PRIu32 " mgauss samples %" PRIu32 "\r\n", state,
+          cal.offset[0], cal.offset[1], cal.offset[2], cal.fieldMgauss, cal.samples);
+  sendMessage(message);
+}
+
+// The newest intact correction in the log. Every block is read: there are a
+// few hundred at most and one torn by a reset is skipped for the one before.
+void loadMagCalibration() {
+  if (!calLog.mount()) {
+    sendMessage("Magcal: flash unavailable\r\n");
+    return;
+  }
+  FlashLogCursor cursor;
+  calLog.begin(cursor);
+  MagCalibration cal;
+  MagCalibration newest;
+  uint16_t length;
+  bool found = false;
+  while (calLog.next(cursor, &cal, sizeof(cal), &length)) {
+    if (length == sizeof(cal) && cal.version == MAG_CAL_VERSION) {
+      newest = cal;
+      found = true;
+    }
+  }
+  if (found && magCal.load(newest)) {
+    reportMagCalibration("loaded", newest);
+  } else {
+    sendMessage("Magcal: uncalibrated\r\n");
+  }
+}
+
+// Hand the adopted correction to the saver, a newer one replaces it if the
+// saver hasn't got to it yet
+void saveMagCalibration() {
+  calLock.lock();
+  calToSave = magCal.calibration();
+  calPending = true;
+  calLock.unlock();
+  if (calSaver != NULL) {
+    osSignalSet(calSaver, STAGE_SIGNAL);
+  }
+}
+
+// Saver thread. Below processing and output, so the erase an append can
+// start doesn't hold up a stage. One handed over before it ran is saved on
+// its first pass.
+void saveMagCalibrations(void const*) {
+  calSaver = osThreadGetId();
+  while (true) {
+    calLock.lock();
+    MagCalibration cal = calToSave;
+    bool pending = calPending;
+    calPending = false;
+    calLock.unlock();
+    if (!pending) {
+      Thread::signal_wait(STAGE_SIGNAL);
+      continue;
+    }
+#if FLASH_LOG
+    flashLock.lock();
+#endif
+    bool saved = calLog.append(&cal, sizeof(cal));
+#if FLASH_LOG
+    flashLock.unlock();
+#endif
+    reportMagCalibration(saved ? "saved" : "adopted, not saved,", cal);
+  }
+}
+#endif
+
+#if AHRS
+// Fuse the newest accelerometer sample with the gyroscope and magnetometer
+void updateOrientation(int32_t ax, int32_t ay, int32_t az, uint32_t timestamp) {
+  int32_t accel[3] = { ax, ay, az };
+  int32_t gyro[3] = { 0, 0, 0 };
+  int32_t mag[3] = { 0, 0, 0 };
+
+  // Each transfer takes the bus on its own, a Ticker sample can go between
+  // the two reads but never into one
+  gyroscope->Get_G_Axes(gyro);
+  LIS3MDL* magnetometer = mems_expansion_board->GetMagnetometer();
+  if (magnetometer != NULL) {
+    magnetometer->Get_M_Axes(mag);
+#if MAG_CAL
+    if (magCal.update(mag)) {
+      saveMagCalibration();
+    }
+    magCal.correct(mag, mag);
+#endif
+  }
+
+  float dt = lastOrientationUs ? (timestamp - lastOrientationUs) / 1000000.0f : samplePeriodUs / 1000000.0f;
+  lastOrientationUs = timestamp;
+  ahrs.update(accel, gyro, mag, dt);
+
+  if (++orientationUpdates % AHRS_REPORT_UPDATES == 0) {
+    const Quaternion& q = ahrs.quaternion();
+    Euler e = q.toEuler();
+    char message[MESSAGE_SIZE];
+    sprintf(message, "Orientation: roll %" PRId32 " pitch %" PRId32 " yaw %" PRId32 " cdeg q %" PRId32 " %" PRId32 " %" PRId32 " %" PRId32 " e-4\r\n",
+            (int32_t) (e.roll * 100), (int32_t) (e.pitch * 100), (int32_t) (e.yaw * 100),
+            (int32_t) (q.w * 10000), (int32_t) (q.x * 10000), (int32_t) (q.y * 10000), (int32_t) (q.z * 10000));
+    sendMessage(message);
+  }
+}
+#endif
+
+#if ENVIRONMENT
+// Tenths with the sign in front, for printf without float support
+int formatTenths(char* out, float value) {
+  if (!(fabsf(value) < 1e8f)) {
+    return sprintf(out, "-");
+  }
+  int32_t tenths = (int32_t) lrintf(value * 10.0f);
+  uint32_t magnitude = tenths < 0 ? -tenths : tenths;
+  return sprintf(out, "%s%" PRIu32 ".%" PRIu32, tenths < 0 ? "-" : "", magnitude / 10, magnitude % 10);
+}
+
+// Environment thread. Low bus priority, so its transfers queue behind sample
+// acquisition and the HTS221 and LPS25H never hold up a FIFO drain. The
+// first poll brings the two sensors up, off the boot path.
+void pollEnvironment(void const*) {
+  bus.setThreadPriority(osThreadGetId(), BUS_PRIORITY_LOW);
+  while (true) {
+    Thread::wait(ENVIRONMENT_PERIOD_S * 1000);
+    HTS221* humidity = mems_expansion_board->GetHumiditySensor();
+    LPS25H* pressure = mems_expansion_board->GetPressureSensor();
+    float celsius = NAN;
+    float rh = NAN;
+    float hpa = NAN;
+    if (humidity != NULL && (humidity->GetTemperature(&celsius) != 0 || humidity->GetHumidity(&rh) != 0)) {
+      celsius = rh = NAN;
+    }
+    if (pressure != NULL && pressure->GetPressure(&hpa) != 0) {
+      hpa = NAN;
+    }
+    char message[MESSAGE_SIZE];
+    int length = sprintf(message, "Environment: temperature ");
+    length += formatTenths(message + length, celsius);
+    length += sprintf(message + length, "C humidity ");
+    length += formatTenths(message + length, rh);
+    length += sprintf(message + length, "%% pressure ");
+    length += formatTenths(message + length, hpa);
+    sprintf(message + length, "hPa\r\n");
+    sendMessage(message);
+  }
+}
+#endif
+
+#if FLASH_LOG
+// Count the blocks a series call wrote, it returns false if one failed
+void countFlashBlocks(uint32_t before, bool ok) {
+  if (flashLog.nextBlock() == before) {
+    return;
+  }
+  if (ok) {
+    flashBlocks.increment();
+  } else {
+    flashErrors.increment();
+  }
+}
+
+// Write out the block being filled, partial or not
+void flushSampleLog() {
+  if (!flashMounted) {
+    return;
+  }
+  flashLock.lock();
+  uint32_t before = flashLog.nextBlock();
+  countFlashBlocks(before, series.flush());
+  flashLock.unlock();
+}
+
+// Add raw samples to the time series, timed like processBlock's
+void logSamples(const q15_t* xyz, uint16_t count, uint32_t timestamp) {
+  if (!flashMounted) {
+    return;
+  }
+  flashLock.lock();
+  for (int i = 0; i < count; i++) {
+    uint32_t before = flashLog.nextBlock();
+    countFlashBlocks(before, series.add(&xyz[3 * i], timestamp - (uint32_t) (count - 1 - i) * samplePeriodUs,
+                                        samplePeriodUs));
+  }
+  flashLock.unlock();
+}
+
+void reportFlash() {
+  uint64_t firstUs;
+  uint64_t endUs;
+  flashLock.lock();
+  FlashLogInfo info = flashLog.info();
+  series.span(&firstUs, &endUs);
+  flashLock.unlock();
+  char message[MESSAGE_SIZE];
+  sprintf(message, "Flash: %s blocks %" PRIu32 " used %" PRIu32 "/%" PRIu32 " bytes erases %" PRIu32 "-%" PRIu32 " bad %" PRIu32 " time %" PRIu32 "-%" PRIu32 "ms\r\n",
+          flashMounted ? "ok" : "unavailable", info.blocks, info.usedBytes, info.capacityBytes,
+          info.minErases, info.maxErases, info.badSectors, (uint32_t) (firstUs / 1000), (uint32_t) (endUs / 1000));
+  sendMessage(message);
+}
+#endif
+
+#if DECIMATE
+// Orientation takes the sample rate down to ORIENTATION_RATE or below, the
+// dashboard tap divides what is left down to DASHBOARD_RATE
+void configureDecimator(uint32_t rate) {
+  uint32_t orientation = rate > ORIENTATION_RATE ? rate / ORIENTATION_RATE : 1;
+  uint32_t dashboard = rate / orientation / DASHBOARD_RATE;
+  decimator.configure(TAP_ORIENTATION, -1, orientation);
+  if (dashboard == 0 || !decimator.configure(TAP_DASHBOARD, TAP_ORIENTATION, dashboard)) {
+    decimator.disable(TAP_DASHBOARD);
+  }
+}
+
+void reportDashboard(uint16_t count, uint32_t timestamp) {
+  const q15_t* xyz;
+  const uint16_t* positions;
+  uint16_t outputs = decimator.output(TAP_DASHBOARD, &xyz, &positions);
+  for (uint16_t i = 0; i < outputs; i++) {
+    uint32_t at = timestamp - (uint32_t) (count - 1 - positions[i]) * samplePeriodUs;
+    char message[MESSAGE_SIZE];
+    if (config.format == FORMAT_CSV) {
+      sprintf(message, "dash,%" PRIu32 ",%d,%d,%d\r\n", at, xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]);
+    } else {
+      sprintf(message, "Dashboard: \tx: %d\t y: %d\t z: %d\r\n", xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]);
+    }
+    sendMessage(message, at);
+  }
+}
+#endif
+
+// Run a block of interleaved X/Y/Z samples in mg through the processing stages.
+// Samples are samplePeriodUs apart, the last one taken at `timestamp`.
+void processBlock(q15_t* xyz, uint16_t count, uint32_t timestamp) {
+  uint32_t now = us_ticker_read();
+  for (int i = 0; i < count; i++) {
+    latency[STAGE_QUEUE].record(now - (timestamp - (uint32_t) (count - 1 - i) * samplePeriodUs));
+  }
+#if GYRO_BIAS
+  // Every raw sample, before orientation's decimated ones smooth motion away
+  correctedGyro.bias().addSamples(xyz, count);
+#if !AHRS
+  // No fusion to read the gyroscope, read it here to learn from
+  if (gyroscope != NULL && timestamp - lastGyroUs >= 1000000 / GYRO_BIAS_RATE) {
+    int32_t rate[3];
+    gyroscope->Get_G_Axes(rate);
+    lastGyroUs = timestamp;
+  }
+#endif
+#endif
+#if SPECTRUM
+  for (int i = 0; i < count; i++) {
+    if (spectrum.feed(xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2])) {
+      reportSpectrum();
+    }
+  }
+#endif
+#if DECIMATE
+  decimator.process(xyz, count);
+  reportDashboard(count, timestamp);
+#endif
+#if AHRS && DECIMATE
+  const q15_t* decimated;
+  const uint16_t* positions;
+  uint16_t outputs = decimator.output(TAP_ORIENTATION, &decimated, &positions);
+  if (outputs > 0) {
+    int last = 3 * (outputs - 1);
+    updateOrientation(decimated[last], decimated[last + 1], decimated[last + 2],
+                      timestamp - (uint32_t) (count - 1 - positions[outputs - 1]) * samplePeriodUs);
+  }
+#elif AHRS
+  if (count > 0) {
+    int last = 3 * (count - 1);
+    updateOrientation(xyz[last], xyz[last + 1], xyz[last + 2], timestamp);
+  }
+#endif
+#if FLASH_LOG
+  logSamples(xyz, count, timestamp);
+#endif
+#if FILTER
+  accelFilter.process(xyz, count);
+#endif
+  for (int i = 0; i < count; i++) {
+    addSample(Data(xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2],
+                   timestamp - (uint32_t) (count - 1 - i) * samplePeriodUs));
+  }
+}
+
+// Hand a block to processing, or count its samples lost if the queue is full
+void publishBlock(const SampleBlock& block) {
+  if (!sampleQueue.push(block)) {
+    samplesDropped.increment(block.count);
+    return;
+  }
+  // Wake the idle loop too, whether it may deep sleep can have changed
+  dataReady = true;
+}
+
+// Drain every sample the FIFO holds, a batch at a time
+void drainFifo() {
+#if BATCH_SIZE
+  SampleBlock block;
+  uint16_t available = 0;
+  uint16_t batch = fifoBatch;
+
+  uint8_t flags = 0;
+  // The batch is due before the next one fills the FIFO
+  uint32_t deadline = us_ticker_read() + batch * samplePeriodUs;
+  IMU_6AXES_StatusTypeDef status = IMU_6AXES_ERROR;
+  if (imuBus.acquire(LSM6DS3_XG_MEMS_ADDRESS, BUS_PRIORITY_HIGH, deadline)) {
+    status = imu->Get_X_FIFO_Samples(&available, &flags);
+    imuBus.release(LSM6DS3_XG_MEMS_ADDRESS);
+  }
+  if (status != IMU_6AXES_OK) {
+    return;
+  }
+  // The FIFO doesn't carry acquisition times, the newest sample is about now
+  // and the rest are back dated by the FIFO period
+  uint32_t newest = us_ticker_read();
+  fifoLevel.set(available);
+  samplesCaptured.increment(available);
+  if (flags & LSM6DS3_XG_FIFO_STATUS2_OVER_RUN) {
+    fifoOverruns.increment();
+  }
+
+  while (available > 0) {
+    uint16_t count = available > batch ? batch : available;
+    status = IMU_6AXES_ERROR;
+    if (imuBus.acquire(LSM6DS3_XG_MEMS_ADDRESS, BUS_PRIORITY_HIGH, deadline)) {
+      status = imu->Read_X_FIFO(block.xyz, count);
+      imuBus.release(LSM6DS3_XG_MEMS_ADDRESS);
+    }
+    if (status != IMU_6AXES_OK) {
+      return;
+    }
+    for (int i = 0; i < count * 3; i++) {
+      block.xyz[i] = saturate15((int64_t) (block.xyz[i] * fifoSensitivity));
+    }
+    block.count = count;
+    block.timestamp = newest - (uint32_t) (available - count) * samplePeriodUs;
+    publishBlock(block);
+    available -= count;
+  }
+#endif
+}
+
+// One read for the newest Ticker time. Older ones still pending would read
+// the same registers, they are counted as dropped instead.
+void readTicks() {
+  uint32_t timestamp;
+  uint32_t newer;
+  if (!sampleTicks.pop(timestamp)) {
+    return;
+  }
+  while (sampleTicks.pop(newer)) {
+    samplesDropped.increment();
+    timestamp = newer;
+  }
+  int32_t axes[3];
+  if (accelerometer->Get_X_Axes(axes) != 0) {
+    samplesDropped.increment();
+    return;
+  }
+  SampleBlock block;
+  block.xyz[0] = saturate15(axes[0]);
+  block.xyz[1] = saturate15(axes[1]);
+  block.xyz[2] = saturate15(axes[2]);
+  block.count = 1;
+  block.timestamp = timestamp;
+  samplesCaptured.increment();
+  publishBlock(block);
+}
+
+// Acquisition stage. Above every other thread, so a sample is read as soon
+// as it is due and only the bus can hold it up. Whatever came in before the
+// thread ran is read on its first pass. Batches are drained on the threshold
+// edge or, if none comes, after two batch periods.
+void acquireSamples(void const*) {
+  acquireThread = osThreadGetId();
+#if EVENTS
+  uint32_t servedEdgeUs = 0;
+#endif
+  while (true) {
+    uint32_t timeoutMs = osWaitForever;
+    if (batched) {
+      drainFifo();
+#if EVENTS
+      // Below the threshold now, so a high INT1 is a latched event. One the
+      // worker already has is left to it, one with no edge of its own is
+      // stamped now.
+      uint32_t edgeUs = int1EdgeUs;
+      if (imu->Read_INT1() && !events.pending()) {
+        events.onInterrupt(edgeUs != servedEdgeUs ? edgeUs : us_ticker_read());
+      }
+      servedEdgeUs = edgeUs;
+#endif
+      timeoutMs = 2 * fifoBatch * samplePeriodUs / 1000 + 1;
+    } else {
+      readTicks();
+    }
+    Thread::signal_wait(STAGE_SIGNAL, timeoutMs);
+  }
+}
+
+// Print time spent running vs sleeping and the energy cost per sample. `force`
+// closes a short window, e.g. before the sample period changes.
+void reportPower(bool force = false) {
+  if (power.samples() < POWER_REPORT_SAMPLES && !(force && power.samples() > 0)) {
+    return;
+  }
+  PowerWindow window = power.close(samplePeriodUs);
+  char message[MESSAGE_SIZE];
+  sprintf(message, "Power: run %" PRIu32 "us sleep %" PRIu32 "us deep %" PRIu32 "us wakeups %" PRIu32 " samples %" PRIu32 " duty %" PRIu32 ".%" PRIu32 "%% %" PRIu32 "nJ/sample\r\n",
+          window.runUs, window.sleepUs, window.deepSleepUs, window.wakeups, window.samples,
+          window.dutyPermille() / 10, window.dutyPermille() % 10, window.njPerSample());
+  sendMessage(message);
+}
+
+// Inter-sample interval statistics of the Ticker driven sampling
+void reportJitter() {
+  if (jitter.intervals() < JITTER_REPORT_SAMPLES) {
+    return;
+  }
+  JitterStats stats = jitter.close();
+  char message[MESSAGE_SIZE];
+  sprintf(message, "Jitter: intervals %" PRIu32 " min %" PRIu32 "us max %" PRIu32 "us mean %" PRIu32 "us p99 %" PRIu32 "us\r\n",
+          stats.intervals, stats.minUs, stats.maxUs, stats.meanUs, stats.p99Us);
+  sendMessage(message);
+}
+
+// One line per stage that saw traffic, then start a new period
+void reportLatency() {
+  if (latency[STAGE_END_TO_END].count() < LATENCY_REPORT_MESSAGES) {
+    return;
+  }
+  for (int stage = 0; stage < STAGE_COUNT; stage++) {
+    if (latency[stage].count() == 0) {
+      continue;
+    }
+    char message[MESSAGE_SIZE];
+    sprintf(message, "Latency %-8s n %" PRIu32 " p50 %" PRIu32 "us p99 %" PRIu32 "us max %" PRIu32 "us\r\n", stageNames[stage],
+            latency[stage].count(), latency[stage].percentile(50), latency[stage].percentile(99), latency[stage].max());
+    latency[stage].reset();
+    sendMessage(message);
+  }
+}
+
+// Static RAM by subsystem. The linker map has the detail, this is for
+// seeing at a glance what a bigger buffer costs and what's left.
+constexpr MemoryItem memoryBudget[] = {
+  { "board", IKS01A1_STORAGE_BYTES + sizeof(boardI2c) },
+  { "samples", sizeof(samples) },
+  { "queues", sizeof(sampleTicks) + sizeof(sampleQueue) + sizeof(outputQueue) + sizeof(controlQueue) },
+  { "filter", sizeof(accelFilter) },
+#if SPECTRUM
+  { "spectrum", sizeof(spectrum) },
+#endif
+#if DECIMATE
+  { "decimate", sizeof(decimator) },
+#endif
+#if AHRS
+  { "ahrs", sizeof(ahrs) },
+#endif
+#if GYRO_BIAS
+  { "gyrobias", sizeof(correctedGyro) },
+#endif
+#if MAG_CAL
+  { "magcal", sizeof(magCal) + sizeof(calFlash) + sizeof(calLog) },
+#endif
+#if I2C_TRACE
+  { "trace", sizeof(traceStorage) + sizeof(traceWriter) },
+#endif
+#if COMMANDS
+  { "console", sizeof(commandInput) },
+#endif
+#if FLASH_LOG
+  { "flash", sizeof(flashDevice) + sizeof(flashLog) + sizeof(series) },
+#endif
+#if EVENTS
+  { "events", sizeof(events) },
+#endif
+#if IMU_SPI
+  { "bus", sizeof(bus) + sizeof(i2cStats) + sizeof(busPlan) + sizeof(spiBus) + sizeof(imuSpi) },
+#else
+  { "bus", sizeof(bus) + sizeof(i2cStats) + sizeof(busPlan) },
+#endif
+  { "stats", sizeof(latency) + sizeof(jitter) + sizeof(metrics) + sizeof(power) + sizeof(busDevices) },
+  { "stacks", sizeof(acquireStack) + sizeof(processStack) + sizeof(outputStack)
+#if COMMANDS
+              + sizeof(consoleStack)
+#endif
+#if EVENTS
+              + sizeof(eventsStack)
+#endif
+#if ENVIRONMENT
+              + sizeof(environmentStack)
+#endif
+#if MAG_CAL
+              + sizeof(magCalStack)
+#endif
+  },
+};
+const size_t memoryItems = sizeof(memoryBudget) / sizeof(memoryBudget[0]);
+static_assert(memoryTotal(memoryBudget, memoryItems) <= RAM_SIZE_BYTES - RAM_RESERVED_BYTES,
+              "static RAM over budget, shrink a buffer or see RAM_RESERVED_BYTES");
+
+void reportMemory() {
+  char message[MESSAGE_SIZE];
+  int length = sprintf(message, "Memory:");
+  for (size_t i = 0; i <= memoryItems; i++) {
+    if (length > MESSAGE_SIZE - 42) {
+      sprintf(message + length, "\r\n");
       sendMessage(message);
+      length = sprintf(message, "Memory:");
+    }
+    if (i < memoryItems) {
+      length += sprintf(message + length, " %s %" PRIu32, memoryBudget[i].name, memoryBudget[i].bytes);
+    }
+  }
+  sprintf(message + length, " total %" PRIu32 " of %" PRIu32 " bytes\r\n", memoryTotal(memoryBudget, memoryItems),
+          (uint32_t) (RAM_SIZE_BYTES - RAM_RESERVED_BYTES));
+  sendMessage(message);
+}
+
+#if PROFILE
+// The sampling half of the profiler
+void profileSample() {
+  PROFILE_ISR(profileIsr);
+  profiler.sample(__get_PSP(), power.asleep());
+}
+
+// Paint and register the thread stacks before any thread starts on them
+void startProfiler() {
+  CycleCounter::enable();
+  Profiler::paint(acquireStack, sizeof(acquireStack));
+  profiler.addThread("acquire", acquireStack, sizeof(acquireStack));
+  Profiler::paint(processStack, sizeof(processStack));
+  profiler.addThread("process", processStack, sizeof(processStack));
+  Profiler::paint(outputStack, sizeof(outputStack));
+  profiler.addThread("output", outputStack, sizeof(outputStack));
+#if COMMANDS
+  Profiler::paint(consoleStack, sizeof(consoleStack));
+  profiler.addThread("console", consoleStack, sizeof(consoleStack));
+#endif
+#if EVENTS
+  Profiler::paint(eventsStack, sizeof(eventsStack));
+  profiler.addThread("events", eventsStack, sizeof(eventsStack));
+#endif
+#if ENVIRONMENT
+  Profiler::paint(environmentStack, sizeof(environmentStack));
+  profiler.addThread("env", environmentStack, sizeof(environmentStack));
 #endif
+#if MAG_CAL
+  Profiler::paint(magCalStack, sizeof(magCalStack));
+  profiler.addThread("magcal", magCalStack, sizeof(magCalStack));
+#endif
+  sampleIsr = profiler.addIsr("ticker");
+  int1Isr = profiler.addIsr("int1");
+  serialIsr = profiler.addIsr("serial");
+  profileIsr = profiler.addIsr("profile");
+  lastProfileUs = us_ticker_read();
+  profileTicker.attach_us(&profileSample, 1000000 / PROFILE_HZ);
+}
+
+// A line per thread, "main" being everything outside the registered stacks,
+// then a line per ISR
+void reportProfile() {
+  uint32_t now = us_ticker_read();
+  if (now - lastProfileUs < PROFILE_PERIOD_S * 1000000) {
+    return;
+  }
+  lastProfileUs = now;
+  ProfileWindow window;
+  profiler.close(&window);
+  if (window.samples == 0 || window.windowUs == 0) {
+    return;
+  }
+  char message[MESSAGE_SIZE];
+  for (uint8_t i = 0; i < window.threadCount; i++) {
+    uint32_t permille = (uint64_t) window.threads[i].samples * 1000 / window.samples;
+    sprintf(message, "Profile %-8s cpu %" PRIu32 ".%" PRIu32 "%% stack %" PRIu32 "/%" PRIu32 "\r\n", window.threads[i].name, permille / 10,
+            permille % 10, profiler.stackUsed(i), window.threads[i].stackBytes);
+    sendMessage(message);
+  }
+  uint32_t permille = (uint64_t) window.otherSamples * 1000 / window.samples;
+  sprintf(message, "Profile %-8s cpu %" PRIu32 ".%" PRIu32 "%%\r\n", "main", permille / 10, permille % 10);
+  sendMessage(message);
+  permille = (uint64_t) window.sleepSamples * 1000 / window.samples;
+  sprintf(message, "Profile %-8s cpu %" PRIu32 ".%" PRIu32 "%%\r\n", "sleep", permille / 10, permille % 10);
+  sendMessage(message);
+  uint32_t cyclesPerUs = SystemCoreClock / 1000000;
+  for (uint8_t i = 0; i < window.isrCount; i++) {
+    const IsrProfile& isr = window.isrs[i];
+    if (isr.calls == 0) {
+      continue;
     }
+    permille = (uint64_t) isr.cycles * 1000 / ((uint64_t) window.windowUs * cyclesPerUs);
+    sprintf(message, "Profile %-8s isr n %" PRIu32 " avg %" PRIu32 "us max %" PRIu32 "us cpu %" PRIu32 ".%" PRIu32 "%%\r\n", isr.name, isr.calls,
+            isr.cycles / isr.calls / cyclesPerUs, isr.maxCycles / cyclesPerUs, permille / 10, permille % 10);
+    sendMessage(message);
+  }
+}
+#endif
+
+// Once the first sample is through, where the time since reset went
+void reportBoot() {
+  if (bootReported || samplesCaptured.value() == 0) {
+    return;
+  }
+  bootReported = true;
+  boot.mark("sample");
+  char message[MESSAGE_SIZE];
+  int length = sprintf(message, "Boot:");
+  for (uint8_t i = 0; i < boot.count() && length < MESSAGE_SIZE - 44; i++) {
+    length += sprintf(message + length, " %s %" PRIu32, boot.phase(i).name, boot.phase(i).us);
+  }
+  sprintf(message + length, " total %" PRIu32 " us\r\n", boot.totalUs());
+  sendMessage(message);
+}
+
+void registerMetrics() {
+  metrics.add("samples", samplesCaptured);
+  metrics.add("drops", samplesDropped);
+  metrics.add("smp_drop", sampleQueue.dropped());
+  metrics.add("fifo_ovr", fifoOverruns);
+  metrics.add("fifo", fifoLevel);
+  metrics.add("log", logBacklog);
+  metrics.add("out_drop", outputQueue.dropped());
+  metrics.add("ctl_wait", controlQueue.waits());
+#if EVENTS
+  metrics.add("ev_drop", events.dropped());
+#endif
+  metrics.add("flash_blk", flashBlocks);
+  metrics.add("flash_err", flashErrors);
+  for (unsigned i = 0; i < sizeof(busDevices) / sizeof(busDevices[0]); i++) {
+    metrics.add(busDevices[i].name, busDevices[i].errors);
+  }
+  metrics.add("i2c_plan", busPlanned);
+  metrics.add("i2c_use", busUsed);
+  metrics.add("lat_queue", latency[STAGE_QUEUE]);
+  metrics.add("lat_total", latency[STAGE_END_TO_END]);
+#if GYRO_BIAS
+  metrics.add("still", correctedGyro.stillGauge());
+  metrics.add("gyro_bx", correctedGyro.biasGauge(0));
+  metrics.add("gyro_by", correctedGyro.biasGauge(1));
+  metrics.add("gyro_bz", correctedGyro.biasGauge(2));
+#endif
+}
+
+// Items a second into and out of one queue, what it dropped or made wait,
+// and how full it got
+void reportStage(const char* name, StageWindow window, uint32_t capacity) {
+  uint32_t inTenths = window.windowUs ? (uint32_t) ((uint64_t) window.pushed * 10000000 / window.windowUs) : 0;
+  uint32_t outTenths = window.windowUs ? (uint32_t) ((uint64_t) window.popped * 10000000 / window.windowUs) : 0;
+  char message[MESSAGE_SIZE];
+  sprintf(message, "Stage %-8s in %" PRIu32 ".%" PRIu32 "/s out %" PRIu32 ".%" PRIu32 "/s drop %" PRIu32 " wait %" PRIu32 " depth max %" PRIu32 "/%" PRIu32 "\r\n", name,
+          inTenths / 10, inTenths % 10, outTenths / 10, outTenths % 10, window.dropped, window.waits,
+          window.maxDepth, capacity);
+  sendMessage(message);
+}
+
+// Throughput between the pipeline stages since the last report
+void reportPipeline() {
+  reportStage("samples", sampleQueue.close(), sampleQueue.capacity());
+  reportStage("output", outputQueue.close(), outputQueue.capacity());
+  reportStage("control", controlQueue.close(), controlQueue.capacity());
+}
+
+// Occupancy per device of one bus manager's window
+void reportOccupancy(const char* label, const BusDeviceStats* stats, uint32_t count, uint32_t windowUs) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (stats[i].grants == 0 && stats[i].refused == 0) {
+      continue;
+    }
+    uint32_t permille = windowUs > 0 ? (uint32_t) ((uint64_t) stats[i].busyUs * 1000 / windowUs) : 0;
+    char message[MESSAGE_SIZE];
+    sprintf(message, "%s: %-9s busy %" PRIu32 ".%" PRIu32 "%% grants %" PRIu32 " wait max %" PRIu32 "us late %" PRIu32 " refused %" PRIu32 "\r\n",
+            label, busDevice(stats[i].address).name, permille / 10, permille % 10, stats[i].grants,
+            stats[i].maxWaitUs, stats[i].late, stats[i].refused);
+    sendMessage(message);
+  }
+}
+
+// Bus occupancy per device since the last report from the bus manager, then
+// what DevI2C measured on the wire next to the plan
+void reportBus() {
+  BusDeviceStats stats[BUS_MAX_DEVICES];
+  I2CDeviceStats wire[I2C_STATS_MAX_DEVICES];
+  uint32_t windowUs;
+  // The DevI2C counts are only consistent between transfers
+  uint8_t devices = 0;
+  bool session = bus.acquire(0, BUS_PRIORITY_NORMAL, us_ticker_read() + BUS_DEFAULT_SLACK_US);
+  uint32_t count = bus.snapshot(stats, &windowUs);
+  if (session) {
+    devices = i2cStats.take(wire);
+    bus.release(0);
+  }
+  reportOccupancy("Bus", stats, count, windowUs);
+#if IMU_SPI
+  uint32_t spiWindowUs;
+  count = spiBus.snapshot(stats, &spiWindowUs);
+  reportOccupancy("SPI", stats, count, spiWindowUs);
+#endif
+  uint64_t totalUs = 0;
+  for (uint8_t i = 0; i < devices; i++) {
+    totalUs += wire[i].bus_us;
+    if (wire[i].transactions == 0) {
+      continue;
+    }
+    uint32_t used = windowUs > 0 ? (uint32_t) ((uint64_t) wire[i].bus_us * 1000 / windowUs) : 0;
+    uint32_t planned = busPlan.permille(wire[i].address);
+    char message[MESSAGE_SIZE];
+    sprintf(message, "I2C: %-9s xfers %" PRIu32 " bytes %" PRIu32 " errors %" PRIu32 " wire %" PRIu32 ".%" PRIu32 "%% plan %" PRIu32 ".%" PRIu32 "%%\r\n",
+            busDevice(wire[i].address << 1).name, wire[i].transactions, wire[i].bytes, wire[i].errors,
+            used / 10, used % 10, planned / 10, planned % 10);
+    sendMessage(message);
+  }
+  busUsed.set(windowUs > 0 ? (int32_t) (totalUs * 1000 / windowUs) : 0);
+}
+
+// Compact snapshot of every registered metric every METRICS_PERIOD_S
+void reportMetrics() {
+  uint32_t now = us_ticker_read();
+  if (now - lastMetricsUs < METRICS_PERIOD_S * 1000000u) {
+    return;
+  }
+  lastMetricsUs = now;
+  logBacklog.set(pendingMessages);
+  reportBus();
+  reportPipeline();
+  metrics.snapshot(&sendMessage);
+}
+
+// FIFO threshold at `rate`: BATCH_SIZE, or with AHRS few enough samples
+// that blocks, and so fusion, keep up with AHRS_RATE
+uint16_t fifoBatchSize(uint32_t rate) {
+#if AHRS
+  uint32_t size = rate / AHRS_RATE;
+  return size < 1 ? 1 : size > BATCH_SIZE ? BATCH_SIZE : size;
+#else
+  (void) rate;
+  return BATCH_SIZE;
+#endif
+}
+
+// The FIFO takes samples at `rate` from the accelerometer, which has to be
+// producing them at least that fast. Lower ODRs are raised to the next step
+// up, e.g. 416Hz for 400.
+bool raiseOdrForFifo(uint32_t rate) {
+  float odr = 0.0f;
+  if (imu->Get_X_ODR(&odr) != 0) {
+    return false;
+  }
+  return odr >= rate || imu->Set_X_ODR((float) rate) == 0;
+}
+
+// Use the LSM6DS3 FIFO when present so the MCU only wakes once per batch
+bool startBatching() {
+#if BATCH_SIZE
+  fifoBatch = fifoBatchSize(config.rate);
+  if (imu == NULL ||
+      !raiseOdrForFifo(config.rate) ||
+      imu->Get_X_Sensitivity(&fifoSensitivity) != 0 ||
+      imu->Enable_X_FIFO(fifoBatch, config.rate) != IMU_6AXES_OK) {
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Sampling's share of the bus traffic `c` makes, none without an
+// accelerometer
+void planSampling(const Config& c, BusPlanner& plan) {
+  if (accelerometer == NULL) {
+    return;
+  }
+  uint8_t accelAddress = (imu != NULL ? LSM6DS3_XG_MEMS_ADDRESS : LSM6DS0_XG_MEMS_ADDRESS) >> 1;
+  // A LSM6DS3 on SPI is off this bus
+  bool accelOnI2c = imu == NULL || !IMU_SPI;
+#if BATCH_SIZE
+  if (batched && accelOnI2c) {
+    // FIFO status, then the batch in one read
+    uint16_t batch = fifoBatchSize(c.rate);
+    plan.add("fifo", accelAddress, (float) c.rate / batch, 2, 2 + 6 * batch);
+  }
+#endif
+  if (!batched && accelOnI2c) {
+    // An axis a transfer, and the full scale for the sensitivity
+    plan.add("accel", accelAddress, c.rate, 4, 7);
+  }
+#if AHRS
+  // One fusion step a block
+  float blocks = batched ? (float) c.rate / fifoBatchSize(c.rate) : c.rate;
+#if DECIMATE
+  if (!batched && blocks > ORIENTATION_RATE) {
+    blocks = ORIENTATION_RATE;
+  }
+#endif
+  if (accelOnI2c) {
+    plan.add("gyro", accelAddress, blocks, 4, 7);
+  }
+  if (mems_expansion_board->HasMagnetometer()) {
+    plan.add("mag", LIS3MDL_M_MEMS_ADDRESS >> 1, blocks, 4, 7);
+  }
+#elif GYRO_BIAS
+  // Processing's own gyro reads, at most one a block
+  float blocks = batched ? (float) c.rate / fifoBatchSize(c.rate) : c.rate;
+  if (accelOnI2c && gyroscope != NULL) {
+    plan.add("gyro", accelAddress, blocks < GYRO_BIAS_RATE ? blocks : GYRO_BIAS_RATE, 4, 7);
+  }
+#endif
+}
+
+// The periodic bus traffic `c` makes, from the transfers the drivers do
+void planBus(const Config& c, BusPlanner& plan) {
+  plan.clear();
+  planSampling(c, plan);
+#if ENVIRONMENT
+  // Calibration, one-shot and output registers, read every time
+  if (mems_expansion_board->HasHumiditySensor()) {
+    plan.add("hts", HTS221_ADDRESS >> 1, 1.0f / ENVIRONMENT_PERIOD_S, 24, 34);
+  }
+  if (mems_expansion_board->HasPressureSensor()) {
+    plan.add("lps", LPS25H_ADDRESS_HIGH >> 1, 1.0f / ENVIRONMENT_PERIOD_S, 4, 5);
+  }
+#endif
+}
+
+// Predicted bus load of `plan`, with a warning if it is over the limit.
+// `warnOnly` keeps quiet about plans that fit.
+void reportBusPlan(const BusPlanner& plan, bool warnOnly) {
+  uint32_t total = plan.permille();
+  char message[MESSAGE_SIZE];
+  if (total > BUS_PLAN_LIMIT_PERMILLE) {
+    sprintf(message, "Bus plan: warning, %" PRIu32 ".%" PRIu32 "%% of %" PRIu32 "kHz is over %" PRIu32 ".%" PRIu32 "%%, expect late samples\r\n",
+            total / 10, total % 10, plan.busHz() / 1000, (uint32_t) BUS_PLAN_LIMIT_PERMILLE / 10,
+            (uint32_t) BUS_PLAN_LIMIT_PERMILLE % 10);
+    sendMessage(message);
+  }
+  if (warnOnly) {
+    return;
+  }
+  int length = sprintf(message, "Bus plan: %" PRIu32 ".%" PRIu32 "%% of %" PRIu32 "kHz", total / 10, total % 10, plan.busHz() / 1000);
+  for (uint8_t i = 0; i < plan.count() && length < MESSAGE_SIZE - 24; i++) {
+    uint32_t permille = plan.permille(plan.load(i));
+    length += sprintf(message + length, " %s %" PRIu32 ".%" PRIu32 "%%", plan.load(i).name, permille / 10, permille % 10);
+  }
+  sprintf(message + length, "\r\n");
+  sendMessage(message);
+}
+
+// Plan the running configuration, for the reports and the metrics
+void updateBusPlan() {
+  planBus(config, busPlan);
+  busPlanned.set(busPlan.permille());
+  reportBusPlan(busPlan, false);
+}
+
+void reportConfig(const Config& c) {
+  char message[MESSAGE_SIZE];
+  sprintf(message, "Config: rate %" PRIu32 "Hz window %" PRIu32 " odr %" PRIu32 "Hz fs %" PRIu32 "g format %s sleep %s%s\r\n",
+          c.rate, c.window, (uint32_t) c.odr, (uint32_t) c.fs, c.format == FORMAT_CSV ? "csv" : "text",
+          c.deepSleep ? "deep" : "light", batched ? " fifo" : "");
+  sendMessage(message);
+}
+
+// Swap in the configuration queued by the console. Runs on the processing
+// thread between blocks; the partial window is dropped and the rate dependent stages
+// restart so nothing straddles the change.
+void applyPendingConfig() {
+  configLock.lock();
+  Config next = pendingConfig;
+  configPending = false;
+  configLock.unlock();
+
+  bool rateChanged = next.rate != config.rate;
+  if (rateChanged) {
+    reportPower(true);
+#if FLASH_LOG
+    flushSampleLog();
+#endif
+  }
+
+  // One session, so the FIFO is never seen half reconfigured
+  bool session = imuBus.acquire(LSM6DS3_XG_MEMS_ADDRESS, BUS_PRIORITY_NORMAL, us_ticker_read() + BUS_DEFAULT_SLACK_US);
+  if (accelerometer != NULL && next.odr > 0.0f && next.odr != config.odr) {
+    accelerometer->Set_X_ODR(next.odr);
+  }
+  if (accelerometer != NULL && next.fs > 0.0f && next.fs != config.fs) {
+    accelerometer->Set_X_FS(next.fs);
+    if (batched) {
+      imu->Get_X_Sensitivity(&fifoSensitivity);
+    }
+  }
+  if (batched) {
+    // Either change can leave the ODR below the FIFO's
+    raiseOdrForFifo(next.rate);
+  }
+  if (rateChanged && batched) {
+    // Going through bypass mode also flushes samples taken at the old rate
+    imu->Disable_X_FIFO();
+    fifoBatch = fifoBatchSize(next.rate);
+    imu->Enable_X_FIFO(fifoBatch, next.rate);
+  }
+  if (session) {
+    imuBus.release(LSM6DS3_XG_MEMS_ADDRESS);
+  }
+  if (rateChanged && !batched && accelerometer != NULL) {
+    ticker.detach();
+    ticker.attach(&sampleData, 1.0f / next.rate);
+  }
+
+  configLock.lock();
+  config = next;
+  configLock.unlock();
+  samplePeriodUs = 1000000 / config.rate;
+  sampleCount = 0;
+
+  if (rateChanged) {
+#if FILTER
+    accelFilter.configure(BiquadCoeffs::lowPass(FILTER_CUTOFF, config.rate));
+#endif
+#if SPECTRUM
+    spectrum.setSampleRate(config.rate);
+#endif
+#if DECIMATE
+    configureDecimator(config.rate);
+#endif
+    jitter = JitterTracker(samplePeriodUs, JITTER_BIN_US);
+  }
+  reportConfig(config);
+  updateBusPlan();
+}
+
+#if COMMANDS
+// Console edits start from whatever is already queued, so several commands
+// sent back to back are applied together
+Config beginEdit() {
+  configLock.lock();
+  Config next = configPending ? pendingConfig : config;
+  configLock.unlock();
+  return next;
+}
+
+// Warns before the change is applied if the bus can't keep up with it
+void commitEdit(const Config& next) {
+  configLock.lock();
+  pendingConfig = next;
+  configPending = true;
+  configLock.unlock();
+  sendMessage("Queued for the next window\r\n");
+  BusPlanner plan(I2C_BUS_HZ);
+  planBus(next, plan);
+  reportBusPlan(plan, true);
+}
+
+bool rateCommand(int argc, char** argv) {
+  uint32_t rate = argc == 2 ? strtoul(argv[1], NULL, 10) : 0;
+  // The FIFO only runs at its own ODR steps
+  bool valid = batched ? (rate == 10 || rate == 25 || rate == 50 || rate == 100 || rate == 200 || rate == 400)
+                       : (rate >= 1 && rate <= MAX_TICKER_RATE);
+  if (!valid) {
+    return false;
+  }
+  Config next = beginEdit();
+  next.rate = rate;
+  commitEdit(next);
+  return true;
+}
+
+bool windowCommand(int argc, char** argv) {
+  uint32_t window = argc == 2 ? strtoul(argv[1], NULL, 10) : 0;
+  if (window < 1 || window > MAX_WINDOW) {
+    return false;
+  }
+  Config next = beginEdit();
+  next.window = window;
+  commitEdit(next);
+  return true;
+}
+
+bool odrCommand(int argc, char** argv) {
+  float odr = argc == 2 ? (float) atof(argv[1]) : 0.0f;
+  if (odr < 1.0f || odr > 6660.0f) {
+    return false;
+  }
+  Config next = beginEdit();
+  next.odr = odr;
+  commitEdit(next);
+  return true;
+}
+
+bool fsCommand(int argc, char** argv) {
+  uint32_t fs = argc == 2 ? strtoul(argv[1], NULL, 10) : 0;
+  if (fs != 2 && fs != 4 && fs != 8 && fs != 16) {
+    return false;
+  }
+  Config next = beginEdit();
+  next.fs = fs;
+  commitEdit(next);
+  return true;
+}
+
+bool formatCommand(int argc, char** argv) {
+  if (argc != 2 || (strcmp(argv[1], "text") != 0 && strcmp(argv[1], "csv") != 0)) {
+    return false;
+  }
+  Config next = beginEdit();
+  next.format = strcmp(argv[1], "csv") == 0 ? FORMAT_CSV : FORMAT_TEXT;
+  commitEdit(next);
+  return true;
+}
+
+bool sleepCommand(int argc, char** argv) {
+  if (argc != 2 || (strcmp(argv[1], "deep") != 0 && strcmp(argv[1], "light") != 0)) {
+    return false;
+  }
+  Config next = beginEdit();
+  next.deepSleep = strcmp(argv[1], "deep") == 0;
+  commitEdit(next);
+  return true;
+}
+
+bool configCommand(int, char**) {
+  reportConfig(beginEdit());
+  return true;
+}
+
+bool metricsCommand(int, char**) {
+  metrics.snapshot(&sendMessage);
+  return true;
+}
+
+#if I2C_TRACE
+// Hex lines of the trace, reassembled on the host with the offsets
+void dumpTrace() {
+  const uint32_t perLine = 48;
+  for (uint32_t offset = 0; offset < traceWriter.size(); offset += perLine) {
+    char message[MESSAGE_SIZE];
+    int length = sprintf(message, "Trace %05" PRIx32 " ", offset);
+    for (uint32_t i = offset; i < offset + perLine && i < traceWriter.size(); i++) {
+      length += sprintf(message + length, "%02x", traceWriter.data()[i]);
+    }
+    sprintf(message + length, "\r\n");
+    sendMessage(message);
+  }
+  char message[MESSAGE_SIZE];
+  sprintf(message, "Trace end %" PRIu32 " bytes%s\r\n", traceWriter.size(), traceWriter.full() ? " (full)" : "");
+  sendMessage(message);
+}
+
+bool traceCommand(int argc, char** argv) {
+  bool start = argc == 2 && strcmp(argv[1], "start") == 0;
+  bool dump = argc == 2 && strcmp(argv[1], "dump") == 0;
+  if (!start && !dump && !(argc == 2 && strcmp(argv[1], "stop") == 0)) {
+    return false;
+  }
+  // Swap the writer between transfers, never in the middle of one
+  DevI2C* i2c = mems_expansion_board->dev_i2c;
+  if (!bus.acquire(0, BUS_PRIORITY_NORMAL, us_ticker_read() + BUS_DEFAULT_SLACK_US)) {
+    return false;
+  }
+  if (start) {
+    traceWriter.reset(us_ticker_read());
+  }
+  i2c->attach_trace_writer(start ? &traceWriter : NULL);
+  bus.release(0);
+  if (dump) {
+    dumpTrace();
+  }
+  return true;
+}
+#endif
+
+#if FLASH_LOG
+// Samples logged between log times fromMs and toMs as csv lines, the
+// index takes the read straight to the first block of the range
+void dumpFlash(uint32_t fromMs, uint32_t toMs) {
+  static TimeSeriesBlock block;
+  static q15_t xyz[3 * TIME_SERIES_MAX_SAMPLES];
+  uint64_t fromUs = (uint64_t) fromMs * 1000;
+  uint64_t toUs = (uint64_t) toMs * 1000 + 999;
+  FlashLogCursor cursor;
+  flashLock.lock();
+  series.seek(cursor, fromUs);
+  flashLock.unlock();
+  while (true) {
+    flashLock.lock();
+    bool more = series.next(cursor, fromUs, toUs, block);
+    flashLock.unlock();
+    if (!more) {
+      break;
+    }
+    uint16_t count = TimeSeries::decode(block, xyz);
+    for (uint16_t i = 0; i < count; i++) {
+      uint64_t us = block.header.firstUs + (uint64_t) i * block.header.periodUs;
+      if (us < fromUs || us > toUs) {
+        continue;
+      }
+      char message[MESSAGE_SIZE];
+      sprintf(message, "log,%" PRIu32 ".%03" PRIu32 ",%d,%d,%d\r\n", (uint32_t) (us / 1000), (uint32_t) (us % 1000),
+              xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]);
+      sendMessage(message);
+    }
+  }
+  sendMessage("log,end\r\n");
+}
+
+bool flashCommand(int argc, char** argv) {
+  if (argc < 2) {
+    return false;
+  }
+  if (strcmp(argv[1], "info") == 0) {
+    reportFlash();
+  } else if (strcmp(argv[1], "dump") == 0) {
+    dumpFlash(argc >= 3 ? strtoul(argv[2], NULL, 10) : 0, argc >= 4 ? strtoul(argv[3], NULL, 10) : 0xFFFFFFFF);
+  } else if (strcmp(argv[1], "format") == 0) {
+    flashLock.lock();
+    flashLog.format();
+    series.mount();
+    flashLock.unlock();
+    reportFlash();
+  } else {
+    return false;
+  }
+  return true;
+}
+#endif
+
+static const Command commandTable[] = {
+  { "rate", "<Hz>  sample rate, FIFO: 10 25 50 100 200 400", &rateCommand },
+  { "window", "<1-" TO_STRING(MAX_WINDOW) ">  samples per average", &windowCommand },
+  { "odr", "<Hz>  accelerometer output data rate", &odrCommand },
+  { "fs", "<2|4|8|16>  accelerometer full scale in g", &fsCommand },
+  { "format", "<text|csv>  average output format", &formatCommand },
+  { "sleep", "<deep|light>  deep sleep makes the console deaf between batches", &sleepCommand },
+  { "config", " show the configuration, including queued changes", &configCommand },
+  { "metrics", " print a metrics snapshot now", &metricsCommand },
+#if FLASH_LOG
+  { "flash", "<info|dump [from_ms [to_ms]]|format>  sample log in flash, dump prints csv", &flashCommand },
+#endif
+#if I2C_TRACE
+  { "trace", "<start|stop|dump>  capture I2C traffic for replay, dump also stops", &traceCommand },
+#endif
+};
+
+// UART RX interrupt, the bytes are parsed on the console thread
+void serialRx() {
+  PROFILE_ISR(serialIsr);
+  while (pc.readable()) {
+    commandInput.push((char) pc.getc());
+  }
+  if (commandThread != NULL) {
+    osSignalSet(commandThread, 0x1);
+  }
+}
+
+// Console thread, blocked on its signal whenever no input is pending. Below
+// output and processing, so parsing never holds up a sample or a line.
+void runCommands(void const*) {
+  CommandParser parser(commandTable, sizeof(commandTable) / sizeof(commandTable[0]), &sendMessage);
+  commandThread = osThreadGetId();
+  while (true) {
+    Thread::signal_wait(0x1);
+    char c;
+    while (commandInput.pop(c)) {
+      parser.feed(c);
+    }
+  }
+}
+#endif
+
+#if EVENTS
+// Runs on the event worker, keep it short
+void logEvent(const Event& event) {
+  static const char* const names[] = { "free-fall", "wake-up", "tap", "tilt", "orientation" };
+  int index = 0;
+  while ((1u << index) != (uint32_t) event.type) {
+    index++;
+  }
+  char message[MESSAGE_SIZE];
+  sprintf(message, "Event: %s 0x%02X at %" PRIu32 "us latency %" PRIu32 "us dropped %" PRIu32 "\r\n", names[index],
+          event.detail, event.timestampUs, event.latencyUs, events.dropped().value());
+  sendMessage(message);
+}
+#endif
+
+#if BENCHMARK
+// Time each signal processing kernel over a synthetic interleaved X/Y/Z block
+void runBenchmarks() {
+  static q15_t block[BENCH_SAMPLES * 3];
+  for (int i = 0; i < BENCH_SAMPLES * 3; i++) {
+    block[i] = (q15_t) ((i * 7919) % 2000 - 1000);
+  }
+
+  Benchmark bench(&sendMessage);
+  BiquadQ15 biquad(BiquadCoeffs::lowPass(FILTER_CUTOFF, SAMPLE_RATE));
+  bench.run("biquad q15", BENCH_SAMPLES, [&]() { biquad.process(block, block, BENCH_SAMPLES); });
+
+  static q31_t wide[BENCH_SAMPLES];
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    wide[i] = (q31_t) block[i] << 16;
+  }
+  BiquadQ31 biquad31(BiquadCoeffs::highPass(FILTER_CUTOFF, SAMPLE_RATE));
+  bench.run("biquad q31", BENCH_SAMPLES, [&]() { biquad31.process(wide, wide, BENCH_SAMPLES); });
+
+  static const q15_t taps[16] = { 2048, 2048, 2048, 2048, 2048, 2048, 2048, 2048,
+                                  2048, 2048, 2048, 2048, 2048, 2048, 2048, 2048 };
+  FirQ15<16> fir(taps);
+  bench.run("fir16 q15", BENCH_SAMPLES, [&]() { fir.process(block, block, BENCH_SAMPLES); });
+
+  DcBlockerQ15 dc;
+  bench.run("dc q15", BENCH_SAMPLES, [&]() { dc.process(block, block, BENCH_SAMPLES); });
+
+  static MultiRateDecimator<2, BENCH_SAMPLES> rates;
+  rates.configure(0, -1, 16);
+  rates.configure(1, 0, 100);
+  bench.run("cic 16+100 xyz", BENCH_SAMPLES, [&]() { rates.process(block, BENCH_SAMPLES); });
+
+  static SpectrumAnalyzer<FFT_SIZE, SPECTRUM_BANDS> analyzer(SAMPLE_RATE);
+  bench.run("fft xyz", FFT_SIZE, [&]() {
+    for (int i = 0; i < FFT_SIZE; i++) {
+      analyzer.feed(block[3 * i], block[3 * i + 1], block[3 * i + 2]);
+    }
+  });
+
+  static const int32_t accel[3] = { 12, -35, 998 };
+  static const int32_t gyro[3] = { 1500, -800, 250 };
+  static const int32_t mag[3] = { 220, -45, -410 };
+  MadgwickAhrs madgwick;
+  bench.run("madgwick 9dof", 100, [&]() {
+    for (int i = 0; i < 100; i++) {
+      madgwick.update(accel, gyro, mag, 0.0025f);
+    }
+  });
+  MahonyAhrs mahony;
+  bench.run("mahony 9dof", 100, [&]() {
+    for (int i = 0; i < 100; i++) {
+      mahony.update(accel, gyro, mag, 0.0025f);
+    }
+  });
+
+  StreamFilter stream;
+  stream.configure(BiquadCoeffs::lowPass(FILTER_CUTOFF, SAMPLE_RATE), true);
+  bench.run("stream xyz", BENCH_SAMPLES, [&]() { stream.process(block, BENCH_SAMPLES); });
+
+  // The driver's own cost per read, over a register file instead of a bus
+  static LSM6DS3Driver<RegisterFileTransport> ds3(RegisterFileTransport(), NC);
+  int32_t axes[3];
+  bench.run("ds3 accel", 1, [&]() { ds3.Get_X_Axes(axes); });
+#if BATCH_SIZE
+  static int16_t fifo[BATCH_SIZE * 3];
+  bench.run("ds3 fifo", BATCH_SIZE, [&]() { ds3.Read_X_FIFO(fifo, BATCH_SIZE); });
+#endif
+}
+#endif
+
+// Processing stage: every block acquisition hands over goes through the
+// filters and the averaging here, then the periodic reports. Above output so
+// printing never holds it up, with normal bus priority for the AHRS reads.
+// It owns the configuration, the bus plan and the magnetometer calibration,
+// so it reports and loads them first.
+void processSamples(void const*) {
+  bus.setThreadPriority(osThreadGetId(), BUS_PRIORITY_NORMAL);
+  sampleQueue.setConsumer(osThreadGetId(), STAGE_SIGNAL);
+  reportConfig(config);
+  reportMemory();
+  updateBusPlan();
+#if MAG_CAL
+  loadMagCalibration();
+#endif
+  SampleBlock block;
+  while (true) {
+    while (sampleQueue.pop(block)) {
+      if (!batched) {
+        jitter.record(block.timestamp);
+      }
+      processBlock(block.xyz, block.count, block.timestamp);
+      power.addSamples(block.count);
+    }
+    if (configPending) {
+      applyPendingConfig();
+    }
+    reportBoot();
+    reportPower();
+    reportJitter();
+    reportLatency();
+    reportMetrics();
+#if PROFILE
+    reportProfile();
+#endif
+    Thread::signal_wait(STAGE_SIGNAL);
+  }
 }
 
 /* Simple main function */
@@ -150,42 +1961,99 @@ int main() {
 
 #if DEBUG
   uint8_t id;
-  accelerometer->ReadID(&id);
-  char message[50];
-  sprintf(message, "LSM6DS0 Accelerometer             = 0x%X\r\n", id);
-  sendMessage(message);
+  if (accelerometer != NULL && accelerometer->ReadID(&id) == 0) {
+    char message[50];
+    sprintf(message, "LSM6DS0 Accelerometer             = 0x%X\r\n", id);
+    sendMessage(message);
+  }
 #endif
 
-  Thread logging(printMessages);
-  ticker.attach(&sampleData, 0.1);
+#if PROFILE
+  startProfiler();
+#endif
+  Thread output(printMessages, NULL, OUTPUT_PRIORITY, sizeof(outputStack), (unsigned char*) outputStack);
+#if COMMANDS
+  Thread console(runCommands, NULL, osPriorityBelowNormal, sizeof(consoleStack), (unsigned char*) consoleStack);
+  pc.attach(&serialRx, Serial::RxIrq);
+#endif
+  registerMetrics();
+  mems_expansion_board->dev_i2c->attach_error_handler(&countI2cError);
+  mems_expansion_board->dev_i2c->attach_arbiter(&bus);
+  mems_expansion_board->dev_i2c->attach_stats(&i2cStats);
+#if IMU_SPI
+  imuSpi.attach_arbiter(&spiBus);
+  imuSpi.frequency(IMU_SPI_HZ);
+#endif
+  lastMetricsUs = us_ticker_read();
+  boot.mark("threads");
+#if BENCHMARK
+  runBenchmarks();
+  boot.mark("bench");
+#endif
+#if FILTER
+  accelFilter.configure(BiquadCoeffs::lowPass(FILTER_CUTOFF, config.rate));
+#endif
+#if DECIMATE
+  configureDecimator(config.rate);
+#endif
+#if EVENTS
+  Thread eventWorker(&EventPipeline::thread, &events, osPriorityAboveNormal, sizeof(eventsStack),
+                     (unsigned char*) eventsStack);
+  events.subscribe(EVENT_MASK, &logEvent);
+  if (!events.configure()) {
+    sendMessage("Events: LSM6DS3 not available\r\n");
+  }
+  boot.mark("events");
+#endif
+  // Start the FIFO before mounting the log, it fills while the flash is
+  // scanned. INT1 goes first so the threshold edge can't come unseen.
+  if (imu != NULL) {
+    imu->Attach_INT1_IRQ(&int1Edge);
+  }
+  batched = startBatching();
+  if (imu != NULL) {
+    imu->Enable_Free_Fall_Detection_IRQ();
+  }
+  Thread processing(processSamples, NULL, PROCESS_PRIORITY, sizeof(processStack), (unsigned char*) processStack);
+  Thread acquisition(acquireSamples, NULL, ACQUIRE_PRIORITY, sizeof(acquireStack), (unsigned char*) acquireStack);
+  if (batched) {
+    fifoPrime.attach_us(&primeFifo, 2 * samplePeriodUs);
+  }
+  boot.mark("fifo");
+#if FLASH_LOG
+  // Processing appends as soon as it sees flashMounted, both mounts first
+  flashLock.lock();
+  bool mounted = flashLog.mount();
+  if (mounted) {
+    series.mount();
+  }
+  flashLock.unlock();
+  flashMounted = mounted;
+  reportFlash();
+  boot.mark("flash");
+#endif
+#if ENVIRONMENT
+  Thread environment(pollEnvironment, NULL, osPriorityBelowNormal, sizeof(environmentStack),
+                     (unsigned char*) environmentStack);
+#endif
+#if MAG_CAL
+  Thread magCalSaver(saveMagCalibrations, NULL, osPriorityBelowNormal, sizeof(magCalStack),
+                     (unsigned char*) magCalStack);
+#endif
+  if (accelerometer == NULL) {
+    // Nothing ever wakes acquisition then, the console and the log still work
+    sendMessage("Sampling: no accelerometer, not sampling\r\n");
+  } else if (!batched) {
+    ticker.attach(&sampleData, 1.0f / config.rate);
+  }
+  boot.mark("setup");
 
+  // The stages do the work from here, this thread only sleeps between
+  // interrupts and so has to sit below every one of them
+  osThreadSetPriority(osThreadGetId(), osPriorityLow);
   while(1) {
-    osEvent evt = dataMailBox.get();
-    if (evt.status == osEventMail) {
-      Data* mailData = (Data*) evt.value.p;
-      samples[sampleCount] = *mailData;
-      sampleCount = (sampleCount + 1) % CAPACITY;
-      if (sampleCount == MAX_ITEMS) {
-        averageLock->lock();
-        Data averages;
-#if DEBUG
-        sendMessage("Main got lock\r\n");
-#endif
-        for (int i = 0; i < MAX_ITEMS; i++) {
-          averages = averages + samples[i];
-        }
-        averages = averages / 10;
-        char message[64];
-        sprintf(message, "Average: \tx: %ld\t y: %ld\t z: %ld\r\n", averages.x(), averages.y(), averages.z());
-        sendMessage(message);
-        averages = Data();
-        averageLock->unlock();
-#if DEBUG
-        sendMessage("Main lost lock\r\n");
-#endif
-      }
-      dataMailBox.free(mailData);
-      sleep();
-    }
+    // INT1 is an EXTI line so STOP mode is safe once the log is flushed, but
+    // the Ticker stops in STOP mode so without the FIFO only light sleep is
+    power.idle(dataReady, batched && config.deepSleep && pendingMessages == 0 && !PROFILE);
   }
 }
@@ -0,0 +1,28 @@
+#ifndef __MEMBUDGET_H__
+#define __MEMBUDGET_H__
+#include <stddef.h>
+#include <stdint.h>
+
+// STM32F401RE SRAM
+#ifndef RAM_SIZE_BYTES
+#define RAM_SIZE_BYTES (96 * 1024)
+#endif
+// What a table of static objects can't see: the main and ISR stacks, RTX's
+// own data, newlib's stdio buffers and the small globals left out
+#ifndef RAM_RESERVED_BYTES
+#define RAM_RESERVED_BYTES (16 * 1024)
+#endif
+
+// Static RAM of one subsystem
+struct MemoryItem {
+  const char* name;
+  uint32_t bytes;
+};
+
+// Sum of a table of them, at compile time so a static_assert can hold the
+// build to RAM_SIZE_BYTES - RAM_RESERVED_BYTES
+constexpr uint32_t memoryTotal(const MemoryItem* items, size_t count) {
+  return count == 0 ? 0 : items[0].bytes + memoryTotal(items + 1, count - 1);
+}
+
+#endif //__MEMBUDGET_H__
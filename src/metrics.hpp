@@ -0,0 +1,135 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include "latency.hpp"
+
+#ifndef METRICS_MAX
+#define METRICS_MAX 28
+#endif
+// Snapshot lines are split to fit a log message
+#ifndef METRICS_LINE_SIZE
+#define METRICS_LINE_SIZE 120
+#endif
+
+// Monotonic event count, safe to bump from ISRs and any thread
+class Counter {
+  std::atomic<uint32_t> _value;
+
+public:
+  Counter() : _value(0) {};
+
+  void increment(uint32_t n = 1) {
+    _value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  uint32_t value() const {
+    return _value.load(std::memory_order_relaxed);
+  }
+};
+
+// Current level of something, e.g. a queue depth
+class Gauge {
+  std::atomic<int32_t> _value;
+
+public:
+  Gauge() : _value(0) {};
+
+  void set(int32_t value) {
+    _value.store(value, std::memory_order_relaxed);
+  }
+
+  void add(int32_t delta) {
+    _value.fetch_add(delta, std::memory_order_relaxed);
+  }
+
+  int32_t value() const {
+    return _value.load(std::memory_order_relaxed);
+  }
+};
+
+// Named view over metrics owned elsewhere. Registration happens once at start
+// up; the hot paths only ever touch the metric objects themselves. Names are
+// kept short since every snapshot prints them.
+class MetricsRegistry {
+  enum Kind { COUNTER, GAUGE, HISTOGRAM };
+
+  struct Entry {
+    const char* name;
+    Kind kind;
+    const void* metric;
+  };
+
+  Entry _entries[METRICS_MAX];
+  int _count;
+
+  bool add(const char* name, Kind kind, const void* metric) {
+    if (_count == METRICS_MAX) {
+      return false;
+    }
+    _entries[_count].name = name;
+    _entries[_count].kind = kind;
+    _entries[_count].metric = metric;
+    _count++;
+    return true;
+  }
+
+  // " name=value", histograms as " name=count/p99/max"
+  static int format(const Entry& entry, char* out, size_t size) {
+    switch (entry.kind) {
+    case COUNTER:
+      return snprintf(out, size, " %s=%" PRIu32, entry.name, ((const Counter*) entry.metric)->value());
+    case GAUGE:
+      return snprintf(out, size, " %s=%" PRId32, entry.name, ((const Gauge*) entry.metric)->value());
+    case HISTOGRAM: {
+      const LatencyHistogram* histogram = (const LatencyHistogram*) entry.metric;
+      return snprintf(out, size, " %s=%" PRIu32 "/%" PRIu32 "/%" PRIu32, entry.name, histogram->count(),
+                      histogram->percentile(99), histogram->max());
+    }
+    }
+    return 0;
+  }
+
+public:
+  MetricsRegistry() : _count(0) {};
+
+  bool add(const char* name, const Counter& counter) {
+    return add(name, COUNTER, &counter);
+  }
+
+  bool add(const char* name, const Gauge& gauge) {
+    return add(name, GAUGE, &gauge);
+  }
+
+  bool add(const char* name, const LatencyHistogram& histogram) {
+    return add(name, HISTOGRAM, &histogram);
+  }
+
+  // Emit every metric as compact "Metrics a=1 b=2 ..." lines
+  void snapshot(void (*emit)(const char*)) const {
+    char line[METRICS_LINE_SIZE];
+    char item[METRICS_LINE_SIZE];
+    int length = sprintf(line, "Metrics");
+    for (int i = 0; i < _count; i++) {
+      int itemLength = format(_entries[i], item, sizeof(item));
+      if (itemLength >= (int) sizeof(item) - 3) {
+        itemLength = sizeof(item) - 3;
+        item[itemLength] = 0;
+      }
+      if (length + itemLength + 3 > METRICS_LINE_SIZE) {
+        strcpy(line + length, "\r\n");
+        emit(line);
+        length = sprintf(line, "Metrics");
+      }
+      strcpy(line + length, item);
+      length += itemLength;
+    }
+    strcpy(line + length, "\r\n");
+    emit(line);
+  }
+};
+
+#endif //__METRICS_H__
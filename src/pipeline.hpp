@@ -0,0 +1,192 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+#include "mbed.h"
+#include "rtos.h"
+#include <atomic>
+#include <string.h>
+#include "metrics.hpp"
+
+// How long a blocked producer sleeps between retries
+#ifndef STAGE_QUEUE_WAIT_MS
+#define STAGE_QUEUE_WAIT_MS 1
+#endif
+
+// What a full queue does to whoever pushes
+enum Backpressure {
+  BACKPRESSURE_DROP,      // the new item is dropped and counted, the producer never waits
+  BACKPRESSURE_BLOCK      // the producer waits for a slot; ISRs can't, theirs are dropped
+};
+
+// Traffic through one queue over a reporting window
+struct StageWindow {
+  uint32_t pushed;
+  uint32_t popped;
+  uint32_t dropped;
+  uint32_t waits;         // pushes that had to wait for a slot
+  uint32_t maxDepth;
+  uint32_t windowUs;
+};
+
+// Bounded queue between two pipeline stages, N items, N a power of two.
+//
+// Lock free for any number of producers and consumers (Vyukov's bounded
+// queue): each slot carries a sequence number saying whose turn it is, and a
+// position is claimed with one compare and swap, so ISRs and threads of any
+// priority can push without a mutex between them. A producer preempted
+// between claiming and filling a slot holds up the items behind it until it
+// resumes; they aren't lost, and its push wakes the consumer again.
+//
+// Full queues follow the queue's Backpressure. A consumer thread set with
+// setConsumer() is signalled on every push; it should drain, then wait.
+template <class T, uint32_t N>
+class StageQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "StageQueue size must be a power of two");
+
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    T item;
+  };
+
+  Slot _slots[N];
+  std::atomic<uint32_t> _enqueue;
+  std::atomic<uint32_t> _dequeue;
+  Backpressure _policy;
+  osThreadId _consumer;
+  int32_t _signal;
+  Counter _pushed;
+  Counter _popped;
+  Counter _dropped;
+  Counter _waits;
+  std::atomic<uint32_t> _maxDepth;
+  StageWindow _last;
+  uint32_t _windowStartUs;
+
+  bool tryPush(const T& item) {
+    uint32_t pos = _enqueue.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+      slot = &_slots[pos & (N - 1)];
+      int32_t diff = (int32_t) (slot->sequence.load(std::memory_order_acquire) - pos);
+      if (diff == 0) {
+        if (_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = _enqueue.load(std::memory_order_relaxed);
+      }
+    }
+    slot->item = item;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    _pushed.increment();
+    // Close enough with several producers, it's a high-water mark
+    uint32_t depth = size();
+    if (depth > _maxDepth.load(std::memory_order_relaxed)) {
+      _maxDepth.store(depth, std::memory_order_relaxed);
+    }
+    if (_consumer != NULL) {
+      osSignalSet(_consumer, _signal);
+    }
+    return true;
+  }
+
+public:
+  StageQueue(Backpressure policy)
+      : _enqueue(0), _dequeue(0), _policy(policy), _consumer(NULL), _signal(0), _maxDepth(0),
+        _windowStartUs(us_ticker_read()) {
+    for (uint32_t i = 0; i < N; i++) {
+      _slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    memset(&_last, 0, sizeof(_last));
+  };
+
+  // From the consumer thread before it first waits
+  void setConsumer(osThreadId thread, int32_t signal) {
+    _signal = signal;
+    _consumer = thread;
+  }
+
+  // Returns false if the item was dropped
+  bool push(const T& item) {
+    if (tryPush(item)) {
+      return true;
+    }
+    if (_policy == BACKPRESSURE_DROP || __get_IPSR() != 0) {
+      _dropped.increment();
+      return false;
+    }
+    _waits.increment();
+    while (!tryPush(item)) {
+      Thread::wait(STAGE_QUEUE_WAIT_MS);
+    }
+    return true;
+  }
+
+  bool pop(T& item) {
+    uint32_t pos = _dequeue.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+      slot = &_slots[pos & (N - 1)];
+      int32_t diff = (int32_t) (slot->sequence.load(std::memory_order_acquire) - (pos + 1));
+      if (diff == 0) {
+        if (_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = _dequeue.load(std::memory_order_relaxed);
+      }
+    }
+    item = slot->item;
+    slot->sequence.store(pos + N, std::memory_order_release);
+    _popped.increment();
+    return true;
+  }
+
+  uint32_t size() const {
+    return _enqueue.load(std::memory_order_acquire) - _dequeue.load(std::memory_order_acquire);
+  }
+
+  uint32_t capacity() const {
+    return N;
+  }
+
+  Backpressure policy() const {
+    return _policy;
+  }
+
+  // Since start, for the metrics registry
+  const Counter& dropped() const {
+    return _dropped;
+  }
+
+  const Counter& waits() const {
+    return _waits;
+  }
+
+  // Traffic since the last call, from one thread only
+  StageWindow close() {
+    uint32_t now = us_ticker_read();
+    StageWindow total;
+    total.pushed = _pushed.value();
+    total.popped = _popped.value();
+    total.dropped = _dropped.value();
+    total.waits = _waits.value();
+
+    StageWindow window;
+    window.pushed = total.pushed - _last.pushed;
+    window.popped = total.popped - _last.popped;
+    window.dropped = total.dropped - _last.dropped;
+    window.waits = total.waits - _last.waits;
+    window.maxDepth = _maxDepth.exchange(size(), std::memory_order_relaxed);
+    window.windowUs = now - _windowStartUs;
+    _last = total;
+    _windowStartUs = now;
+    return window;
+  }
+};
+
+#endif //__PIPELINE_H__
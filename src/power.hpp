@@ -0,0 +1,127 @@
+#ifndef __POWER_H__
+#define __POWER_H__
+#include "mbed.h"
+
+// Typical STM32F401 supply currents at 84MHz (uA), override per board after
+// measuring. Used only to turn run/sleep time into an energy estimate.
+#ifndef POWER_RUN_UA
+#define POWER_RUN_UA 11000
+#endif
+#ifndef POWER_SLEEP_UA
+#define POWER_SLEEP_UA 4500
+#endif
+#ifndef POWER_DEEPSLEEP_UA
+#define POWER_DEEPSLEEP_UA 50
+#endif
+#ifndef POWER_SUPPLY_MV
+#define POWER_SUPPLY_MV 3300
+#endif
+
+// Time and energy accounting for one reporting window
+struct PowerWindow {
+  uint32_t runUs;
+  uint32_t sleepUs;
+  uint32_t deepSleepUs;
+  uint32_t wakeups;
+  uint32_t samples;
+
+  PowerWindow() : runUs(0), sleepUs(0), deepSleepUs(0), wakeups(0), samples(0) {};
+
+  // Energy spent over the window in nJ
+  uint32_t energyNj() const {
+    uint64_t uaUs = (uint64_t) runUs * POWER_RUN_UA +
+                    (uint64_t) sleepUs * POWER_SLEEP_UA +
+                    (uint64_t) deepSleepUs * POWER_DEEPSLEEP_UA;
+    return (uint32_t) (uaUs * POWER_SUPPLY_MV / 1000000);
+  }
+
+  uint32_t njPerSample() const {
+    return samples ? energyNj() / samples : 0;
+  }
+
+  // Run time share in 1/10 of a percent
+  uint32_t dutyPermille() const {
+    uint32_t total = runUs + sleepUs + deepSleepUs;
+    return total ? (uint32_t) ((uint64_t) runUs * 1000 / total) : 0;
+  }
+};
+
+// Wraps sleep()/deepsleep() so the time the MCU spends awake vs asleep can be
+// accounted per window.
+//
+// The us ticker stops in STOP mode, so deep sleep can't be timed directly.
+// Instead the sensor is used as the clock: a window that delivered N samples
+// at a fixed period lasted N * period, and whatever isn't run or light sleep
+// time was spent in deep sleep.
+class PowerManager {
+  PowerWindow _window;
+  uint32_t _awakeSince;
+  volatile bool _asleep;
+
+public:
+  PowerManager() : _awakeSince(us_ticker_read()), _asleep(false) {};
+
+  // Sleep until `ready` is set by an ISR or by a thread one woke. Deep sleep
+  // is only entered when the caller says it is safe, i.e. the wakeup source
+  // still works in STOP mode (EXTI pin, not a Ticker) and nothing is waiting
+  // on the UART. Meant for the lowest priority thread: whatever runs between
+  // a wakeup and the next sleep is run time.
+  void idle(volatile bool& ready, bool deepAllowed) {
+    uint32_t now = us_ticker_read();
+    _window.runUs += now - _awakeSince;
+
+    __disable_irq();
+    _asleep = true;
+    while (!ready) {
+      uint32_t before = us_ticker_read();
+      if (deepAllowed) {
+        deepsleep();
+      } else {
+        sleep();
+        _window.sleepUs += us_ticker_read() - before;
+      }
+      // Let the pending ISR run, and any thread it wakes, so `ready` can be set
+      uint32_t woke = us_ticker_read();
+      __enable_irq();
+      __disable_irq();
+      _window.runUs += us_ticker_read() - woke;
+    }
+    ready = false;
+    _asleep = false;
+    __enable_irq();
+
+    _window.wakeups++;
+    _awakeSince = us_ticker_read();
+  }
+
+  // For ISRs: whether the caller of idle() was asleep, rather than busy, when
+  // they came in
+  bool asleep() const {
+    return _asleep;
+  }
+
+  void addSamples(uint32_t count) {
+    _window.samples += count;
+  }
+
+  uint32_t samples() const {
+    return _window.samples;
+  }
+
+  // Close the current window, attributing unaccounted time to deep sleep
+  PowerWindow close(uint32_t samplePeriodUs) {
+    uint32_t now = us_ticker_read();
+    _window.runUs += now - _awakeSince;
+    _awakeSince = now;
+
+    uint32_t wallUs = _window.samples * samplePeriodUs;
+    uint32_t accounted = _window.runUs + _window.sleepUs;
+    _window.deepSleepUs = wallUs > accounted ? wallUs - accounted : 0;
+
+    PowerWindow result = _window;
+    _window = PowerWindow();
+    return result;
+  }
+};
+
+#endif //__POWER_H__
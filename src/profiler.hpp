@@ -0,0 +1,183 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+#include "mbed.h"
+#include "cycles.hpp"
+
+#ifndef PROFILE_MAX_THREADS
+#define PROFILE_MAX_THREADS 7
+#endif
+#ifndef PROFILE_MAX_ISRS
+#define PROFILE_MAX_ISRS 6
+#endif
+// RTX's own stack fill, so a stack reads the same whether or not RTX fills
+// it again when the thread is created
+#ifndef PROFILE_STACK_PATTERN
+#define PROFILE_STACK_PATTERN 0xE25A2EA5u
+#endif
+
+struct ThreadProfile {
+  const char* name;
+  const uint32_t* stack;      // lowest word
+  uint32_t stackBytes;
+  uint32_t samples;
+};
+
+struct IsrProfile {
+  const char* name;
+  uint32_t calls;
+  uint32_t cycles;
+  uint32_t maxCycles;
+};
+
+// One reporting window
+struct ProfileWindow {
+  ThreadProfile threads[PROFILE_MAX_THREADS];
+  uint8_t threadCount;
+  IsrProfile isrs[PROFILE_MAX_ISRS];
+  uint8_t isrCount;
+  uint32_t samples;           // all of them
+  uint32_t otherSamples;      // in no registered thread's stack
+  uint32_t sleepSamples;      // the main loop asleep
+  uint32_t windowUs;
+};
+
+// Where the CPU goes, per thread and per ISR, and how deep each stack has
+// been.
+//
+// Threads are sampled: a periodic ISR calls sample() with the stack pointer
+// of the thread it interrupted (PSP) and the thread whose stack holds it
+// gets the sample. Threads whose stacks weren't registered, the main thread
+// and RTX's own, share the "other" count. The ISRs worth knowing about are
+// timed exactly instead, with the DWT cycle counter from entry to exit; a
+// higher priority ISR that cuts in is counted in both.
+//
+// Stack depth is the high-water mark: stacks are painted before their
+// thread starts and the deepest word no longer holding the paint is the
+// most the thread has ever used.
+class Profiler {
+  ThreadProfile _threads[PROFILE_MAX_THREADS];
+  uint8_t _threadCount;
+  IsrProfile _isrs[PROFILE_MAX_ISRS];
+  uint8_t _isrCount;
+  uint32_t _samples;
+  uint32_t _otherSamples;
+  uint32_t _sleepSamples;
+  uint32_t _windowStartUs;
+
+public:
+  Profiler() : _threadCount(0), _isrCount(0), _samples(0), _otherSamples(0), _sleepSamples(0),
+               _windowStartUs(us_ticker_read()) {};
+
+  // Before the thread is created on it
+  static void paint(void* stack, uint32_t bytes) {
+    uint32_t* words = (uint32_t*) stack;
+    for (uint32_t i = 0; i < bytes / 4; i++) {
+      words[i] = PROFILE_STACK_PATTERN;
+    }
+  }
+
+  bool addThread(const char* name, const void* stack, uint32_t bytes) {
+    if (_threadCount == PROFILE_MAX_THREADS) {
+      return false;
+    }
+    ThreadProfile& thread = _threads[_threadCount++];
+    thread.name = name;
+    thread.stack = (const uint32_t*) stack;
+    thread.stackBytes = bytes;
+    thread.samples = 0;
+    return true;
+  }
+
+  // Returns the id to time the ISR with, -1 if there's no room
+  int addIsr(const char* name) {
+    if (_isrCount == PROFILE_MAX_ISRS) {
+      return -1;
+    }
+    IsrProfile& isr = _isrs[_isrCount];
+    memset(&isr, 0, sizeof(isr));
+    isr.name = name;
+    return _isrCount++;
+  }
+
+  // From the sampling ISR: `sp` is the interrupted thread's stack pointer,
+  // `asleep` that the main loop was in its idle sleep. Threads the wakeup
+  // ran before the main loop got back are theirs, not sleep.
+  void sample(uint32_t sp, bool asleep) {
+    _samples++;
+    for (uint8_t i = 0; i < _threadCount; i++) {
+      uint32_t base = (uint32_t) (uintptr_t) _threads[i].stack;
+      if (sp - base < _threads[i].stackBytes) {
+        _threads[i].samples++;
+        return;
+      }
+    }
+    if (asleep) {
+      _sleepSamples++;
+      return;
+    }
+    _otherSamples++;
+  }
+
+  void addIsrCycles(int id, uint32_t cycles) {
+    if (id < 0) {
+      return;
+    }
+    IsrProfile& isr = _isrs[id];
+    isr.calls++;
+    isr.cycles += cycles;
+    if (cycles > isr.maxCycles) {
+      isr.maxCycles = cycles;
+    }
+  }
+
+  // Deepest the thread's stack has been, in bytes. The bottom word is
+  // skipped, RTX keeps its overflow check there.
+  uint32_t stackUsed(uint8_t i) const {
+    const ThreadProfile& thread = _threads[i];
+    uint32_t words = thread.stackBytes / 4;
+    uint32_t untouched = 1;
+    while (untouched < words && thread.stack[untouched] == PROFILE_STACK_PATTERN) {
+      untouched++;
+    }
+    return thread.stackBytes - untouched * 4;
+  }
+
+  // Copy the counts out and start a new window
+  void close(ProfileWindow* out) {
+    __disable_irq();
+    uint32_t now = us_ticker_read();
+    memcpy(out->threads, _threads, sizeof(_threads));
+    out->threadCount = _threadCount;
+    memcpy(out->isrs, _isrs, sizeof(_isrs));
+    out->isrCount = _isrCount;
+    out->samples = _samples;
+    out->otherSamples = _otherSamples;
+    out->sleepSamples = _sleepSamples;
+    out->windowUs = now - _windowStartUs;
+    for (uint8_t i = 0; i < _threadCount; i++) {
+      _threads[i].samples = 0;
+    }
+    for (uint8_t i = 0; i < _isrCount; i++) {
+      _isrs[i].calls = _isrs[i].cycles = _isrs[i].maxCycles = 0;
+    }
+    _samples = _otherSamples = _sleepSamples = 0;
+    _windowStartUs = now;
+    __enable_irq();
+  }
+};
+
+// Times an ISR from construction to the end of the scope
+class IsrScope {
+  Profiler& _profiler;
+  int _id;
+  uint32_t _start;
+
+public:
+  IsrScope(Profiler& profiler, int id) : _profiler(profiler), _id(id), _start(CycleCounter::now()) {};
+
+  ~IsrScope() {
+    _profiler.addIsrCycles(_id, CycleCounter::now() - _start);
+  }
+};
+
+#endif //__PROFILER_H__
@@ -0,0 +1,219 @@
+#ifndef __SPECTRUM_H__
+#define __SPECTRUM_H__
+#include <stdint.h>
+#include <math.h>
+#include "filter.hpp"
+
+struct ComplexQ15 {
+  q15_t re;
+  q15_t im;
+};
+
+// N point real FFT in Q15, computed as an N/2 point complex FFT on the
+// even/odd packed input followed by a split step. Every butterfly stage
+// scales by 1/2 so nothing can overflow; the result is X[k] / N.
+//
+// The twiddle table holds W_N^k for k < N/2, which also covers every
+// W_(N/2) factor the half length FFT needs.
+template <int N>
+class RealFftQ15 {
+  static const int M = N / 2;
+  static_assert(N >= 8 && (N & (N - 1)) == 0, "FFT size must be a power of two");
+
+  ComplexQ15 _twiddle[M];
+  ComplexQ15 _work[M];
+
+  static q15_t toQ15(float value) {
+    return saturate15((int64_t) lrintf(value * 32767.0f));
+  }
+
+  // A rotation can grow the larger part by up to sqrt(2), saturate rather
+  // than wrap
+  static ComplexQ15 multiply(ComplexQ15 a, ComplexQ15 b) {
+    ComplexQ15 r;
+    r.re = saturate15(((int64_t) a.re * b.re - (int64_t) a.im * b.im) >> 15);
+    r.im = saturate15(((int64_t) a.re * b.im + (int64_t) a.im * b.re) >> 15);
+    return r;
+  }
+
+  void bitReverse() {
+    for (int i = 1, j = 0; i < M; i++) {
+      int bit = M >> 1;
+      for (; j & bit; bit >>= 1) {
+        j ^= bit;
+      }
+      j ^= bit;
+      if (i < j) {
+        ComplexQ15 tmp = _work[i];
+        _work[i] = _work[j];
+        _work[j] = tmp;
+      }
+    }
+  }
+
+  void complexFft() {
+    bitReverse();
+    for (int size = 2; size <= M; size <<= 1) {
+      int half = size / 2;
+      int step = N / size;
+      for (int i = 0; i < M; i += size) {
+        for (int j = 0; j < half; j++) {
+          ComplexQ15 a = _work[i + j];
+          ComplexQ15 t = multiply(_work[i + j + half], _twiddle[j * step]);
+          _work[i + j].re = (q15_t) (((int32_t) a.re + t.re) >> 1);
+          _work[i + j].im = (q15_t) (((int32_t) a.im + t.im) >> 1);
+          _work[i + j + half].re = (q15_t) (((int32_t) a.re - t.re) >> 1);
+          _work[i + j + half].im = (q15_t) (((int32_t) a.im - t.im) >> 1);
+        }
+      }
+    }
+  }
+
+public:
+  RealFftQ15() {
+    for (int k = 0; k < M; k++) {
+      float angle = 2.0f * (float) M_PI * k / N;
+      _twiddle[k].re = toQ15(cosf(angle));
+      _twiddle[k].im = toQ15(-sinf(angle));
+    }
+  }
+
+  // Transform N real samples into bins 0..N/2-1 of the spectrum
+  void transform(const q15_t* in, ComplexQ15* out) {
+    for (int n = 0; n < M; n++) {
+      _work[n].re = in[2 * n];
+      _work[n].im = in[2 * n + 1];
+    }
+    complexFft();
+
+    for (int k = 0; k < M; k++) {
+      ComplexQ15 z = _work[k];
+      ComplexQ15 zc = _work[k == 0 ? 0 : M - k];
+      zc.im = -zc.im;
+
+      // Even part E = (Z[k] + Z*[M-k]) / 2, odd part O = -j (Z[k] - Z*[M-k]) / 2
+      ComplexQ15 even, odd;
+      even.re = (q15_t) (((int32_t) z.re + zc.re) >> 1);
+      even.im = (q15_t) (((int32_t) z.im + zc.im) >> 1);
+      odd.re = (q15_t) (((int32_t) z.im - zc.im) >> 1);
+      odd.im = (q15_t) (((int32_t) zc.re - z.re) >> 1);
+
+      ComplexQ15 t = multiply(odd, _twiddle[k]);
+      out[k].re = (q15_t) (((int32_t) even.re + t.re) >> 1);
+      out[k].im = (q15_t) (((int32_t) even.im + t.im) >> 1);
+    }
+  }
+};
+
+// Vibration spectrum over blocks of N accelerometer samples per axis.
+// Each block has its mean removed, is Hann windowed and normalised to full
+// Q15 scale before the FFT, then reduced to BANDS equal width band energies
+// and a peak frequency per axis. A summary is a few dozen bytes against
+// 6 * N bytes of raw samples.
+template <int N, int BANDS>
+class SpectrumAnalyzer {
+  static const int M = N / 2;
+  static_assert(BANDS >= 1 && BANDS < M, "Too many bands for the FFT size");
+
+public:
+  struct Summary {
+    uint32_t peakMilliHz[3];
+    uint32_t bandEnergy[3][BANDS];
+  };
+
+private:
+  RealFftQ15<N> _fft;
+  q15_t _window[N];
+  q15_t _block[3][N];
+  q15_t _scratch[N];
+  ComplexQ15 _bins[M];
+  int32_t _fill;
+  uint32_t _rateMilliHz;
+  Summary _summary;
+
+  // Left shift that brings the largest magnitude up to Q15 full scale
+  static int headroom(const q15_t* data) {
+    int32_t peak = 1;
+    for (int i = 0; i < N; i++) {
+      int32_t v = data[i] < 0 ? -(int32_t) data[i] : data[i];
+      if (v > peak) {
+        peak = v;
+      }
+    }
+    int shift = 0;
+    while ((peak << (shift + 1)) <= INT16_MAX) {
+      shift++;
+    }
+    return shift;
+  }
+
+  void analyse(int axis) {
+    int32_t mean = 0;
+    for (int n = 0; n < N; n++) {
+      mean += _block[axis][n];
+    }
+    mean /= N;
+
+    for (int n = 0; n < N; n++) {
+      _scratch[n] = saturate15((((int32_t) _block[axis][n] - mean) * _window[n]) >> 15);
+    }
+    int shift = headroom(_scratch);
+    for (int n = 0; n < N; n++) {
+      _scratch[n] = (q15_t) (_scratch[n] << shift);
+    }
+
+    _fft.transform(_scratch, _bins);
+
+    // Undo the normalisation on the energies; squared, so twice the shift
+    uint32_t peakPower = 0;
+    int peakBin = 0;
+    for (int b = 0; b < BANDS; b++) {
+      _summary.bandEnergy[axis][b] = 0;
+    }
+    for (int k = 1; k < M; k++) {
+      uint32_t power = (uint32_t) ((int32_t) _bins[k].re * _bins[k].re) +
+                       (uint32_t) ((int32_t) _bins[k].im * _bins[k].im);
+      if (power > peakPower) {
+        peakPower = power;
+        peakBin = k;
+      }
+      int band = (k - 1) * BANDS / (M - 1);
+      _summary.bandEnergy[axis][band] += power >> (2 * shift);
+    }
+    _summary.peakMilliHz[axis] = (uint32_t) ((uint64_t) peakBin * _rateMilliHz / N);
+  }
+
+public:
+  SpectrumAnalyzer(float sampleRate) : _fill(0), _rateMilliHz((uint32_t) (sampleRate * 1000.0f)) {
+    for (int n = 0; n < N; n++) {
+      _window[n] = saturate15((int64_t) lrintf(32767.0f * 0.5f * (1.0f - cosf(2.0f * (float) M_PI * n / N))));
+    }
+  }
+
+  // Add one sample, returns true when a block completed and summary() is fresh
+  bool feed(int32_t x, int32_t y, int32_t z) {
+    _block[0][_fill] = saturate15(x);
+    _block[1][_fill] = saturate15(y);
+    _block[2][_fill] = saturate15(z);
+    if (++_fill < N) {
+      return false;
+    }
+    _fill = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      analyse(axis);
+    }
+    return true;
+  }
+
+  // Restart block collection at a new rate, a block never mixes two rates
+  void setSampleRate(float sampleRate) {
+    _rateMilliHz = (uint32_t) (sampleRate * 1000.0f);
+    _fill = 0;
+  }
+
+  const Summary& summary() const {
+    return _summary;
+  }
+};
+
+#endif //__SPECTRUM_H__
@@ -0,0 +1,273 @@
+#ifndef __TIMESERIES_H__
+#define __TIMESERIES_H__
+#include <stdint.h>
+#include <string.h>
+#include "flashlog.hpp"
+
+#ifndef TIME_SERIES_BLOCK
+#define TIME_SERIES_BLOCK 256
+#endif
+// One index entry per this many blocks, the most a range query reads in
+// vain before reaching the range
+#ifndef TIME_SERIES_INDEX_EVERY
+#define TIME_SERIES_INDEX_EVERY 16
+#endif
+// Enough for the whole of a 3 sector log: 1445 blocks
+#ifndef TIME_SERIES_INDEX_SIZE
+#define TIME_SERIES_INDEX_SIZE 96
+#endif
+
+// Times are log time, microseconds of the board running since the log was
+// started: each boot carries on from the newest block in flash, so time
+// only grows across reboots and us_ticker wraps.
+struct TimeSeriesHeader {
+  uint64_t firstUs;     // time of the first sample, the block's minimum
+  uint64_t lastUs;      // and of the last, its maximum
+  uint32_t periodUs;
+  uint16_t count;
+  uint16_t bytes;       // of data used, the rest is left erased
+};
+
+// A fixed size block of X/Y/Z samples exactly periodUs apart, the payload
+// of one FlashLog block. The first sample, then for every other one the
+// difference of each axis to the sample before, is stored as a zigzag
+// varint: 7 bits a byte low first, the top bit set when more follow. Most
+// deltas of a sensor at rest take one byte, half of the raw size.
+//
+// Everything is little endian and naturally aligned, with FlashLog keeping
+// the block 8 byte aligned in flash, so host tools can map a flash image
+// and read blocks in place (scripts/tsquery.py).
+struct TimeSeriesBlock {
+  TimeSeriesHeader header;
+  uint8_t data[TIME_SERIES_BLOCK - sizeof(TimeSeriesHeader)];
+};
+
+// Samples in a block at most, every delta a byte
+#define TIME_SERIES_MAX_SAMPLES (sizeof(((TimeSeriesBlock*) 0)->data) / 3)
+
+// Time series of samples over a FlashLog the series has to itself.
+//
+// Samples are packed into a block in RAM until it is full, the rate changes
+// or a sample comes off the expected period by more than half a period,
+// a dropped sample for instance, so sample times decode exactly. A sparse
+// index in RAM maps the log time of every TIME_SERIES_INDEX_EVERY-th block
+// to its block number; a range query binary searches it and FlashLog seeks
+// to that block, so reading a range costs the blocks in it plus at most
+// TIME_SERIES_INDEX_EVERY - 1 before.
+class TimeSeries {
+  struct IndexEntry {
+    uint32_t block;
+    uint64_t firstUs;
+  };
+
+  FlashLog& _log;
+  IndexEntry _index[TIME_SERIES_INDEX_SIZE];
+  uint32_t _indexStart;
+  uint32_t _indexCount;
+  TimeSeriesBlock _block;     // being filled
+  int16_t _last[3];
+  uint64_t _epochUs;          // log time at us_ticker 0 of this boot
+  uint32_t _wraps;
+  uint32_t _lastTicker;
+  uint64_t _newestUs;
+
+  // Extend us_ticker to 64 bits, samples come far more often than it wraps
+  uint64_t logTime(uint32_t tickerUs) {
+    if (tickerUs < _lastTicker && _lastTicker - tickerUs > 0x80000000u) {
+      _wraps++;
+    }
+    _lastTicker = tickerUs;
+    return _epochUs + ((uint64_t) _wraps << 32 | tickerUs);
+  }
+
+  static uint16_t encode(int32_t value, uint8_t* out) {
+    uint32_t zigzag = ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+    uint16_t length = 0;
+    while (zigzag >= 0x80) {
+      out[length++] = (uint8_t) (zigzag | 0x80);
+      zigzag >>= 7;
+    }
+    out[length++] = (uint8_t) zigzag;
+    return length;
+  }
+
+  // Bytes `xyz` takes following the samples in the block, into `out`
+  uint16_t encodeSample(const int16_t* xyz, uint8_t* out) const {
+    uint16_t length = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      length += encode(xyz[axis] - (_block.header.count > 0 ? _last[axis] : 0), out + length);
+    }
+    return length;
+  }
+
+  void addIndex(uint32_t block, uint64_t firstUs) {
+    if (_indexCount > 0 &&
+        block < _index[(_indexStart + _indexCount - 1) % TIME_SERIES_INDEX_SIZE].block + TIME_SERIES_INDEX_EVERY) {
+      return;
+    }
+    if (_indexCount == TIME_SERIES_INDEX_SIZE) {
+      _indexStart = (_indexStart + 1) % TIME_SERIES_INDEX_SIZE;
+      _indexCount--;
+    }
+    IndexEntry& entry = _index[(_indexStart + _indexCount++) % TIME_SERIES_INDEX_SIZE];
+    entry.block = block;
+    entry.firstUs = firstUs;
+  }
+
+public:
+  TimeSeries(FlashLog& log)
+      : _log(log), _indexStart(0), _indexCount(0), _epochUs(0), _wraps(0), _lastTicker(0), _newestUs(0) {
+    memset(&_block, 0xFF, sizeof(_block));
+    _block.header.count = 0;
+    _block.header.bytes = 0;
+  };
+
+  // Rebuild the index and carry log time on from the newest block, after
+  // the log is mounted. Reads the header of every block, no samples.
+  void mount() {
+    FlashLogCursor cursor;
+    TimeSeriesHeader header;
+    uint16_t length;
+    uint32_t number;
+    _indexStart = 0;
+    _indexCount = 0;
+    _newestUs = 0;
+    _log.begin(cursor);
+    while (_log.peek(cursor, &header, sizeof(header), &length, &number)) {
+      if (length != sizeof(TimeSeriesBlock)) {
+        continue;
+      }
+      addIndex(number, header.firstUs);
+      if (header.lastUs + 1 > _newestUs) {
+        _newestUs = header.lastUs + 1;
+      }
+    }
+    if (_newestUs > _epochUs) {
+      _epochUs = _newestUs;
+    }
+  }
+
+  // Add one sample taken at us_ticker time `tickerUs`. Returns false if a
+  // block had to be written and that failed.
+  bool add(const int16_t* xyz, uint32_t tickerUs, uint32_t periodUs) {
+    uint64_t now = logTime(tickerUs);
+    TimeSeriesHeader& header = _block.header;
+    bool ok = true;
+    if (header.count > 0) {
+      uint64_t expected = header.firstUs + (uint64_t) header.count * header.periodUs;
+      uint64_t skew = now > expected ? now - expected : expected - now;
+      if (periodUs != header.periodUs || skew > periodUs / 2) {
+        ok = flush();
+      }
+    }
+    uint8_t encoded[9];
+    uint16_t length = encodeSample(xyz, encoded);
+    if (header.bytes + length > sizeof(_block.data)) {
+      ok = flush() && ok;
+      length = encodeSample(xyz, encoded);
+    }
+    if (header.count == 0) {
+      header.firstUs = now;
+      header.periodUs = periodUs;
+    }
+    memcpy(_block.data + header.bytes, encoded, length);
+    header.bytes += length;
+    header.lastUs = header.firstUs + (uint64_t) header.count * header.periodUs;
+    header.count++;
+    memcpy(_last, xyz, sizeof(_last));
+    return ok;
+  }
+
+  // Write out the block being filled, partial or not
+  bool flush() {
+    TimeSeriesHeader& header = _block.header;
+    if (header.count == 0) {
+      return true;
+    }
+    uint32_t number = _log.nextBlock();
+    bool ok = _log.append(&_block, sizeof(_block));
+    if (ok) {
+      addIndex(number, header.firstUs);
+      _newestUs = header.lastUs + 1;
+    }
+    memset(&_block, 0xFF, sizeof(_block));
+    header.count = 0;
+    header.bytes = 0;
+    return ok;
+  }
+
+  // Start reading at the newest indexed block starting at or before
+  // `fromUs`, or at the oldest block in flash
+  void seek(FlashLogCursor& cursor, uint64_t fromUs) const {
+    uint32_t low = 0;
+    uint32_t high = _indexCount;
+    while (low < high) {
+      uint32_t middle = (low + high) / 2;
+      if (_index[(_indexStart + middle) % TIME_SERIES_INDEX_SIZE].firstUs <= fromUs) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    _log.begin(cursor, low > 0 ? _index[(_indexStart + low - 1) % TIME_SERIES_INDEX_SIZE].block : 0);
+  }
+
+  // Next block with samples in [fromUs, toUs] after seek(). Returns false
+  // at the end of the range.
+  bool next(FlashLogCursor& cursor, uint64_t fromUs, uint64_t toUs, TimeSeriesBlock& block) {
+    uint16_t length;
+    while (_log.next(cursor, &block, sizeof(block), &length)) {
+      if (length != sizeof(block) || block.header.lastUs < fromUs) {
+        continue;
+      }
+      return block.header.firstUs <= toUs;
+    }
+    return false;
+  }
+
+  // Log time of the oldest sample in flash and just past the newest one,
+  // equal when there are none
+  void span(uint64_t* firstUs, uint64_t* endUs) {
+    FlashLogCursor cursor;
+    TimeSeriesHeader header;
+    uint16_t length;
+    _log.begin(cursor);
+    *firstUs = _newestUs;
+    *endUs = _newestUs;
+    while (_log.peek(cursor, &header, sizeof(header), &length)) {
+      if (length == sizeof(TimeSeriesBlock)) {
+        *firstUs = header.firstUs;
+        break;
+      }
+    }
+  }
+
+  // Unpack a block into `xyz`, room for TIME_SERIES_MAX_SAMPLES. Returns
+  // the number of samples, short if the data is cut off.
+  static uint16_t decode(const TimeSeriesBlock& block, int16_t* xyz) {
+    uint16_t count = 0;
+    uint32_t at = 0;
+    uint32_t end = block.header.bytes < sizeof(block.data) ? block.header.bytes : sizeof(block.data);
+    while (count < block.header.count && count < TIME_SERIES_MAX_SAMPLES) {
+      for (int axis = 0; axis < 3; axis++) {
+        uint32_t zigzag = 0;
+        for (int shift = 0;; shift += 7) {
+          if (at == end || shift > 28) {
+            return count;
+          }
+          uint8_t byte = block.data[at++];
+          zigzag |= (uint32_t) (byte & 0x7F) << shift;
+          if (!(byte & 0x80)) {
+            break;
+          }
+        }
+        int32_t delta = (int32_t) (zigzag >> 1) ^ -(int32_t) (zigzag & 1);
+        xyz[3 * count + axis] = (int16_t) (delta + (count > 0 ? xyz[3 * (count - 1) + axis] : 0));
+      }
+      count++;
+    }
+    return count;
+  }
+};
+
+#endif //__TIMESERIES_H__
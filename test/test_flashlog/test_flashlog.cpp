@@ -0,0 +1,131 @@
+// FlashLog on the file backed emulator: torn writes at every point of a
+// few appends, sector recycles included, then a remount and an append; and
+// erase counts staying level over many laps. Run with
+// `platformio test -e native`.
+#include <unity.h>
+#include <stdio.h>
+#include "../../src/flashlog.hpp"
+
+static const char* PATH = "test_flashlog.bin";
+static const uint32_t SECTOR_SIZE = 1024;
+static const uint32_t SECTORS = 4;
+
+// Block `value`: the value, then filler up to a length that varies with it,
+// not always a multiple of 4
+static uint16_t fill(uint32_t value, uint8_t* data) {
+  uint16_t length = 8 + value % 53;
+  memcpy(data, &value, 4);
+  for (uint16_t i = 4; i < length; i++) {
+    data[i] = (uint8_t) (value + i);
+  }
+  return length;
+}
+
+static bool append(FlashLog& log, uint32_t value) {
+  uint8_t data[64];
+  uint16_t length = fill(value, data);
+  return log.append(data, length);
+}
+
+// Every intact block in order, checking each payload. Returns how many.
+static uint32_t readAll(FlashLog& log, uint32_t* values, uint32_t size) {
+  FlashLogCursor cursor;
+  log.begin(cursor);
+  uint8_t data[64];
+  uint8_t expected[64];
+  uint16_t length;
+  uint32_t count = 0;
+  while (count < size && log.next(cursor, data, sizeof(data), &length)) {
+    uint32_t value;
+    memcpy(&value, data, 4);
+    TEST_ASSERT_EQUAL_UINT16(fill(value, expected), length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, data, length);
+    values[count++] = value;
+  }
+  return count;
+}
+
+void setUp() {
+  remove(PATH);
+}
+
+void tearDown() {
+  remove(PATH);
+}
+
+// Cut the power after `cut` more programmed words, some way into a sector
+// so the torn append is sometimes the one that recycles the next
+static void tornAt(uint32_t cut) {
+  uint32_t acked = 0;
+  {
+    FileFlash flash(PATH, SECTOR_SIZE, SECTORS);
+    FlashLog log(flash);
+    TEST_ASSERT_TRUE(log.mount());
+    uint32_t before = 100 + cut % 17;
+    for (uint32_t value = 1; value <= before; value++) {
+      TEST_ASSERT_TRUE(append(log, value));
+    }
+    acked = before;
+    flash.failAfter(cut);
+    while (append(log, acked + 1)) {
+      acked++;
+    }
+  }
+
+  FileFlash flash(PATH, SECTOR_SIZE, SECTORS);
+  FlashLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  uint32_t values[256];
+  uint32_t count = readAll(log, values, 256);
+  // Whatever survived is a run of acknowledged blocks ending at the last one
+  TEST_ASSERT_TRUE(count > 0);
+  TEST_ASSERT_EQUAL_UINT32(acked, values[count - 1]);
+  for (uint32_t i = 1; i < count; i++) {
+    TEST_ASSERT_EQUAL_UINT32(values[i - 1] + 1, values[i]);
+  }
+
+  // and appending carries on behind the torn block
+  TEST_ASSERT_TRUE(append(log, acked + 1));
+  count = readAll(log, values, 256);
+  TEST_ASSERT_EQUAL_UINT32(acked + 1, values[count - 1]);
+}
+
+void test_torn_writes() {
+  for (uint32_t cut = 0; cut < 120; cut += 2) {
+    setUp();
+    tornAt(cut);
+  }
+}
+
+void test_wear_levelling() {
+  FileFlash flash(PATH, SECTOR_SIZE, SECTORS);
+  FlashLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  for (uint32_t value = 1; value <= 3000; value++) {
+    TEST_ASSERT_TRUE(append(log, value));
+  }
+  uint32_t least = flash.erases(0);
+  uint32_t most = flash.erases(0);
+  for (uint32_t i = 1; i < SECTORS; i++) {
+    least = flash.erases(i) < least ? flash.erases(i) : least;
+    most = flash.erases(i) > most ? flash.erases(i) : most;
+  }
+  TEST_ASSERT_TRUE(least > 0);
+  TEST_ASSERT_TRUE(most - least <= 1);
+
+  FlashLogInfo info = log.info();
+  TEST_ASSERT_EQUAL_UINT32(least, info.minErases);
+  TEST_ASSERT_EQUAL_UINT32(most, info.maxErases);
+  TEST_ASSERT_EQUAL_UINT32(0, info.badSectors);
+
+  uint32_t values[256];
+  uint32_t count = readAll(log, values, 256);
+  TEST_ASSERT_EQUAL_UINT32(3000, values[count - 1]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_torn_writes);
+  RUN_TEST(test_wear_levelling);
+  return UNITY_END();
+}